@@ -0,0 +1,174 @@
+#ifndef __FBOX_CORE_ASYNC_LOGGER_H__
+#define __FBOX_CORE_ASYNC_LOGGER_H__
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Asynchronous logging
+*/
+
+
+#include "main.h"
+#include "logger.h"
+#include <boost/thread/detail/singleton.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace fbox {
+
+//! Asynchronous logger
+/*!
+	Each thread formats its records into its own buffer and appends them, length-prefixed, to its own
+	lock-free ring, so logging threads never wait on each other or on the output. A background thread
+	writes the records to the output stream straight from the rings and flushes the stream when it runs
+	out of records. Records from one thread keep their order; records from different threads are
+	interleaved whole. A thread only waits when its ring is full.
+
+	Use through FBOX_ALOG, which skips the formatting of records below the trigger level and compiles
+	out records below FBOX_LOG_MIN_LEVEL altogether. Threads that log must finish before the logger is
+	destroyed.
+*/
+class async_logger
+{
+public:
+	enum { DEFAULT_CAPACITY = 1 << 16 }; //!< Default ring size per thread, in bytes (rounded up to a power of two)
+
+	class record;
+
+	//! Create logger initialised to default settings (as set in fbox.xml)
+	async_logger();
+
+	//! Create logger connected with an existing output stream
+	async_logger(std::ostream& _stream,bool _head=true,logger::level_type _level=logger::WARNING,size_type _capacity=DEFAULT_CAPACITY);
+
+	//! Create file logger
+	async_logger(const std::string& _filename,bool _head=true,logger::level_type _level=logger::WARNING,size_type _capacity=DEFAULT_CAPACITY);
+
+	//! Write all pending records and stop the background thread
+	virtual ~async_logger();
+
+	//! Change trigger level
+	void set_trigger_level(logger::level_type _lv) { m_lv = _lv; }
+
+	//! True if records at level _lv are written
+	bool is_enabled(logger::level_type _lv) const { return _lv >= m_lv; }
+
+	//! Stream to format the calling thread's next record into
+	record& begin_record();
+
+	//! Queue the record formatted into _rec since begin_record(). Records that do not fit in the ring are truncated.
+	void end_record(record& _rec);
+
+	//! Wait until all records queued before the call are written, then flush the output
+	void flush();
+
+private:
+	//! Growable formatting buffer, reused for every record of a thread
+	class record_buffer : public std::streambuf
+	{
+	public:
+		record_buffer() : m_buffer(256) { clear(); }
+
+		void clear() { setp(&m_buffer[0],&m_buffer[0] + m_buffer.size()); }
+		char* data() { return pbase(); }
+		size_type size() const { return pptr() - pbase(); }
+
+	protected:
+		virtual int_type overflow(int_type _c);
+
+	private:
+		std::vector<char> m_buffer;
+	};
+
+	//! Single producer, single consumer ring of length-prefixed records
+	class ring
+	{
+	public:
+		typedef boost::uint32_t length_type;
+
+		//! _capacity must be a power of two, so that positions stay aligned with the ring when the counters wrap
+		explicit ring(size_type _capacity) : m_data(_capacity),m_mask(_capacity - 1),m_head(0),m_tail(0) {}
+
+		//! Largest record that fits
+		size_type max_record() const { return m_data.size() - sizeof(length_type); }
+
+		bool empty() const { return m_head.load(boost::memory_order_acquire) == m_tail.load(boost::memory_order_relaxed); }
+
+		//! Append a record of at most max_record() bytes, or return false if there is no room
+		bool push(const char* _data,size_type _n);
+
+		//! Write all the records present to _strm, and return false if there were none
+		bool pop(std::ostream& _strm);
+
+	private:
+		std::vector<char> m_data;
+		size_type m_mask;
+		boost::atomic<size_type> m_head;	//!< Bytes written so far, changed by the producer only
+		boost::atomic<size_type> m_tail;	//!< Bytes read so far, changed by the consumer only
+
+		void put(size_type _pos,const char* _data,size_type _n);
+		void get(size_type _pos,char* _data,size_type _n) const;
+	};
+
+	boost::atomic<int> m_lv;
+	flex_ptr<std::ostream> mp_stream;
+	bool m_head;
+	size_type m_capacity;						//!< Ring size, a power of two once started
+
+	std::vector<record*> m_buffers;				//!< All rings, owned here and reused after their threads exit
+	boost::thread_specific_ptr<record> m_local;
+	boost::mutex m_mutex;						//!< Guards m_buffers and the output stream
+	boost::condition_variable m_wake;
+	boost::atomic<bool> m_stop;
+	boost::atomic<size_type> m_passes;			//!< Completed passes over the rings
+	boost::thread m_thread;
+
+	void start();
+	record& local();
+	bool drain();
+	void run();
+
+	static void release(record* _rec);
+};
+
+
+//! Formatting stream and ring of one logging thread
+class async_logger::record : public std::ostream
+{
+public:
+	explicit record(size_type _capacity) : std::ostream(&m_buffer),m_ring(_capacity),m_in_use(true) {}
+
+private:
+	friend class async_logger;
+
+	record_buffer m_buffer;
+	ring m_ring;
+	boost::atomic<bool> m_in_use;
+};
+
+
+#ifndef FBOX_LOG_MIN_LEVEL
+	#define FBOX_LOG_MIN_LEVEL 0 //!< Records below this level are compiled out of FBOX_ALOG
+#endif
+
+#define FBOX_ALOG(_lv,_msg) { \
+	if ((_lv) >= FBOX_LOG_MIN_LEVEL) { \
+		fbox::async_logger& __logger__( boost::detail::thread::singleton<fbox::async_logger>::instance() ); \
+		if (__logger__.is_enabled(_lv)) { \
+			fbox::async_logger::record& __record__( __logger__.begin_record() ); \
+			__record__ << _msg << '\n'; \
+			__logger__.end_record(__record__); } } }
+
+
+} // namespace fbox
+
+#endif
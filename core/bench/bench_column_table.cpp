@@ -0,0 +1,61 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Timings of column table loaders
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <ctime>
+#include <map>
+#include <sstream>
+#include "../column_table.h"
+#include "../line.h"
+
+
+BOOST_AUTO_TEST_CASE(bench_load_csv)
+{
+	using namespace fbox;
+
+	std::ostringstream csv;
+	csv.precision(10);
+	csv << "curve,tenor,rate\n";
+	for(int i = 0; i < 500000; ++i) csv << "curve" << i / 10 << ',' << 0.5 * (i % 10 + 1) << ',' << 0.01 + 1e-7 * i << '\n';
+	std::string text = csv.str();
+
+	// stream parsing, as done by hand before
+	std::clock_t c0 = std::clock();
+	std::istringstream in(text);
+	std::string line,key;
+	std::getline(in,line);
+	std::vector<std::string> keys;
+	std::vector<double> x,y;
+	while (std::getline(in,line))
+	{
+		std::istringstream fields(line);
+		double a,b;
+		char comma;
+		std::getline(fields,key,',');
+		fields >> a >> comma >> b;
+		keys.push_back(key);
+		x.push_back(a);
+		y.push_back(b);
+	}
+
+	std::clock_t c1 = std::clock();
+	column_table t;
+	load_csv(text.data(),text.data() + text.size(),t,',',true,1);
+	std::clock_t c2 = std::clock();
+
+	std::map<std::string,math::linear_line> curves;
+	t.get_lines(0,1,2,curves);
+	std::clock_t c3 = std::clock();
+
+	BOOST_CHECK_EQUAL(x.size(),t.rows());
+	BOOST_CHECK(y == t.values(2));
+	BOOST_CHECK_EQUAL(50000,curves.size());
+	BOOST_MESSAGE("Loading " << text.size() / 1000 << "kB of CSV: streams " << double(c1 - c0) / CLOCKS_PER_SEC
+		<< "s, load_csv on one thread " << double(c2 - c1) / CLOCKS_PER_SEC << "s, building " << curves.size()
+		<< " lines " << double(c3 - c2) / CLOCKS_PER_SEC << "s");
+}
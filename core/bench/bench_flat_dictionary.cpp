@@ -0,0 +1,46 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Timings of flat dictionaries
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <ctime>
+#include <vector>
+#include "../flat_dictionary.h"
+
+
+BOOST_AUTO_TEST_CASE(bench_flat_dictionary)
+{
+	using namespace fbox;
+
+	const int n = 20000;
+	const char* names[] = { "notional","currency","maturity","strike","quantity","counterparty","book","rate" };
+
+	std::clock_t c0 = std::clock();
+	double sum0 = 0.0;
+	for(int i = 0; i < n; ++i)
+	{
+		dictionary d;
+		for(int k = 0; k < 8; ++k) d.insert(names[k],double(i + k));
+		for(int k = 0; k < 8; ++k) sum0 += d[names[k]].as_double();
+	}
+
+	std::clock_t c1 = std::clock();
+	std::vector<dictionary_key> keys(names,names + 8);
+	double sum1 = 0.0;
+	for(int i = 0; i < n; ++i)
+	{
+		flat_dictionary d;
+		d.reserve(8);
+		for(int k = 0; k < 8; ++k) d.insert(keys[k],double(i + k));
+		for(int k = 0; k < 8; ++k) sum1 += d[keys[k]].as_double();
+	}
+	std::clock_t c2 = std::clock();
+
+	BOOST_CHECK_EQUAL(sum0,sum1);
+	BOOST_MESSAGE("Building and reading " << n << " dictionaries of 8 entries: dictionary " << double(c1 - c0) / CLOCKS_PER_SEC
+		<< "s, flat_dictionary " << double(c2 - c1) / CLOCKS_PER_SEC << "s");
+}
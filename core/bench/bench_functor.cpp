@@ -0,0 +1,110 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Timings of the functor framework
+*/
+
+#include <ctime>
+#include <boost/test/unit_test.hpp>
+#include "../functor.h"
+
+using namespace fbox;
+
+namespace {
+
+struct add : public declare_task<add>
+{
+	add(int _a,int _b) : a(_a),b(_b),c(0) {};
+	int a,b,c;
+};
+
+struct addx : public add, public declare_task<addx>
+{
+	addx(int _a,int _b,int _x) : add(_a,_b),x(_x) {};
+	int x;
+
+	DECLARE_CHILD_TASK(addx,add)
+};
+
+struct swap : public declare_task<swap>
+{
+	swap(int _a,int _b) : a(_a),b(_b) {};
+	int a,b;
+};
+
+struct func2 : public functor, public task_handle<add>, public task_handle<swap>
+{
+	virtual bool task_impl(add& _tsk) { _tsk.c = _tsk.a + _tsk.b; return true; }
+	virtual bool task_impl(swap& _tsk) { std::swap(_tsk.a,_tsk.b); return true; }
+};
+
+
+template<int _n>
+struct count : public declare_task<count<_n> >
+{
+	count() : n(0) {}
+	int n;
+};
+
+//! Functor with many handlers, as pricing functors tend to be
+struct counter
+:	public functor,
+	public task_handle<count<0> >,
+	public task_handle<count<1> >,
+	public task_handle<count<2> >,
+	public task_handle<count<3> >,
+	public task_handle<count<4> >,
+	public task_handle<count<5> >,
+	public task_handle<count<6> >,
+	public task_handle<count<7> >
+{
+	virtual bool task_impl(count<0>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<1>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<2>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<3>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<4>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<5>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<6>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<7>& _tsk) { ++_tsk.n; return true; }
+};
+
+
+// dispatch through dynamic_cast, as done before dispatch tables
+inline bool cast_apply(functor&,task&) { return false; }
+
+template<typename _T>
+bool cast_apply(functor& _func,_T& _tsk)
+{
+	task_handle<_T>* h = dynamic_cast<task_handle<_T>*>(&_func);
+	return h ? h->task_impl(_tsk) : cast_apply(_func,static_cast<typename _T::parent_task&>(_tsk));
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_CASE(bench_functor_dispatch)
+{
+	const int n = 2000000;
+	counter c;
+	count<7> last;
+	func2 f2;
+	addx x(1,2,3);
+
+	std::clock_t c0 = std::clock();
+	for(int i = 0; i < n; ++i) cast_apply(c,last);
+	std::clock_t c1 = std::clock();
+	for(int i = 0; i < n; ++i) c.apply(last);
+	std::clock_t c2 = std::clock();
+	for(int i = 0; i < n; ++i) cast_apply(f2,x);
+	std::clock_t c3 = std::clock();
+	for(int i = 0; i < n; ++i) f2.apply(x);
+	std::clock_t c4 = std::clock();
+
+	BOOST_CHECK_EQUAL(2 * n,last.n);
+	BOOST_CHECK_EQUAL(3,x.c);
+	BOOST_MESSAGE("Functor dispatch, " << n << " tasks: handler of 8, dynamic_cast " << double(c1 - c0) / CLOCKS_PER_SEC
+		<< "s, table " << double(c2 - c1) / CLOCKS_PER_SEC << "s; inherited task, dynamic_cast "
+		<< double(c3 - c2) / CLOCKS_PER_SEC << "s, table " << double(c4 - c3) / CLOCKS_PER_SEC << "s");
+}
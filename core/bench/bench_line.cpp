@@ -0,0 +1,97 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Timings of line interpolation
+*/
+
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "../line.h"
+
+
+BOOST_AUTO_TEST_CASE(bench_line_lookup)
+{
+	using namespace fbox::math;
+
+	linear_line lin;
+	for(int i = 0; i < 100000; ++i) 
+	{
+		double x = i + 0.3 * (i % 3);
+		lin.add(x,std::sin(x / 1000.0));
+	}
+
+	const int n = 2000000;
+	double s0 = 0.0,s1 = 0.0;
+	int hint = -1;
+
+	std::clock_t c0 = std::clock();
+	for(int i = 0; i < n; ++i) s0 += lin(i * 0.05);
+	std::clock_t c1 = std::clock();
+	for(int i = 0; i < n; ++i) s1 += lin(i * 0.05,hint);
+	std::clock_t c2 = std::clock();
+
+	BOOST_CHECK_EQUAL(s0,s1);
+	BOOST_MESSAGE("Sequential lookups on a 100000 point table, cold: " << double(c1 - c0) / CLOCKS_PER_SEC 
+		<< "s, hinted: " << double(c2 - c1) / CLOCKS_PER_SEC << "s");
+}
+
+
+//! Binary search as sorted_find was written before it became branchless, for comparison
+int branchy_find(const std::vector<double>& v,double y)
+{
+	int x0(0);
+	int x1(v.size()-1);
+
+	if (y < v[x0]) return -1;
+	if (y >= v[x1]) return x1;
+
+	while( x1 - x0 > 1) {
+		int x = (x0 + x1) >> 1;
+		if ( y < v[x] ) x1 = x;
+		else x0 = x;
+	}
+
+	return x0;
+}
+
+
+BOOST_AUTO_TEST_CASE(bench_sorted_find)
+{
+	using namespace fbox::math;
+
+	std::vector<double> table;
+	for(int i = 0; i < 100000; ++i) table.push_back(i + 0.3 * (i % 3));
+
+	// random points defeat the branch predictor, sequential points favour it
+	const int n = 2000000;
+	std::vector<double> random(n),sequential(n);
+	unsigned int seed = 12345;
+	for(int i = 0; i < n; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		random[i] = (seed >> 8) * (100000.0 / (1 << 24));
+		sequential[i] = i * 0.05;
+	}
+
+	const std::vector<double>* points[] = { &random, &sequential };
+	const char* names[] = { "random", "sequential" };
+	for(int p = 0; p < 2; ++p)
+	{
+		const std::vector<double>& x = *points[p];
+		long s0 = 0,s1 = 0;
+
+		std::clock_t c0 = std::clock();
+		for(int i = 0; i < n; ++i) s0 += branchy_find(table,x[i]);
+		std::clock_t c1 = std::clock();
+		for(int i = 0; i < n; ++i) s1 += sorted_find(table,x[i]);
+		std::clock_t c2 = std::clock();
+
+		BOOST_CHECK_EQUAL(s0,s1);
+		BOOST_MESSAGE("sorted_find on a 100000 point table, " << names[p] << " points, branchy: "
+			<< double(c1 - c0) / CLOCKS_PER_SEC << "s, branchless: " << double(c2 - c1) / CLOCKS_PER_SEC << "s");
+	}
+}
@@ -0,0 +1,118 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Timings of the loggers
+*/
+
+#include <sstream>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/chrono/thread_clock.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../logger.h"
+#include "../async_logger.h"
+
+
+//! Wall clock seconds, since logging threads run concurrently
+static double wall_seconds()
+{
+	using namespace boost::posix_time;
+	return (microsec_clock::universal_time() - ptime(boost::gregorian::date(2015,1,1))).total_microseconds() * 1e-6;
+}
+
+
+//! Processor seconds of the calling thread, leaving out the background writer
+static double thread_seconds()
+{
+	return boost::chrono::duration<double>(boost::chrono::thread_clock::now().time_since_epoch()).count();
+}
+
+
+static void async_log_records(fbox::async_logger* _l,int _thread,int _n)
+{
+	for(int i = 0; i < _n; ++i)
+	{
+		fbox::async_logger::record& r = _l->begin_record();
+		r << _thread << ' ' << i << '\n';
+		_l->end_record(r);
+	}
+}
+
+
+static double async_log_seconds(std::ostream& _s,int _threads,int _n,fbox::size_type _capacity)
+{
+	fbox::async_logger l(_s,false,fbox::logger::NOTE,_capacity);
+
+	double t0 = wall_seconds();
+	boost::thread_group g;
+	for(int t = 0; t < _threads; ++t) g.create_thread(boost::bind(&async_log_records,&l,t,_n));
+	g.join_all();
+	l.flush();
+	return wall_seconds() - t0;
+}
+
+
+BOOST_AUTO_TEST_CASE(bench_async_logger)
+{
+	using namespace fbox;
+
+	const int n = 200000;
+
+	// synchronous logger, single thread (it is not safe to share between threads)
+	std::ostringstream s0;
+	logger l(s0,false,logger::NOTE);
+	for(int i = 0; i < n; ++i) l << logger::NOTE << 0 << ' ' << i << std::endl; // warm up
+	s0.str("");
+
+	double t0 = wall_seconds();
+	for(int i = 0; i < n; ++i) l << logger::NOTE << 0 << ' ' << i << std::endl;
+	double sync = wall_seconds() - t0;
+
+	// caller side cost of the asynchronous logger, with a ring large enough never to wait
+	std::ostringstream s1;
+	double latency;
+	{
+		async_logger a(s1,false,logger::NOTE,1 << 24);
+		async_log_records(&a,0,n); // warm up
+		a.flush();
+		s1.str("");
+
+		t0 = thread_seconds();
+		async_log_records(&a,0,n);
+		latency = thread_seconds() - t0;
+	}
+
+	std::ostringstream s2,s3;
+	double async1 = async_log_seconds(s2,1,n,async_logger::DEFAULT_CAPACITY);
+	double async4 = async_log_seconds(s3,4,n / 4,async_logger::DEFAULT_CAPACITY);
+
+	BOOST_CHECK_EQUAL(s1.str().size(),s0.str().size());
+	BOOST_CHECK_EQUAL(s2.str().size(),s0.str().size());
+
+	BOOST_MESSAGE("Logging " << n << " records to memory: synchronous " << 1e9 * sync / n << "ns per record, asynchronous "
+		<< 1e9 * async1 / n << "ns (1 thread) and " << 1e9 * async4 / n << "ns (4 threads) to output, "
+		<< 1e9 * latency / n << "ns caller time");
+
+	// to a file, where the synchronous logger pays for flushing every record
+	std::string name = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	{
+		logger f(name,false,logger::NOTE);
+		t0 = wall_seconds();
+		for(int i = 0; i < n; ++i) f << logger::NOTE << 0 << ' ' << i << std::endl;
+		sync = wall_seconds() - t0;
+	}
+	{
+		std::ofstream f(name.c_str());
+		async1 = async_log_seconds(f,1,n,async_logger::DEFAULT_CAPACITY);
+	}
+	BOOST_CHECK_EQUAL(boost::filesystem::file_size(name),s0.str().size());
+	boost::filesystem::remove(name);
+
+	BOOST_MESSAGE("Logging " << n << " records to a file: synchronous " << 1e9 * sync / n << "ns per record, asynchronous "
+		<< 1e9 * async1 / n << "ns");
+}
@@ -0,0 +1,86 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Timings of math utilities
+*/
+
+#include <ctime>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "../math.h"
+#include "../random.h"
+#include "../option.h"
+
+
+BOOST_AUTO_TEST_CASE(bench_poisson_deviate)
+{
+	using namespace fbox::math;
+
+	mersenne_twister rnd;
+	rnd.seed(4321);
+
+	// cost per deviate is flat in the mean once rejection takes over
+	const double bench[] = { 1.0,10.0,100.0,1000.0,10000.0 };
+	const int draws = 1000000;
+	for(int i = 0; i < 5; ++i)
+	{
+		unsigned long total = 0;
+		std::clock_t c0 = std::clock();
+		for(int j = 0; j < draws; ++j) total += poisson_deviate(bench[i],rnd);
+		std::clock_t c1 = std::clock();
+
+		BOOST_MESSAGE("Poisson deviates with mean " << bench[i] << ": "
+			<< 1e9 * double(c1 - c0) / CLOCKS_PER_SEC / draws << "ns per draw (average " << double(total) / draws << ")");
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(bench_normal_cdf)
+{
+	using namespace fbox::math;
+
+	const int n = 4096,reps = 500;
+	std::vector<double> x(n),y(n),k(n),t(n),f(n,100.0),v(n),d(n,0.97);
+	for(int i = 0; i < n; ++i)
+	{
+		x[i] = -8.0 + 16.0 * i / n;
+		k[i] = 50.0 + 100.0 * i / n;
+		t[i] = 0.25 + 0.001 * i;
+		v[i] = 0.1 + 0.0001 * i;
+	}
+
+	// scalar kernel in a plain loop, against the vectorised batch
+	double sum = 0.0;
+	std::clock_t c0 = std::clock();
+	for(int r = 0; r < reps; ++r)
+	{
+		for(int i = 0; i < n; ++i) y[i] = normal_cdf(x[i]);
+		sum += y[r % n];
+	}
+	std::clock_t c1 = std::clock();
+	for(int r = 0; r < reps; ++r)
+	{
+		normal_cdf(&x[0],&y[0],n);
+		sum += y[r % n];
+	}
+	std::clock_t c2 = std::clock();
+
+	for(int r = 0; r < reps; ++r)
+	{
+		for(int i = 0; i < n; ++i) y[i] = fbox::finance::black_scholes('c',k[i],t[i],f[i],v[i],d[i]);
+		sum += y[r % n];
+	}
+	std::clock_t c3 = std::clock();
+	for(int r = 0; r < reps; ++r)
+	{
+		fbox::finance::black_scholes('c',&k[0],&t[0],&f[0],&v[0],&d[0],&y[0],n);
+		sum += y[r % n];
+	}
+	std::clock_t c4 = std::clock();
+
+	double scale = 1e9 / CLOCKS_PER_SEC / (double(n) * reps);
+	BOOST_MESSAGE("Normal CDF: " << scale * (c1 - c0) << "ns scalar, " << scale * (c2 - c1) << "ns batch; Black-Scholes: "
+		<< scale * (c3 - c2) << "ns scalar, " << scale * (c4 - c3) << "ns batch (checksum " << sum << ")");
+}
@@ -0,0 +1,41 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Timings of the tokenisers
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <ctime>
+#include <sstream>
+#include "../tokeniser.h"
+
+
+BOOST_AUTO_TEST_CASE(bench_buffer_tokeniser)
+{
+	using namespace fbox;
+
+	std::ostringstream csv;
+	for(int i = 0; i < 200000; ++i)
+		csv << "2015-01-" << 10 + i % 20 << ",EURUSD," << 1.1 + 1e-6 * i << ",counterparty_" << i % 1000 << '\n';
+	std::string text = csv.str();
+
+	std::string s;
+	string_slice slice;
+	size_type n0 = 0,n1 = 0;
+
+	std::clock_t c0 = std::clock();
+	std::istringstream in(text);
+	tokeniser tok0(in,",\n");
+	while (tok0.good()) { tok0.next(s); n0 += s.size(); }
+
+	std::clock_t c1 = std::clock();
+	buffer_tokeniser tok1(text.data(),text.data() + text.size(),",\n");
+	while (tok1.good()) { tok1.next(slice); n1 += slice.size; }
+	std::clock_t c2 = std::clock();
+
+	BOOST_CHECK_EQUAL(n0,n1);
+	BOOST_MESSAGE("Tokenising " << text.size() / 1000 << "kB of CSV: stream " << double(c1 - c0) / CLOCKS_PER_SEC
+		<< "s, buffer " << double(c2 - c1) / CLOCKS_PER_SEC << "s");
+}
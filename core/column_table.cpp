@@ -0,0 +1,656 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Columnar data tables and their bulk loaders
+*/
+
+#include "column_table.h"
+#include "tokeniser.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <boost/cstdint.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace fbox {
+
+
+////////////////////////////////////////
+// column_table
+////////////////////////////////////////
+
+void column_table::clear()
+{
+	m_rows = 0;
+	m_names.clear();
+	m_numeric.clear();
+	m_slot.clear();
+	m_values.clear();
+	m_text.clear();
+}
+
+
+void column_table::add_column(const std::string& _name,bool _numeric)
+{
+	if (m_rows) throw error("Cannot add column " + _name + " to a column_table with rows");
+
+	m_names.push_back(_name);
+	m_numeric.push_back(_numeric);
+	if (_numeric)
+	{
+		m_slot.push_back(m_values.size());
+		m_values.push_back(std::vector<double>());
+	}
+	else
+	{
+		m_slot.push_back(m_text.size());
+		m_text.push_back(std::vector<std::string>());
+	}
+}
+
+
+size_type column_table::index(const std::string& _name) const
+{
+	for(size_type i = 0; i < m_names.size(); ++i) if (m_names[i] == _name) return i;
+	throw error("No column " + _name + " in column_table");
+}
+
+
+const std::vector<double>& column_table::values(size_type _col) const
+{
+	if (!is_numeric(_col)) throw error("Column " + m_names[_col] + " is not numeric");
+	return m_values[m_slot[_col]];
+}
+
+
+std::vector<double>& column_table::values(size_type _col)
+{
+	if (!is_numeric(_col)) throw error("Column " + m_names[_col] + " is not numeric");
+	return m_values[m_slot[_col]];
+}
+
+
+const std::vector<std::string>& column_table::text(size_type _col) const
+{
+	if (is_numeric(_col)) throw error("Column " + m_names[_col] + " is not text");
+	return m_text[m_slot[_col]];
+}
+
+
+std::vector<std::string>& column_table::text(size_type _col)
+{
+	if (is_numeric(_col)) throw error("Column " + m_names[_col] + " is not text");
+	return m_text[m_slot[_col]];
+}
+
+
+void column_table::set_rows(size_type _rows)
+{
+	for(size_type i = 0; i < m_values.size(); ++i)
+		if (m_values[i].size() != _rows) throw error("Column sizes do not match the rows in column_table");
+
+	for(size_type i = 0; i < m_text.size(); ++i)
+		if (m_text[i].size() != _rows) throw error("Column sizes do not match the rows in column_table");
+
+	m_rows = _rows;
+}
+
+
+
+////////////////////////////////////////
+// parse_double
+////////////////////////////////////////
+
+namespace {
+
+// powers of ten exactly representable as doubles
+const double s_pow10[] = {
+	1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+	1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22 };
+
+
+inline bool is_space(char _c) { return _c == ' ' || _c == '\t' || _c == '\r'; }
+
+
+//! Trim spaces from both ends of [_begin,_end)
+inline void trim(const char*& _begin,const char*& _end)
+{
+	while (_begin != _end && is_space(*_begin)) ++_begin;
+	while (_end != _begin && is_space(_end[-1])) --_end;
+}
+
+
+bool parse_slow(const char* _begin,const char* _end,double& _out)
+{
+	std::string s(_begin,_end);
+	char* end;
+	_out = std::strtod(s.c_str(),&end);
+	return !s.empty() && end == s.c_str() + s.size();
+}
+
+} // namespace
+
+
+bool parse_double(const char* _begin,const char* _end,double& _out)
+{
+	trim(_begin,_end);
+
+	const char* p = _begin;
+	bool neg = false;
+	if (p != _end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+
+	// mantissa digits, exact up to 19 significant digits
+	boost::uint64_t mantissa = 0;
+	int digits = 0,exponent = 0;
+	bool any = false,exact = true;
+
+	for(; p != _end && *p >= '0' && *p <= '9'; ++p,any = true)
+	{
+		if (digits < 19)
+		{
+			mantissa = 10 * mantissa + (*p - '0');
+			if (mantissa) ++digits;
+		}
+		else
+		{
+			++exponent;
+			exact = exact && *p == '0';
+		}
+	}
+
+	if (p != _end && *p == '.')
+	{
+		for(++p; p != _end && *p >= '0' && *p <= '9'; ++p,any = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = 10 * mantissa + (*p - '0');
+				if (mantissa) ++digits;
+				--exponent;
+			}
+			else
+				exact = exact && *p == '0';
+		}
+	}
+
+	if (!any) return parse_slow(_begin,_end,_out); // inf, nan, hexadecimal or not a number
+
+	if (p != _end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		bool eneg = false;
+		if (p != _end && (*p == '-' || *p == '+')) eneg = *p++ == '-';
+		if (p == _end || *p < '0' || *p > '9') return false;
+
+		int e = 0;
+		for(; p != _end && *p >= '0' && *p <= '9'; ++p) if (e < 10000) e = 10 * e + (*p - '0');
+		exponent += eneg ? -e : e;
+	}
+
+	if (p != _end) return false;
+
+	// a mantissa and a power of ten that are both exact give a correctly rounded result
+	if (exact && mantissa <= (boost::uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+	{
+		double v = static_cast<double>(mantissa);
+		v = exponent < 0 ? v / s_pow10[-exponent] : v * s_pow10[exponent];
+		_out = neg ? -v : v;
+		return true;
+	}
+
+	return parse_slow(_begin,_end,_out);
+}
+
+
+
+////////////////////////////////////////
+// load_csv
+////////////////////////////////////////
+
+namespace {
+
+//! Split [_begin,_end) at the delimiter into _fields, as (begin,end) pairs. Returns the number of fields.
+size_type split_fields(const char* _begin,const char* _end,char _delimiter,std::vector<const char*>& _fields)
+{
+	_fields.clear();
+	_fields.push_back(_begin);
+	for(const char* p; 0 != (p = static_cast<const char*>(std::memchr(_begin,_delimiter,_end - _begin))); _begin = p + 1)
+	{
+		_fields.push_back(p);
+		_fields.push_back(p + 1);
+	}
+	_fields.push_back(_end);
+	return _fields.size() / 2;
+}
+
+
+//! End of the line starting at _begin (not including the newline)
+inline const char* line_end(const char* _begin,const char* _end)
+{
+	const char* p = static_cast<const char*>(std::memchr(_begin,'\n',_end - _begin));
+	return p ? p : _end;
+}
+
+
+//! True for lines with only spaces
+inline bool is_blank(const char* _begin,const char* _end)
+{
+	trim(_begin,_end);
+	return _begin == _end;
+}
+
+
+//! Parses the lines of one chunk into its own columns
+class chunk_parser
+{
+public:
+	chunk_parser(
+		const char* _begin,
+		const char* _end,
+		char _delimiter,
+		const column_table& _layout)
+	:	mp_begin(_begin),
+		mp_end(_end),
+		m_delimiter(_delimiter),
+		mp_layout(&_layout),
+		m_rows(0)
+	{}
+
+	void operator() ()
+	{
+		try
+		{
+			parse();
+		}
+		catch (const std::exception& _e)
+		{
+			m_error = _e.what();
+		}
+	}
+
+	size_type rows() const { return m_rows; }
+	const std::string& error_message() const { return m_error; }
+
+	std::vector<std::vector<double> > values;
+	std::vector<std::vector<std::string> > text;
+
+private:
+	const char* mp_begin;
+	const char* mp_end;
+	char m_delimiter;
+	const column_table* mp_layout;
+	size_type m_rows;
+	std::string m_error;
+
+	void parse()
+	{
+		size_type n = mp_layout->columns();
+		std::vector<size_type> slot(n);
+		for(size_type i = 0; i < n; ++i)
+		{
+			if (mp_layout->is_numeric(i))
+			{
+				slot[i] = values.size();
+				values.push_back(std::vector<double>());
+			}
+			else
+			{
+				slot[i] = text.size();
+				text.push_back(std::vector<std::string>());
+			}
+		}
+
+		// guess the number of rows from the first line
+		const char* eol = line_end(mp_begin,mp_end);
+		size_type guess = static_cast<size_type>((mp_end - mp_begin) / (eol - mp_begin + 1) + 1);
+		for(size_type i = 0; i < values.size(); ++i) values[i].reserve(guess);
+		for(size_type i = 0; i < text.size(); ++i) text[i].reserve(guess);
+
+		std::vector<const char*> fields;
+		for(const char* p = mp_begin; p < mp_end; p = eol + 1)
+		{
+			eol = line_end(p,mp_end);
+			if (is_blank(p,eol)) continue;
+
+			if (split_fields(p,eol,m_delimiter,fields) != n)
+			{
+				std::ostringstream msg;
+				msg << "Expected " << n << " fields but found " << fields.size() / 2 << " in line: " << std::string(p,eol);
+				throw error(msg.str());
+			}
+
+			for(size_type i = 0; i < n; ++i)
+			{
+				const char* b = fields[2*i];
+				const char* e = fields[2*i+1];
+
+				if (mp_layout->is_numeric(i))
+				{
+					double v;
+					trim(b,e);
+					if (b == e)
+						v = std::numeric_limits<double>::quiet_NaN();
+					else if (!parse_double(b,e,v))
+						throw error("Invalid number '" + std::string(b,e) + "' in column " + mp_layout->name(i));
+
+					values[slot[i]].push_back(v);
+				}
+				else
+				{
+					trim(b,e);
+					text[slot[i]].push_back(std::string(b,e));
+				}
+			}
+
+			++m_rows;
+		}
+	}
+};
+
+} // namespace
+
+
+void load_csv(
+	const std::string& _filename,
+	column_table& _table,
+	char _delimiter,
+	bool _header,
+	size_type _threads)
+{
+	mapped_file file(_filename);
+
+	try
+	{
+		load_csv(file.begin(),file.end(),_table,_delimiter,_header,_threads);
+	}
+	catch (const error& _e)
+	{
+		throw error(std::string(_e.what()) + " in " + _filename);
+	}
+}
+
+
+void load_csv(
+	const char* _begin,
+	const char* _end,
+	column_table& _table,
+	char _delimiter,
+	bool _header,
+	size_type _threads)
+{
+	_table.clear();
+
+	// column names and types
+	std::vector<const char*> names,fields;
+	const char* p = _begin;
+	const char* eol = _end;
+
+	while (p < _end && is_blank(p,eol = line_end(p,_end))) p = eol + 1;
+	if (_header && p < _end)
+	{
+		split_fields(p,eol,_delimiter,names);
+		for(p = eol + 1; p < _end && is_blank(p,eol = line_end(p,_end)); p = eol + 1);
+	}
+
+	const char* data = std::min(p,_end);
+	size_type n = 0;
+	if (data != _end)
+		n = split_fields(data,line_end(data,_end),_delimiter,fields);
+	else if (_header)
+		n = names.size() / 2;
+
+	if (_header && n != names.size() / 2) throw error("Header and first line have different numbers of fields");
+
+	for(size_type i = 0; i < n; ++i)
+	{
+		bool numeric = true;
+		if (data != _end)
+		{
+			const char* b = fields[2*i];
+			const char* e = fields[2*i+1];
+
+			double v;
+			trim(b,e);
+			numeric = b == e || parse_double(b,e,v);
+		}
+
+		std::ostringstream name;
+		if (_header)
+		{
+			const char* b = names[2*i];
+			const char* e = names[2*i+1];
+			trim(b,e);
+			name << std::string(b,e);
+		}
+		else
+			name << i;
+
+		_table.add_column(name.str(),numeric);
+	}
+
+	// split the data at line ends into chunks of at least 64kB
+	if (_threads == 0) _threads = std::max<size_type>(1,boost::thread::hardware_concurrency());
+	std::size_t size = static_cast<std::size_t>(_end - data);
+	size_type chunks = static_cast<size_type>(std::max<std::size_t>(1,std::min<std::size_t>(_threads,size >> 16)));
+
+	std::vector<const char*> bounds(1,data);
+	for(size_type k = 1; k < chunks; ++k)
+	{
+		const char* e = line_end(std::max(bounds.back(),data + size / chunks * k),_end);
+		bounds.push_back(e == _end ? _end : e + 1);
+	}
+	bounds.push_back(_end);
+
+	std::vector<chunk_parser> parsers;
+	for(size_type k = 0; k < chunks; ++k) parsers.push_back(chunk_parser(bounds[k],bounds[k+1],_delimiter,_table));
+
+	if (chunks == 1)
+		parsers[0]();
+	else
+	{
+		boost::thread_group threads;
+		for(size_type k = 0; k < chunks; ++k) threads.create_thread(boost::ref(parsers[k]));
+		threads.join_all();
+	}
+
+	// join the chunks
+	size_type rows = 0;
+	for(size_type k = 0; k < chunks; ++k)
+	{
+		if (!parsers[k].error_message().empty()) throw error(parsers[k].error_message());
+		rows += parsers[k].rows();
+	}
+
+	for(size_type i = 0,nv = 0,nt = 0; i < n; ++i)
+	{
+		if (_table.is_numeric(i))
+		{
+			std::vector<double>& out = _table.values(i);
+			out.swap(parsers[0].values[nv]);
+			out.reserve(rows);
+			for(size_type k = 1; k < chunks; ++k) out.insert(out.end(),parsers[k].values[nv].begin(),parsers[k].values[nv].end());
+			++nv;
+		}
+		else
+		{
+			std::vector<std::string>& out = _table.text(i);
+			out.swap(parsers[0].text[nt]);
+			out.reserve(rows);
+			for(size_type k = 1; k < chunks; ++k)
+				for(size_type j = 0; j < parsers[k].text[nt].size(); ++j)
+				{
+					out.push_back(std::string());
+					out.back().swap(parsers[k].text[nt][j]);
+				}
+			++nt;
+		}
+	}
+
+	_table.set_rows(rows);
+}
+
+
+
+////////////////////////////////////////
+// Binary tables
+////////////////////////////////////////
+
+/*
+	Layout, in native byte order:
+
+	"FBOXTBL1"
+	uint64 rows, uint64 columns
+	for each column: uint8 numeric, uint32 name size, name
+	for each column: rows doubles, or rows times (uint32 size, text)
+*/
+
+namespace {
+
+const char s_magic[] = "FBOXTBL1";
+
+
+template<typename _type>
+void write_raw(std::ostream& _out,const _type& _value)
+{
+	_out.write(reinterpret_cast<const char*>(&_value),sizeof(_type));
+}
+
+
+void write_string(std::ostream& _out,const std::string& _s)
+{
+	write_raw(_out,boost::uint32_t(_s.size()));
+	_out.write(_s.data(),_s.size());
+}
+
+
+//! Bounds checked reads from a mapped table
+class binary_reader
+{
+public:
+	binary_reader(const char* _begin,const char* _end) : mp_pos(_begin),mp_end(_end) {}
+
+	//! Bytes left to read
+	std::size_t remaining() const { return mp_end - mp_pos; }
+
+	const char* take(std::size_t _size)
+	{
+		if (remaining() < _size) throw error("Truncated binary table");
+		const char* p = mp_pos;
+		mp_pos += _size;
+		return p;
+	}
+
+	template<typename _type>
+	_type read()
+	{
+		_type v;
+		std::memcpy(&v,take(sizeof(_type)),sizeof(_type));
+		return v;
+	}
+
+	std::string read_string()
+	{
+		size_type n = read<boost::uint32_t>();
+		const char* p = take(n);
+		return std::string(p,p + n);
+	}
+
+private:
+	const char* mp_pos;
+	const char* mp_end;
+};
+
+} // namespace
+
+
+void save_binary(const std::string& _filename,const column_table& _table)
+{
+	std::ofstream out(_filename.c_str(),std::ios::binary);
+	if (!out) throw error("Failed to open " + _filename);
+
+	out.write(s_magic,8);
+	write_raw(out,boost::uint64_t(_table.rows()));
+	write_raw(out,boost::uint64_t(_table.columns()));
+
+	for(size_type i = 0; i < _table.columns(); ++i)
+	{
+		write_raw(out,boost::uint8_t(_table.is_numeric(i)));
+		write_string(out,_table.name(i));
+	}
+
+	for(size_type i = 0; i < _table.columns(); ++i)
+	{
+		if (_table.is_numeric(i))
+		{
+			const std::vector<double>& v = _table.values(i);
+			if (!v.empty()) out.write(reinterpret_cast<const char*>(&v[0]),v.size() * sizeof(double));
+		}
+		else
+		{
+			const std::vector<std::string>& v = _table.text(i);
+			for(size_type j = 0; j < v.size(); ++j) write_string(out,v[j]);
+		}
+	}
+
+	if (!out) throw error("Failed to write " + _filename);
+}
+
+
+void load_binary(const std::string& _filename,column_table& _table)
+{
+	mapped_file file(_filename);
+	binary_reader in(file.begin(),file.end());
+
+	_table.clear();
+
+	try
+	{
+		if (std::memcmp(in.take(8),s_magic,8)) throw error("Not a binary table");
+		boost::uint64_t rows64 = in.read<boost::uint64_t>(),n64 = in.read<boost::uint64_t>();
+		size_type rows = static_cast<size_type>(rows64),n = static_cast<size_type>(n64);
+		if (rows != rows64 || n != n64) throw error("Corrupt binary table");
+
+		for(size_type i = 0; i < n; ++i)
+		{
+			bool numeric = in.read<boost::uint8_t>() != 0;
+			_table.add_column(in.read_string(),numeric);
+		}
+
+		for(size_type i = 0; i < n; ++i)
+		{
+			if (_table.is_numeric(i))
+			{
+				// check the header against the data before allocating for it
+				if (rows > in.remaining() / sizeof(double)) throw error("Truncated binary table");
+				std::size_t bytes = std::size_t(rows) * sizeof(double);
+				std::vector<double>& v = _table.values(i);
+				v.resize(rows);
+				if (rows) std::memcpy(&v[0],in.take(bytes),bytes);
+			}
+			else
+			{
+				// each string takes at least its length
+				if (rows > in.remaining() / sizeof(boost::uint32_t)) throw error("Truncated binary table");
+				std::vector<std::string>& v = _table.text(i);
+				v.reserve(rows);
+				for(size_type j = 0; j < rows; ++j) v.push_back(in.read_string());
+			}
+		}
+
+		_table.set_rows(rows);
+	}
+	catch (const error& _e)
+	{
+		_table.clear();
+		throw error(std::string(_e.what()) + " in " + _filename);
+	}
+}
+
+
+
+} // namespace fbox
@@ -0,0 +1,171 @@
+#ifndef __FBOX_CORE_COLUMN_TABLE_H__
+#define __FBOX_CORE_COLUMN_TABLE_H__
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Columnar data tables and their bulk loaders
+*/
+
+#include "main.h"
+#include "error.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fbox {
+
+
+//! In-memory table of named columns, each holding either numbers or text
+/*!
+	Columns are stored contiguously, so a whole column can be handed to a line or to a vectorised
+	calculation without copying. Tables are filled by load_csv() or load_binary(), or by hand:
+
+	<code>
+	column_table t;
+	t.add_column("curve",false);
+	t.add_column("tenor");
+	t.add_column("rate");
+
+	std::map<std::string,math::linear_line> curves;
+	t.get_lines(t.index("curve"),t.index("tenor"),t.index("rate"),curves);
+	</code>
+*/
+class column_table
+{
+public:
+	column_table() : m_rows(0) {}
+
+	//! Remove all columns
+	void clear();
+
+	//! Append an empty column. Columns can only be added while the table has no rows.
+	void add_column(const std::string& _name,bool _numeric=true);
+
+	size_type rows() const { return m_rows; }
+	size_type columns() const { return m_names.size(); }
+
+	//! Name of column _col
+	const std::string& name(size_type _col) const { return m_names.at(_col); }
+
+	//! Index of the column named _name. Throws if there is none.
+	size_type index(const std::string& _name) const;
+
+	//! True if column _col holds numbers
+	bool is_numeric(size_type _col) const { return m_numeric.at(_col); }
+
+	//! Values of the numeric column _col
+	const std::vector<double>& values(size_type _col) const;
+	std::vector<double>& values(size_type _col);
+
+	//! Values of the text column _col
+	const std::vector<std::string>& text(size_type _col) const;
+	std::vector<std::string>& text(size_type _col);
+
+	//! Set the number of rows once all columns have been filled to that size
+	void set_rows(size_type _rows);
+
+	//! Fill _line with the points (x,y) of rows [_begin,_end) of two numeric columns
+	template<typename _line>
+	void get_line(size_type _x,size_type _y,_line& _out,size_type _begin=0,size_type _end=size_type(-1)) const;
+
+	//! Fill one line per distinct value of the text column _key with the points (x,y) of its rows, in
+	//! the order they appear in the table. Lines already in _out for other keys are left untouched.
+	template<typename _line>
+	void get_lines(size_type _key,size_type _x,size_type _y,std::map<std::string,_line>& _out) const;
+
+private:
+	size_type m_rows;
+	std::vector<std::string> m_names;
+	std::vector<bool> m_numeric;
+	std::vector<size_type> m_slot;						//!< Index of each column in m_values or m_text
+	std::vector<std::vector<double> > m_values;
+	std::vector<std::vector<std::string> > m_text;
+};
+
+
+//! Parse the number in [_begin,_end), ignoring surrounding spaces. Returns false unless the whole range
+//! is a number. Short decimals take an exact fast path, anything else is left to strtod.
+bool parse_double(const char* _begin,const char* _end,double& _out);
+
+
+//! Load a delimited text file into _table
+/*!
+	The file is memory mapped and split into chunks at line boundaries, which are parsed in parallel.
+	The first line holds the column names if _header is set (columns are named by number otherwise).
+	Columns whose first value is a number are numeric, with empty fields read as NaN; the others are
+	text. Fields are split at every delimiter: quoting is not supported.
+*/
+void load_csv(
+	const std::string& _filename,	//!< File to load
+	column_table& _table,			//!< Output table
+	char _delimiter = ',',			//!< Field delimiter
+	bool _header = true,			//!< First line holds the column names
+	size_type _threads = 0);		//!< Number of threads, or zero for one per core
+
+//! Load delimited text in [_begin,_end) into _table (see above)
+void load_csv(
+	const char* _begin,
+	const char* _end,
+	column_table& _table,
+	char _delimiter = ',',
+	bool _header = true,
+	size_type _threads = 0);
+
+
+//! Save _table in binary form, which load_binary() maps back without parsing
+void save_binary(const std::string& _filename,const column_table& _table);
+
+//! Load a table saved by save_binary()
+void load_binary(const std::string& _filename,column_table& _table);
+
+
+
+////////////////////////////////////////
+// column_table
+////////////////////////////////////////
+
+template<typename _line>
+void column_table::get_line(size_type _x,size_type _y,_line& _out,size_type _begin,size_type _end) const
+{
+	const std::vector<double>& x = values(_x);
+	const std::vector<double>& y = values(_y);
+	if (_end > m_rows) _end = m_rows;
+
+	_out.clear();
+	for(size_type i = _begin; i < _end; ++i) _out.add(x[i],y[i]);
+}
+
+
+template<typename _line>
+void column_table::get_lines(size_type _key,size_type _x,size_type _y,std::map<std::string,_line>& _out) const
+{
+	const std::vector<std::string>& key = text(_key);
+	const std::vector<double>& x = values(_x);
+	const std::vector<double>& y = values(_y);
+
+	// lines are built in place, as interpolated lines should not be copied once evaluated
+	std::set<_line*> filled;
+	const std::string* last = 0;
+	_line* l = 0;
+
+	for(size_type i = 0; i < m_rows; ++i)
+	{
+		if (!last || key[i] != *last)
+		{
+			last = &key[i];
+			l = &_out[*last];
+			if (filled.insert(l).second) l->clear();
+		}
+
+		l->add(x[i],y[i]);
+	}
+}
+
+
+
+} // namespace fbox
+
+#endif
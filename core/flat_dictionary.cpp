@@ -0,0 +1,540 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Hash table dictionary with interned keys
+*/
+
+#include "main.h"
+#include "flat_dictionary.h"
+#include <algorithm>
+#include <map>
+#include <boost/cstdint.hpp>
+#include <boost/thread/detail/singleton.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/unordered_set.hpp>
+
+namespace fbox {
+
+
+////////////////////////////////////////
+// dictionary_key
+////////////////////////////////////////
+
+namespace {
+
+//! Interned key texts. The set never shrinks and its elements do not move, so keys keep pointers to them.
+struct key_pool
+{
+	boost::mutex mutex;
+	boost::unordered_set<std::string> keys;
+
+	const std::string* intern(const std::string& _key)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		return &*keys.insert(_key).first;
+	}
+};
+
+
+const std::string* intern(const std::string& _key)
+{
+	return boost::detail::thread::singleton<key_pool>::instance().intern(_key);
+}
+
+} // namespace
+
+
+dictionary_key::dictionary_key()
+:	mp_str(intern(std::string())),
+	m_hash(hash(0,0))
+{}
+
+
+dictionary_key::dictionary_key(const std::string& _key)
+:	mp_str(intern(_key)),
+	m_hash(hash(_key.data(),_key.size()))
+{}
+
+
+dictionary_key::dictionary_key(const char* _key)
+:	mp_str(intern(_key)),
+	m_hash(hash(mp_str->data(),mp_str->size()))
+{}
+
+
+std::size_t dictionary_key::hash(const char* _key,size_type _size)
+{
+	// 64-bit FNV-1a
+	boost::uint64_t h = 14695981039346656037ULL;
+	for(size_type i = 0; i < _size; ++i)
+	{
+		h ^= static_cast<unsigned char>(_key[i]);
+		h *= 1099511628211ULL;
+	}
+
+	return static_cast<std::size_t>(h ^ (h >> 32));
+}
+
+
+
+////////////////////////////////////////
+// flat_dictionary
+////////////////////////////////////////
+
+flat_dictionary::flat_dictionary(const dictionary& _dict)
+:	m_mask(0)
+{
+	reserve(_dict.size());
+
+	for(dictionary::const_iterator itr = _dict.begin(); itr != _dict.end(); ++itr)
+	{
+		const dictionary::value_type& v = itr->second;
+		switch (v.which())
+		{
+		case 0: insert(itr->first,boost::get<int>(v)); break;
+		case 1: insert(itr->first,boost::get<double>(v)); break;
+		case 2: insert(itr->first,boost::get<std::string>(v)); break;
+		case 3: insert(itr->first,dictionary_ptr(new flat_dictionary(boost::get<dictionary>(v)))); break;
+		}
+	}
+}
+
+
+flat_dictionary::flat_dictionary(const flat_dictionary& _dict)
+:	m_entries(_dict.m_entries),
+	m_slots(_dict.m_slots),
+	m_mask(_dict.m_mask)
+{
+}
+
+
+flat_dictionary& flat_dictionary::operator=(const flat_dictionary& _dict)
+{
+	flat_dictionary d(_dict);
+	swap(d);
+	return *this;
+}
+
+
+void flat_dictionary::swap(flat_dictionary& _dict)
+{
+	m_entries.swap(_dict.m_entries);
+	m_slots.swap(_dict.m_slots);
+	std::swap(m_mask,_dict.m_mask);
+}
+
+
+void flat_dictionary::clear()
+{
+	m_entries.clear();
+	m_slots.clear();
+	m_mask = 0;
+}
+
+
+void flat_dictionary::reserve(size_type _n)
+{
+	m_entries.reserve(_n);
+
+	// keep the index at most three quarters full
+	size_type capacity = 8;
+	while (4 * _n > 3 * capacity) capacity *= 2;
+	if (capacity > m_slots.size()) rehash(capacity);
+}
+
+
+void flat_dictionary::rehash(size_type _capacity)
+{
+	slot_type empty = { 0,0 };
+	m_slots.assign(_capacity,empty);
+	m_mask = _capacity - 1;
+
+	for(size_type i = 0; i < m_entries.size(); ++i)
+	{
+		std::size_t h = m_entries[i].first.hash();
+		std::size_t j = h & m_mask;
+		while (m_slots[j].index) j = (j + 1) & m_mask;
+
+		m_slots[j].hash = h;
+		m_slots[j].index = i + 1;
+	}
+}
+
+
+size_type flat_dictionary::find_index(const dictionary_key& _key) const
+{
+	if (m_slots.empty()) return 0;
+
+	std::size_t h = _key.hash();
+	for(std::size_t j = h & m_mask; m_slots[j].index; j = (j + 1) & m_mask)
+		if (m_entries[m_slots[j].index - 1].first == _key) return m_slots[j].index;
+
+	return 0;
+}
+
+
+size_type flat_dictionary::find_index(const std::string& _key) const
+{
+	if (m_slots.empty()) return 0;
+
+	std::size_t h = dictionary_key::hash(_key.data(),_key.size());
+	for(std::size_t j = h & m_mask; m_slots[j].index; j = (j + 1) & m_mask)
+		if (m_slots[j].hash == h && m_entries[m_slots[j].index - 1].first.str() == _key) return m_slots[j].index;
+
+	return 0;
+}
+
+
+flat_dictionary_value_proxy flat_dictionary::insert(const dictionary_key& _key,const value_type& _value,bool _overwrite)
+{
+	size_type i = find_index(_key);
+	if (i)
+	{
+		if (!_overwrite) throw error("trying to overwrite existing key '" + _key.str() + "' with 'overwrite' flag set to false)");
+		return flat_dictionary_value_proxy(m_entries[i-1].second = _value);
+	}
+
+	if (4 * (m_entries.size() + 1) > 3 * m_slots.size()) rehash(m_slots.empty() ? 8 : 2 * m_slots.size());
+
+	m_entries.push_back(entry_type(_key,_value));
+
+	std::size_t j = _key.hash() & m_mask;
+	while (m_slots[j].index) j = (j + 1) & m_mask;
+	m_slots[j].hash = _key.hash();
+	m_slots[j].index = m_entries.size();
+
+	return flat_dictionary_value_proxy(m_entries.back().second);
+}
+
+
+flat_dictionary_value_proxy flat_dictionary::insert(const dictionary_key& _key,const flat_dictionary& _value,bool _overwrite)
+{
+	return insert(_key,dictionary_ptr(new flat_dictionary(_value)),_overwrite);
+}
+
+
+const flat_dictionary::value_type* flat_dictionary::find(const dictionary_key& _key) const
+{
+	size_type i = find_index(_key);
+	return i ? &m_entries[i-1].second : 0;
+}
+
+
+const flat_dictionary::value_type* flat_dictionary::find(const std::string& _key) const
+{
+	size_type i = find_index(_key);
+	return i ? &m_entries[i-1].second : 0;
+}
+
+
+flat_dictionary_value_proxy flat_dictionary::operator[] (const dictionary_key& _key)
+{
+	value_type* v = find(_key);
+	if (!v) throw error("Dictionary does not contain key " + _key.str());
+	return flat_dictionary_value_proxy(*v);
+}
+
+
+flat_dictionary_value_proxy flat_dictionary::operator[] (const std::string& _key)
+{
+	value_type* v = find(_key);
+	if (!v) throw error("Dictionary does not contain key " + _key);
+	return flat_dictionary_value_proxy(*v);
+}
+
+
+flat_dictionary_value_proxy flat_dictionary::operator[] (const char* _key)
+{
+	return (*this)[std::string(_key)];
+}
+
+
+const_flat_dictionary_value_proxy flat_dictionary::operator[] (const dictionary_key& _key) const
+{
+	const value_type* v = find(_key);
+	if (!v) throw error("Dictionary does not contain key " + _key.str());
+	return const_flat_dictionary_value_proxy(*v);
+}
+
+
+const_flat_dictionary_value_proxy flat_dictionary::operator[] (const std::string& _key) const
+{
+	const value_type* v = find(_key);
+	if (!v) throw error("Dictionary does not contain key " + _key);
+	return const_flat_dictionary_value_proxy(*v);
+}
+
+
+const_flat_dictionary_value_proxy flat_dictionary::operator[] (const char* _key) const
+{
+	return (*this)[std::string(_key)];
+}
+
+
+dictionary flat_dictionary::to_dictionary() const
+{
+	dictionary d;
+	for(const_iterator itr = begin(); itr != end(); ++itr)
+	{
+		const value_type& v = itr->second;
+		switch (v.which())
+		{
+		case 0: d.insert(itr->first.str(),boost::get<int>(v)); break;
+		case 1: d.insert(itr->first.str(),boost::get<double>(v)); break;
+		case 2: d.insert(itr->first.str(),boost::get<std::string>(v)); break;
+		case 3: d.insert(itr->first.str(),boost::get<dictionary_ptr>(v)->to_dictionary()); break;
+		}
+	}
+
+	return d;
+}
+
+
+
+////////////////////////////////////////
+// Binary form
+////////////////////////////////////////
+
+/*
+	"FBD1"
+	varint number of keys, then each key as varint size and text
+	the dictionary: varint number of entries, then each entry as varint key number, a type byte (the
+	index of the value in value_type) and the value: a zigzag varint, 8 native bytes, a varint size and
+	text, or a nested dictionary
+*/
+
+namespace {
+
+const char s_magic[] = "FBD1";
+
+typedef std::map<const std::string*,size_type> key_map;
+
+
+void write_varint(std::ostream& _out,boost::uint64_t _v)
+{
+	char buf[10];
+	size_type n = 0;
+	for(; _v >= 0x80; _v >>= 7) buf[n++] = static_cast<char>(_v | 0x80);
+	buf[n++] = static_cast<char>(_v);
+	_out.write(buf,n);
+}
+
+
+boost::uint64_t read_varint(std::istream& _in)
+{
+	boost::uint64_t v = 0;
+	for(int shift = 0; shift < 64; shift += 7)
+	{
+		int c = _in.get();
+		if (c == EOF) throw flat_dictionary::error("Truncated binary dictionary");
+		v |= boost::uint64_t(c & 0x7f) << shift;
+		if (!(c & 0x80)) return v;
+	}
+
+	throw flat_dictionary::error("Malformed binary dictionary");
+}
+
+
+void write_string(std::ostream& _out,const std::string& _s)
+{
+	write_varint(_out,_s.size());
+	_out.write(_s.data(),_s.size());
+}
+
+
+std::string read_string(std::istream& _in)
+{
+	boost::uint64_t n = read_varint(_in);
+	std::string s;
+
+	// read in blocks, so that a corrupt size fails on the data rather than on the allocation
+	char buf[256];
+	while (n)
+	{
+		std::streamsize k = static_cast<std::streamsize>(std::min<boost::uint64_t>(n,sizeof(buf)));
+		if (!_in.read(buf,k)) throw flat_dictionary::error("Truncated binary dictionary");
+		s.append(buf,static_cast<size_type>(k));
+		n -= k;
+	}
+
+	return s;
+}
+
+
+void collect_keys(const flat_dictionary& _dict,key_map& _keys,std::vector<const std::string*>& _order)
+{
+	for(flat_dictionary::const_iterator itr = _dict.begin(); itr != _dict.end(); ++itr)
+	{
+		const std::string* k = &itr->first.str();
+		if (_keys.insert(key_map::value_type(k,_order.size())).second) _order.push_back(k);
+
+		if (itr->second.which() == 3) collect_keys(*boost::get<flat_dictionary::dictionary_ptr>(itr->second),_keys,_order);
+	}
+}
+
+
+void write_body(std::ostream& _out,const flat_dictionary& _dict,const key_map& _keys)
+{
+	write_varint(_out,_dict.size());
+	for(flat_dictionary::const_iterator itr = _dict.begin(); itr != _dict.end(); ++itr)
+	{
+		const flat_dictionary::value_type& v = itr->second;
+		write_varint(_out,_keys.find(&itr->first.str())->second);
+		_out.put(static_cast<char>(v.which()));
+
+		switch (v.which())
+		{
+		case 0:
+		{
+			boost::int64_t i = boost::get<int>(v);
+			write_varint(_out,(boost::uint64_t(i) << 1) ^ boost::uint64_t(i >> 63));
+			break;
+		}
+
+		case 1:
+		{
+			double d = boost::get<double>(v);
+			_out.write(reinterpret_cast<const char*>(&d),sizeof(d));
+			break;
+		}
+
+		case 2:
+			write_string(_out,boost::get<std::string>(v));
+			break;
+
+		case 3:
+			write_body(_out,*boost::get<flat_dictionary::dictionary_ptr>(v),_keys);
+			break;
+		}
+	}
+}
+
+
+void read_body(std::istream& _in,flat_dictionary& _dict,const std::vector<dictionary_key>& _keys)
+{
+	boost::uint64_t n = read_varint(_in);
+	_dict.reserve(static_cast<size_type>(std::min<boost::uint64_t>(n,1 << 16)));
+
+	for(boost::uint64_t i = 0; i < n; ++i)
+	{
+		boost::uint64_t k = read_varint(_in);
+		if (k >= _keys.size()) throw flat_dictionary::error("Malformed binary dictionary");
+
+		switch (_in.get())
+		{
+		case 0:
+		{
+			boost::uint64_t z = read_varint(_in);
+			_dict.insert(_keys[k],static_cast<int>(boost::int64_t(z >> 1) ^ -boost::int64_t(z & 1)));
+			break;
+		}
+
+		case 1:
+		{
+			double d;
+			if (!_in.read(reinterpret_cast<char*>(&d),sizeof(d))) throw flat_dictionary::error("Truncated binary dictionary");
+			_dict.insert(_keys[k],d);
+			break;
+		}
+
+		case 2:
+			_dict.insert(_keys[k],read_string(_in));
+			break;
+
+		case 3:
+		{
+			boost::shared_ptr<flat_dictionary> p( new flat_dictionary );
+			read_body(_in,*p,_keys);
+			_dict.insert(_keys[k],p);
+			break;
+		}
+
+		case EOF:
+			throw flat_dictionary::error("Truncated binary dictionary");
+
+		default:
+			throw flat_dictionary::error("Malformed binary dictionary");
+		}
+	}
+}
+
+} // namespace
+
+
+void flat_dictionary::save(std::ostream& _out) const
+{
+	key_map keys;
+	std::vector<const std::string*> order;
+	collect_keys(*this,keys,order);
+
+	_out.write(s_magic,4);
+	write_varint(_out,order.size());
+	for(size_type i = 0; i < order.size(); ++i) write_string(_out,*order[i]);
+
+	write_body(_out,*this,keys);
+}
+
+
+void flat_dictionary::load(std::istream& _in)
+{
+	char magic[4];
+	if (!_in.read(magic,4) || !std::equal(magic,magic + 4,s_magic)) throw error("Not a binary dictionary");
+
+	// each key is interned once
+	boost::uint64_t n = read_varint(_in);
+	std::vector<dictionary_key> keys;
+	for(boost::uint64_t i = 0; i < n; ++i) keys.push_back(read_string(_in));
+
+	flat_dictionary d;
+	read_body(_in,d,keys);
+
+	swap(d);
+}
+
+
+std::ostream& operator<<(std::ostream& _s,const flat_dictionary& _dict)
+{
+	flat_dictionary::const_iterator itr = _dict.begin();
+	flat_dictionary::const_iterator end = _dict.end();
+	for(; itr != end; ++itr)
+	{
+		const flat_dictionary::value_type& v = itr->second;
+		_s << itr->first.str() << " = ";
+		if (v.which() == 3)
+			_s << "{\n" << *boost::get<flat_dictionary::dictionary_ptr>(v) << "}\n";
+		else
+			_s << v << '\n';
+	}
+
+	return _s;
+}
+
+
+
+////////////////////////////////////////
+// flat_dictionary_value_proxy
+// const_flat_dictionary_value_proxy
+////////////////////////////////////////
+
+int& flat_dictionary_value_proxy::as_int()										{ return boost::get<int>(mr_v); }
+double& flat_dictionary_value_proxy::as_double()								{ return boost::get<double>(mr_v); }
+std::string& flat_dictionary_value_proxy::as_string()							{ return boost::get<std::string>(mr_v); }
+
+flat_dictionary& flat_dictionary_value_proxy::as_dictionary()
+{
+	// nested dictionaries are always allocated non-const, so once unshared this is the only handle
+	flat_dictionary::dictionary_ptr& p = boost::get<flat_dictionary::dictionary_ptr>(mr_v);
+	if (!p.unique()) p.reset(new flat_dictionary(*p));
+	return const_cast<flat_dictionary&>(*p);
+}
+
+int const_flat_dictionary_value_proxy::as_int() const							{ return boost::get<int>(mr_v); }
+double const_flat_dictionary_value_proxy::as_double() const						{ return boost::get<double>(mr_v); }
+const std::string& const_flat_dictionary_value_proxy::as_string() const			{ return boost::get<std::string>(mr_v); }
+const flat_dictionary& const_flat_dictionary_value_proxy::as_dictionary() const	{ return *boost::get<flat_dictionary::dictionary_ptr>(mr_v); }
+
+
+} // namespace fbox
@@ -0,0 +1,190 @@
+#ifndef __FBOX_CORE_FLAT_DICTIONARY_H__
+#define __FBOX_CORE_FLAT_DICTIONARY_H__
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Hash table dictionary with interned keys
+*/
+
+#include "main.h"
+#include "error.h"
+#include "dictionary.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/variant.hpp>
+
+namespace fbox {
+
+
+//! Interned dictionary key
+/*!
+	Equal keys share a single copy of their text, which lives until the program ends, so keys are the
+	size of two pointers and compare by address. Creating a key looks its text up in a global table (a
+	lock and a hash lookup): keys used repeatedly are best created once and kept.
+*/
+class dictionary_key
+{
+public:
+	dictionary_key();
+	dictionary_key(const std::string& _key);
+	dictionary_key(const char* _key);
+
+	const std::string& str() const { return *mp_str; }
+	std::size_t hash() const { return m_hash; }
+
+	bool operator==(const dictionary_key& _key) const { return mp_str == _key.mp_str; }
+	bool operator!=(const dictionary_key& _key) const { return mp_str != _key.mp_str; }
+
+	//! Hash of _key as computed for keys
+	static std::size_t hash(const char* _key,size_type _size);
+
+private:
+	const std::string* mp_str;
+	std::size_t m_hash;
+};
+
+
+class flat_dictionary_value_proxy;
+class const_flat_dictionary_value_proxy;
+
+//! Dictionary held in an open addressing hash table
+/*!
+	Same values as dictionary, in a flat table: entries are stored contiguously in insertion order and
+	found through a linear probing index, so lookups cost a hash and usually a single comparison.
+	Nested dictionaries are shared between copies and only copied when modified through one of them,
+	which makes copies shallow. Copies must not be modified concurrently from different threads.
+	Keys of stored entries are const, and values only give const access to nested dictionaries: the
+	only way to modify a nested dictionary is the value proxy's as_dictionary(), which unshares it.
+
+	Entries cannot be removed. Lookups by string do not intern the string.
+*/
+class flat_dictionary
+{
+public:
+	typedef boost::shared_ptr<const flat_dictionary> dictionary_ptr;
+	typedef boost::variant<int,double,std::string,dictionary_ptr> value_type;
+	typedef std::pair<const dictionary_key,value_type> entry_type;
+	typedef std::vector<entry_type>::iterator iterator;
+	typedef std::vector<entry_type>::const_iterator const_iterator;
+
+	FBOX_LOCAL_ERROR(error,fbox::error,"Dictionary error");
+
+	flat_dictionary() : m_mask(0) {}
+
+	//! Convert a dictionary
+	explicit flat_dictionary(const dictionary& _dict);
+
+	flat_dictionary(const flat_dictionary& _dict);
+
+	//! Copy and swap, since entries with const keys cannot be assigned
+	flat_dictionary& operator=(const flat_dictionary& _dict);
+
+	void swap(flat_dictionary& _dict); //!< Exchange contents with _dict
+	void clear(); //!< clear dictionary
+	void reserve(size_type _n); //!< Make room for _n entries
+
+	//! Insert key. If _overwrite=0 it will except if key already exists. The proxy is valid until the next insert.
+	flat_dictionary_value_proxy insert(const dictionary_key& _key,const value_type& _value,bool _overwrite=false);
+	flat_dictionary_value_proxy insert(const dictionary_key& _key,const flat_dictionary& _value,bool _overwrite=false);
+
+	size_type size() const { return m_entries.size(); } //!< Number of entries
+
+	//! True if dictionary contains key
+	bool contains(const dictionary_key& _key) const { return find(_key) != 0; }
+	bool contains(const std::string& _key) const { return find(_key) != 0; }
+	bool contains(const char* _key) const { return find(std::string(_key)) != 0; }
+
+	//! Value of key, or null if the dictionary does not contain it
+	const value_type* find(const dictionary_key& _key) const;
+	const value_type* find(const std::string& _key) const;
+	const value_type* find(const char* _key) const { return find(std::string(_key)); }
+	value_type* find(const dictionary_key& _key) { return const_cast<value_type*>(static_cast<const flat_dictionary*>(this)->find(_key)); }
+	value_type* find(const std::string& _key) { return const_cast<value_type*>(static_cast<const flat_dictionary*>(this)->find(_key)); }
+	value_type* find(const char* _key) { return find(std::string(_key)); }
+
+	//! Access to existing key (excepts if key does not exist)
+	flat_dictionary_value_proxy operator[] (const dictionary_key& _key);
+	flat_dictionary_value_proxy operator[] (const std::string& _key);
+	flat_dictionary_value_proxy operator[] (const char* _key);
+	const_flat_dictionary_value_proxy operator[] (const dictionary_key& _key) const;
+	const_flat_dictionary_value_proxy operator[] (const std::string& _key) const;
+	const_flat_dictionary_value_proxy operator[] (const char* _key) const;
+
+	//! Entries in insertion order
+	const_iterator begin() const { return m_entries.begin(); }
+	const_iterator end() const { return m_entries.end(); }
+
+	iterator begin() { return m_entries.begin(); }
+	iterator end() { return m_entries.end(); }
+
+	//! Convert to a dictionary
+	dictionary to_dictionary() const;
+
+	//! Write in binary form. Each distinct key is written once, however many nested dictionaries use it.
+	void save(std::ostream& _out) const;
+
+	//! Replace the contents with a dictionary written by save()
+	void load(std::istream& _in);
+
+protected:
+	struct slot_type
+	{
+		std::size_t hash;
+		size_type index; //!< Entry index plus one, or zero for empty slots
+	};
+
+	std::vector<entry_type> m_entries;
+	std::vector<slot_type> m_slots;
+	std::size_t m_mask;
+
+	size_type find_index(const dictionary_key& _key) const;
+	size_type find_index(const std::string& _key) const;
+	void rehash(size_type _capacity);
+};
+
+
+class flat_dictionary_value_proxy
+{
+public:
+	flat_dictionary_value_proxy(flat_dictionary::value_type& _value) : mr_v(_value) {}
+
+	operator flat_dictionary::value_type() { return mr_v; }
+
+	int& as_int();
+	double& as_double();
+	std::string& as_string();
+	flat_dictionary& as_dictionary(); //!< Unshares the dictionary first, if shared
+
+private:
+	flat_dictionary::value_type& mr_v;
+};
+
+
+class const_flat_dictionary_value_proxy
+{
+public:
+	const_flat_dictionary_value_proxy(const flat_dictionary::value_type& _value) : mr_v(_value) {}
+
+	operator flat_dictionary::value_type() const { return mr_v; }
+
+	int as_int() const;
+	double as_double() const;
+	const std::string& as_string() const;
+	const flat_dictionary& as_dictionary() const;
+
+private:
+	const flat_dictionary::value_type& mr_v;
+};
+
+
+
+//! default stream output for flat dictionaries
+std::ostream& operator<<(std::ostream& _s,const flat_dictionary& _dict);
+
+} // namespace fbox
+
+#endif
@@ -0,0 +1,104 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Dispatch tables of the functor framework
+*/
+
+#include "main.h"
+#include "functor.h"
+#include <map>
+#include <boost/thread/detail/singleton.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace fbox {
+namespace detail {
+
+
+//! Tables of all functor types seen and task numbers given out
+struct dispatch_registry
+{
+	struct type_less
+	{
+		bool operator()(const std::type_info* _a,const std::type_info* _b) const { return _a->before(*_b) != 0; }
+	};
+
+	typedef std::map<const std::type_info*,dispatch_table*,type_less> table_map;
+
+	boost::mutex mutex;
+	table_map tables;
+	size_type tasks;
+
+	dispatch_registry() : tasks(0) {}
+
+	static dispatch_registry& instance() { return boost::detail::thread::singleton<dispatch_registry>::instance(); }
+
+	dispatch_table& table(const std::type_info& _type)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		table_map::iterator itr = tables.find(&_type);
+		if (itr == tables.end()) itr = tables.insert(table_map::value_type(&_type,new dispatch_table(_type))).first;
+		return *itr->second;
+	}
+};
+
+
+
+////////////////////////////////////////
+// dispatch_table
+////////////////////////////////////////
+
+dispatch_table::dispatch_table(const std::type_info& _type)
+:	mr_type(_type)
+{
+	for(size_type i = 0; i < max_blocks; ++i) m_blocks[i].store(0,boost::memory_order_relaxed);
+}
+
+
+dispatch_table::~dispatch_table()
+{
+	for(size_type i = 0; i < max_blocks; ++i) delete[] m_blocks[i].load(boost::memory_order_relaxed);
+}
+
+
+void dispatch_table::set(size_type _task,std::ptrdiff_t _offset) const
+{
+	size_type b = _task >> block_bits;
+	if (b >= max_blocks) return; // too many task types: these are looked up every time
+
+	boost::atomic<std::ptrdiff_t>* block = m_blocks[b].load(boost::memory_order_acquire);
+	if (!block)
+	{
+		boost::lock_guard<boost::mutex> lock(dispatch_registry::instance().mutex);
+		block = m_blocks[b].load(boost::memory_order_acquire);
+		if (!block)
+		{
+			block = new boost::atomic<std::ptrdiff_t>[block_size];
+			for(size_type i = 0; i < block_size; ++i) block[i].store(unresolved,boost::memory_order_relaxed);
+			m_blocks[b].store(block,boost::memory_order_release);
+		}
+	}
+
+	block[_task & (block_size - 1)].store(_offset,boost::memory_order_relaxed);
+}
+
+
+const dispatch_table& dispatch_table::get(const std::type_info& _type)
+{
+	return dispatch_registry::instance().table(_type);
+}
+
+
+size_type dispatch_table::new_task()
+{
+	dispatch_registry& r = dispatch_registry::instance();
+	boost::lock_guard<boost::mutex> lock(r.mutex);
+	return r.tasks++;
+}
+
+
+
+} // namespace detail
+} // namespace fbox
@@ -98,17 +98,87 @@
 		...
 	};
 	\endcode
+
+
+	\par Dispatch
+
+	Each task type is given a number the first time it is used and each functor type a table, indexed by
+	task number, of where its handlers lie within the object. The first <code>apply</code> of a task to a
+	type of functor finds the handler with a <code>dynamic_cast</code> and records it; later ones read the
+	table, so dispatch takes constant time whatever the shape of the functor or task hierarchies. Tasks
+	must not be applied to a functor while it is being constructed or destroyed.
 */
 
 
 #include "main.h"
+#include <cstddef>
 #include <typeinfo>
+#include <boost/atomic.hpp>
 
 
 namespace fbox {
 
 
 class functor;
+template<typename _T> class task_handle;
+
+
+namespace detail {
+
+//! Positions of the task handlers within objects of one functor type, indexed by task number
+class dispatch_table
+{
+public:
+	enum
+	{
+		unresolved = -1,	//!< Handler not looked up yet
+		unsupported = -2	//!< Functor does not handle the task
+	};
+
+	const std::type_info& type() const { return mr_type; }
+
+	//! Offset of the handler of task _task from the start of the object, or one of the values above
+	std::ptrdiff_t offset(size_type _task) const
+	{
+		size_type b = _task >> block_bits;
+		if (b >= max_blocks) return unresolved;
+
+		const boost::atomic<std::ptrdiff_t>* block = m_blocks[b].load(boost::memory_order_acquire);
+		return block ? block[_task & (block_size - 1)].load(boost::memory_order_relaxed) : std::ptrdiff_t(unresolved);
+	}
+
+	//! Record the offset of the handler of task _task
+	void set(size_type _task,std::ptrdiff_t _offset) const;
+
+	//! Table of functor type _type. Tables last until the program ends.
+	static const dispatch_table& get(const std::type_info& _type);
+
+	//! Number for a new task type
+	static size_type new_task();
+
+private:
+	enum { block_bits = 6, block_size = 1 << block_bits, max_blocks = 64 };
+
+	const std::type_info& mr_type;
+	mutable boost::atomic<boost::atomic<std::ptrdiff_t>*> m_blocks[max_blocks]; //!< Allocated as tasks are seen
+
+	explicit dispatch_table(const std::type_info& _type);
+	~dispatch_table();
+
+	friend struct dispatch_registry;
+};
+
+
+//! Number of task type _T
+template<typename _T>
+size_type task_number()
+{
+	static const size_type n = dispatch_table::new_task();
+	return n;
+}
+
+} // namespace detail
+
 
 //! Task base class. 
 /*! See \ref functor_task "functor framework" for full details. */
@@ -140,8 +210,12 @@ protected:
 class functor
 {
 public :
+	functor() : mp_dispatch(0) {}
+	functor(const functor&) : mp_dispatch(0) {}
 	virtual ~functor() {}
 
+	functor& operator=(const functor&) { return *this; }
+
 	//! Execute a task and report exit state.
 	/*! \return True if successful, false if task is not supported or the execution reports error. */
 	virtual bool apply(task& _tsk) { return _tsk.apply_inv(*this); }
@@ -149,6 +223,18 @@ public :
 	//! Constant version of <code>apply</code>
 	/*! \return True if successful, false if task is not supported or the execution reports error. */
 	virtual bool apply(task& _tsk) const { return _tsk.const_apply_inv(*this); }
+
+	//! Handler of task _T, or null if the functor does not support it
+	template<typename _T>
+	task_handle<_T>* handle() { return const_cast<task_handle<_T>*>(static_cast<const functor*>(this)->handle<_T>()); }
+
+	template<typename _T>
+	const task_handle<_T>* handle() const;
+
+private:
+	mutable boost::atomic<const detail::dispatch_table*> mp_dispatch; //!< Table of the last type seen
+
+	const detail::dispatch_table& dispatch() const;
 };
 
 
@@ -251,11 +337,41 @@ public :
 
 
 
+inline const detail::dispatch_table& functor::dispatch() const
+{
+	const std::type_info& type = typeid(*this);
+	const detail::dispatch_table* t = mp_dispatch.load(boost::memory_order_acquire);
+	if (!t || (&t->type() != &type && t->type() != type))
+	{
+		t = &detail::dispatch_table::get(type);
+		mp_dispatch.store(t,boost::memory_order_release);
+	}
+
+	return *t;
+}
+
+
+template<typename _T>
+const task_handle<_T>* functor::handle() const
+{
+	const detail::dispatch_table& table = dispatch();
+	size_type n = detail::task_number<_T>();
+	const char* object = static_cast<const char*>(dynamic_cast<const void*>(this));
+
+	std::ptrdiff_t offset = table.offset(n);
+	if (offset >= 0) return reinterpret_cast<const task_handle<_T>*>(object + offset);
+	if (offset == detail::dispatch_table::unsupported) return 0;
+
+	const task_handle<_T>* h = dynamic_cast<const task_handle<_T>*>(this);
+	table.set(n,h ? reinterpret_cast<const char*>(h) - object : std::ptrdiff_t(detail::dispatch_table::unsupported));
+	return h;
+}
+
+
 template<typename _T>
 bool declare_task<_T>::apply_inv(functor& func)
 {
-	typedef task_handle<_T> target_task;
-	target_task* t = dynamic_cast<target_task*>(&func);
+	task_handle<_T>* t = func.handle<_T>();
 	if(t)
 	{
 		return t->task_impl( static_cast<_T&>(*this) );
@@ -271,8 +387,7 @@ bool declare_task<_T>::apply_inv(functor& func)
 template<typename _T>
 bool declare_task<_T>::const_apply_inv(const functor& func)
 {
-	typedef const task_handle<_T> target_task;
-	target_task* t = dynamic_cast<target_task*>(&func);
+	const task_handle<_T>* t = func.handle<_T>();
 	if(t)
 	{
 		return t->task_impl( static_cast<_T&>(*this) );
@@ -48,6 +48,35 @@ public:
 };
 
 
+//! 4-point Gauss-Legendre integration, exact for polynomials of degree 7 or less
+class gauss_legendre4
+{
+public:
+	template<typename _func>
+	double operator() (
+		double _x0,			//!< Lower limit
+		double _x1,			//!< Upper limit
+		_func& _function)	//!< Integrand
+		const
+	{
+		static const double x[] = {0.3399810435848563,0.8611363115940526};
+		static const double w[] = {0.6521451548625461,0.3478548451374538};
+
+		double xm = 0.5 * (_x1 + _x0);
+		double xr = 0.5 * (_x1 - _x0);
+
+		double s = 0.0;
+		for (int j = 0; j < 2; ++j)
+		{
+			double dx = xr * x[j];
+			s += w[j] * (_function(xm+dx) + _function(xm-dx));
+		}
+
+		return s * xr;
+	}
+};
+
+
 } // namespace math
 } // namespace fbox
 
@@ -9,42 +9,81 @@
 #include "main.h"
 #include "error.h"
 #include "interpolator.h"
+#include <algorithm>
 
 namespace fbox {
 namespace math {
 
 
+////////////////////////////////////////
+// table_interpolator_impl
+////////////////////////////////////////
+
+void table_interpolator_impl::locate(const double* _x,int* _seg,size_type _n,int& _hint) const
+{
+	for(size_type i = 0; i < _n; ++i) _seg[i] = locate(_x[i],_hint);
+}
+
+
+
 ////////////////////////////////////////
 // linear_interpolator
 ////////////////////////////////////////
 
+linear_interpolator::linear_interpolator(const table_type& _table)
+:	table_interpolator_impl(_table)
+{
+	size_type n = mr_table.size();
+	m_sums.resize(n);
+
+	for(size_type i = 1; i < n; ++i)
+	{
+		double h = mr_table[i].first - mr_table[i-1].first;
+		m_sums[i] = m_sums[i-1] + (mr_table[i-1].second + mr_table[i].second) * h / 2.0;
+	}
+}
+
+
 double linear_interpolator::operator() (double _x) const
 {
-	int i0,i1;
-	double v;
+	int hint = -1;
+	return (*this)(_x,hint);
+}
+
+
+double linear_interpolator::operator() (double _x,int& _hint) const
+{
+	return value(_x,locate(_x,_hint));
+}
+
+
+void linear_interpolator::evaluate(const double* _x,double* _y,size_type _n) const
+{
+	evaluate_blocks(*this,_x,_y,_n);
+}
 
-	// check bounds
+
+double linear_interpolator::primitive(double _x,int& _hint) const
+{
+	// flat extrapolation at both ends
 	if (_x <= mr_table.front().first)
-		v = mr_table.front().second;
+		return mr_table.front().second * (_x - mr_table.front().first);
 	else if (_x >= mr_table.back().first) 
-		v = mr_table.back().second;
-	else
-	{
-		sorted_find_adaptor adapt(mr_table);
-		i0 = sorted_find(adapt,_x);
-		i1 = i0 + 1;
-		v = interp1(_x,mr_table[i0].first,mr_table[i1].first,mr_table[i0].second,mr_table[i1].second);
-	}
+		return m_sums.back() + mr_table.back().second * (_x - mr_table.back().first);
+
+	int i = locate(_x,_hint);
 
-	return v;
+	double dx = _x - mr_table[i].first;
+	double y = interp1(_x,mr_table[i].first,mr_table[i+1].first,mr_table[i].second,mr_table[i+1].second);
+	return m_sums[i] + (mr_table[i].second + y) * dx / 2.0;
 }
 
 
-double linear_interpolator::interp1(double x,double x0,double x1,double y0,double y1) const
+double linear_interpolator::integral(double _x0,double _x1) const
 {
-	double dif(x1-x0);
-	if(dif == 0.) return y0;
-	return (x-x0) * (y1-y0)/dif + y0;
+	int hint = -1;
+	double p0 = primitive(_x0,hint);
+	return primitive(_x1,hint) - p0;
 }
 
 
@@ -139,73 +178,70 @@ void cubic_spline_interpolator::make_spline()
 		m_deriv2[k] = m_deriv2[k] * m_deriv2[k+1] + u[k];
 	}
 
+	// exact segment integrals h (y0 + y1) / 2 - h^3 (y0'' + y1'') / 24
+	m_sums.resize(sz);
+	m_sums[0] = 0.0;
+	for(int i = 1; i < n; ++i)
+	{
+		double h = mr_table[i].first - mr_table[i-1].first;
+		m_sums[i] = m_sums[i-1] + h * (mr_table[i-1].second + mr_table[i].second) / 2.0 
+			- h * h * h * (m_deriv2[i-1] + m_deriv2[i]) / 24.0;
+	}
 }
 
 
 double cubic_spline_interpolator::operator() (double _x) const 
+{
+	int hint = -1;
+	return (*this)(_x,hint);
+}
+
+
+double cubic_spline_interpolator::operator() (double _x,int& _hint) const 
 {	
 	if (!m_deriv2.size()) throw error("cubic-spline table is not valid");
-	
-	double a,b,h;
+	return value(_x,locate(_x,_hint));
+}
 
-	int klo = 0;
-	int khi = int(mr_table.size() - 1);
-	int k;
 
-	if(_x > mr_table[khi].first)		
-	{
-		if( m_end > 0.99e30 )
-		{
-			klo = khi - 1;
-			h = mr_table[khi].first - mr_table[klo].first;
-			a = (mr_table[khi].first - _x) / h;
-			b = (_x - mr_table[klo].first) / h;
-			return (a * mr_table[klo].second + b * mr_table[khi].second - a * m_deriv2[klo] * (h*h) / 6.0);
-	
-		}
-		else 
-		{
-			return ( mr_table[khi].second + m_end * (_x - mr_table[khi].first) );
-		}
+void cubic_spline_interpolator::evaluate(const double* _x,double* _y,size_type _n) const
+{
+	if (!m_deriv2.size()) throw error("cubic-spline table is not valid");
+	evaluate_blocks(*this,_x,_y,_n);
+}
 
-	}
 
-	else if(_x < mr_table[klo].first)	
-	{
-		if ( m_start > 0.99e30 )
-		{
-			khi = 1;
-			h = mr_table[khi].first - mr_table[klo].first;
-			a = (mr_table[khi].first - _x) / h;
-			b = (_x - mr_table[klo].first) / h;
-			return (a * mr_table[klo].second + b * mr_table[khi].second - a * m_deriv2[khi] * (h*h) / 6.0);
-		}
-		else
-		{
-			return ( mr_table[klo].second + m_start * (_x - mr_table[klo].first) );
-		}
-	}
 
-	while ( khi-klo > 1 ) 
-	{
-		k = (khi + klo) >> 1;
-		if (mr_table[k].first > _x) 
-		{
-			khi = k;
-		}
-		else 
-		{
-			klo = k;
-		}
-	}
+double cubic_spline_interpolator::primitive(double _x,int& _hint) const
+{
+	if (!m_deriv2.size()) throw error("cubic-spline table is not valid");
+
+	// extrapolation is linear at both ends (though not always continuous) so the midpoint rule is exact
+	int khi = int(mr_table.size() - 1);
+	if (_x < mr_table.front().first)
+		return (_x - mr_table.front().first) * (*this)((_x + mr_table.front().first) / 2.0);
+	else if (_x > mr_table[khi].first)
+		return m_sums.back() + (_x - mr_table[khi].first) * (*this)((_x + mr_table[khi].first) / 2.0);
+
+	int klo = locate(_x,_hint);
 
-	h = mr_table[khi].first - mr_table[klo].first;
-	a = (mr_table[khi].first - _x) / h;
-	b = (_x - mr_table[klo].first) / h;
+	double h = mr_table[klo+1].first - mr_table[klo].first;
+	double b = (_x - mr_table[klo].first) / h;
+	double a = 1.0 - b;
+	double a2 = a * a, b2 = b * b;
 
-	return ( a * mr_table[klo].second + b * mr_table[khi].second + ((a*a*a-a) * m_deriv2[klo] + (b*b*b-b) * m_deriv2[khi]) * (h*h) / 6.0 );
+	// antiderivative of the spline polynomial from the start of the segment
+	return m_sums[klo] + h * ( mr_table[klo].second * (b - b2 / 2.0) + mr_table[klo+1].second * b2 / 2.0 
+		+ h * h / 6.0 * ( m_deriv2[klo] * (a2 / 2.0 - a2 * a2 / 4.0 - 0.25) + m_deriv2[klo+1] * (b2 * b2 / 4.0 - b2 / 2.0) ) );
+}
+
+
+double cubic_spline_interpolator::integral(double _x0,double _x1) const
+{
+	int hint = -1;
+	double p0 = primitive(_x0,hint);
+	return primitive(_x1,hint) - p0;
 }
 
 } // namespace math
 } // namespace fbox
-
@@ -10,12 +10,46 @@
 
 #include "main.h"
 #include "math.h"
+#include <algorithm>
+#include <cstring>
 #include <map>
 #include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/integral_constant.hpp>
 
 namespace fbox {
 namespace math {
 
+namespace detail {
+
+//! All bits set where _a < _b. The difference of two distinct doubles is never zero, so its sign bit decides,
+//! and is turned into a mask by integer shifts: gcc does not vectorise conditional expressions on doubles
+//! under trapping math (see the masks in math.cpp, which only take non negative values).
+inline boost::uint64_t less_mask(double _a,double _b)
+{
+	double d = _a - _b;
+	boost::uint64_t b;
+	std::memcpy(&b,&d,sizeof(b));
+	return 0 - (b >> 63);
+}
+
+
+//! _a where the mask _m is set and _b elsewhere
+inline double select(boost::uint64_t _m,double _a,double _b)
+{
+	boost::uint64_t a,b;
+	std::memcpy(&a,&_a,sizeof(a));
+	std::memcpy(&b,&_b,sizeof(b));
+	a = (a & _m) | (b & ~_m);
+
+	double r;
+	std::memcpy(&r,&a,sizeof(r));
+	return r;
+}
+
+} // namespace detail
+
+
 //! Define point and table types for tabulated interpolators
 class table_interpolator_impl
 {
@@ -26,6 +60,13 @@ public:
 	table_interpolator_impl(const table_type& _table)
 	:	mr_table(_table) {}
 
+	//! Segment of _x: the last point of the table at or before _x, limited to the segments of the table so
+	//! that points outside it fall in the end segments. Increasing points walk forward from _hint.
+	int locate(double _x,int& _hint) const;
+
+	//! Segments of _n points, as above
+	void locate(const double* _x,int* _seg,size_type _n,int& _hint) const;
+
 protected:
 	const table_type& mr_table;
 };
@@ -35,9 +76,10 @@ struct right_continuous
 {
 	static double interp(double x,double x0,double x1,double y0,double y1)
 	{
-		if (x < x1 - TINY) return y0;
-		else return y1;
+		return detail::select(detail::less_mask(x,x1 - TINY),y0,y1);
 	}
+
+	static double level(double y0,double /*y1*/) { return y0; } //!< Value inside a segment
 };
 
 
@@ -45,9 +87,10 @@ struct left_continuous
 {
 	static double interp(double x,double x0,double x1,double y0,double y1)
 	{
-		if (x > x0 + TINY) return y1;
-		else return y0;
+		return detail::select(detail::less_mask(x0 + TINY,x),y1,y0);
 	}
+
+	static double level(double /*y0*/,double y1) { return y1; } //!< Value inside a segment
 };
 
 
@@ -56,10 +99,17 @@ template<typename _dir>
 class constant_interpolator : public table_interpolator_impl
 {
 public:
-	constant_interpolator(const table_type& _table)
-	:	table_interpolator_impl(_table) {}
+	constant_interpolator(const table_type& _table);
 
 	double operator() (double _x) const; // interpolation
+	double operator() (double _x,int& _hint) const; // interpolation starting from segment _hint
+	double value(double _x,int _seg) const; // interpolation in the segment given by locate()
+	void evaluate(const double* _x,double* _y,size_type _n) const; // batch interpolation
+	double primitive(double _x,int& _hint) const; // exact integral from the first point to _x
+	double integral(double _x0,double _x1) const; // exact integral
+
+private:
+	std::vector<double> m_sums; // integral from the first point to each point
 };
 
 
@@ -67,13 +117,24 @@ public:
 class linear_interpolator : public table_interpolator_impl
 {
 public:
-	linear_interpolator(const table_type& _table)
-	:	table_interpolator_impl(_table) {}
+	linear_interpolator(const table_type& _table);
 
 	double operator() (double _x) const;
+	double operator() (double _x,int& _hint) const;
+	double value(double _x,int _seg) const;
+	void evaluate(const double* _x,double* _y,size_type _n) const;
+	double primitive(double _x,int& _hint) const; // exact integral from the first point to _x
+	double integral(double _x0,double _x1) const; // exact integral
 
 private:
-	double interp1(double x,double x0,double x1,double y0,double y1) const;
+	std::vector<double> m_sums; // integral from the first point to each point
+
+	static double interp1(double x,double x0,double x1,double y0,double y1)
+	{
+		double dif(x1-x0);
+		double v = (x-x0) * (y1-y0)/dif + y0; // computed unconditionally so that the choice below is a select
+		return detail::select(detail::less_mask(0.,dif),v,y0); // table points are sorted, so dif is 0 or more
+	}
 };
 
 
@@ -87,9 +148,15 @@ public:
 		double _end = 1e30);		//!< Ending 1st derivative
 
 	double operator() (double _x) const;
+	double operator() (double _x,int& _hint) const;
+	double value(double _x,int _seg) const;
+	void evaluate(const double* _x,double* _y,size_type _n) const;
+	double primitive(double _x,int& _hint) const; // exact integral from the first point to _x
+	double integral(double _x0,double _x1) const; // exact integral
 
 private:
 	std::vector<double> m_deriv2;
+	std::vector<double> m_sums; // integral from the first point to each point
 	double m_start,m_end;
 
 	void check_table();
@@ -97,6 +164,22 @@ private:
 };
 
 
+//! True for interpolators that are piecewise polynomials (of degree 3 or less) between the points of their
+//! table, and have exact <code>primitive</code> and <code>integral</code> members. Specialise for new
+//! interpolators of that kind.
+template<typename _interp>
+struct is_piecewise_polynomial : public boost::false_type {};
+
+template<typename _dir>
+struct is_piecewise_polynomial<constant_interpolator<_dir> > : public boost::true_type {};
+
+template<>
+struct is_piecewise_polynomial<linear_interpolator> : public boost::true_type {};
+
+template<>
+struct is_piecewise_polynomial<cubic_spline_interpolator> : public boost::true_type {};
+
+
 //! adapt table for use in sorted_find
 struct sorted_find_adaptor
 {
@@ -107,31 +190,171 @@ struct sorted_find_adaptor
 };
 
 
+inline int table_interpolator_impl::locate(double _x,int& _hint) const
+{
+	sorted_find_adaptor adapt(mr_table);
+	int last = std::max(int(mr_table.size()) - 2,0);
+	return std::min(std::max(sorted_find(adapt,_x,_hint),0),last);
+}
+
+
+//! Batch interpolation in blocks of points: a first pass finds the segments and a second computes the values
+//! with the interpolator's value(). The second pass makes its choices with bit masks rather than conditionals
+//! and writes to a local buffer that cannot alias the table, so the compiler vectorises it under the default
+//! (trapping) floating point flags.
+template<typename _interp>
+void evaluate_blocks(const _interp& _i,const double* _x,double* _y,size_type _n)
+{
+	const size_type block = 256;
+	int seg[block];
+	double y[block];
+	int hint = -1;
+
+	for(size_type k = 0; k < _n; k += block)
+	{
+		size_type m = std::min(block,_n - k);
+		const double* x = _x + k;
+		_i.locate(x,seg,m,hint);
+		for(size_type j = 0; j < m; ++j) y[j] = _i.value(x[j],seg[j]);
+		std::copy(y,y + m,_y + k);
+	}
+}
+
+
+
+////////////////////////////////////////
+// linear_interpolator
+////////////////////////////////////////
+
+inline double linear_interpolator::value(double _x,int _seg) const
+{
+	// points copied up front so that all loads are unconditional
+	int i1 = _seg + 1 < int(mr_table.size())? _seg + 1 : _seg; // single point tables
+	point_type p0 = mr_table[_seg];
+	point_type p1 = mr_table[i1];
+	point_type front = mr_table.front();
+	point_type back = mr_table.back();
+
+	// flat outside the table
+	double v = interp1(_x,p0.first,p1.first,p0.second,p1.second);
+	v = detail::select(detail::less_mask(_x,back.first),v,back.second);
+	return detail::select(detail::less_mask(front.first,_x),v,front.second);
+}
+
+
+
+////////////////////////////////////////
+// cubic_spline_interpolator
+////////////////////////////////////////
+
+inline double cubic_spline_interpolator::value(double _x,int _seg) const
+{
+	int klo = _seg;
+	int khi = klo + 1;
+	const point_type& lo = mr_table[klo];
+	const point_type& hi = mr_table[khi];
+	const point_type& front = mr_table.front();
+	const point_type& back = mr_table.back();
+
+	double h = hi.first - lo.first;
+	double a = (hi.first - _x) / h;
+	double b = (_x - lo.first) / h;
+
+	double v = a * lo.second + b * hi.second + ((a*a*a-a) * m_deriv2[klo] + (b*b*b-b) * m_deriv2[khi]) * (h*h) / 6.0;
+
+	// outside the table points fall in the end segments. Natural ends continue the end segment linearly,
+	// others extrapolate with the given derivative. Every case is computed and the result selected.
+	double left_natural = a * lo.second + b * hi.second - a * m_deriv2[khi] * (h*h) / 6.0;
+	double left_slope = front.second + m_start * (_x - front.first);
+	double right_natural = a * lo.second + b * hi.second - a * m_deriv2[klo] * (h*h) / 6.0;
+	double right_slope = back.second + m_end * (_x - back.first);
+
+	double left = detail::select(detail::less_mask(0.99e30,m_start),left_natural,left_slope);
+	double right = detail::select(detail::less_mask(0.99e30,m_end),right_natural,right_slope);
+	v = detail::select(detail::less_mask(_x,front.first),left,v);
+	return detail::select(detail::less_mask(back.first,_x),right,v);
+}
+
+
 
 ////////////////////////////////////////
 // constant_interpolator
 ////////////////////////////////////////
 
+template<typename _dir>
+constant_interpolator<_dir>::constant_interpolator(const table_type& _table)
+:	table_interpolator_impl(_table)
+{
+	size_type n = mr_table.size();
+	m_sums.resize(n);
+
+	for(size_type i = 1; i < n; ++i)
+	{
+		double h = mr_table[i].first - mr_table[i-1].first;
+		m_sums[i] = m_sums[i-1] + _dir::level(mr_table[i-1].second,mr_table[i].second) * h;
+	}
+}
+
+
 template<typename _dir>
 double constant_interpolator<_dir>::operator() (double _x) const
 {
-	int i0,i1;
-	double v;
+	int hint = -1;
+	return (*this)(_x,hint);
+}
+
 
-	// check bounds
+template<typename _dir>
+double constant_interpolator<_dir>::operator() (double _x,int& _hint) const
+{
+	return value(_x,locate(_x,_hint));
+}
+
+
+template<typename _dir>
+double constant_interpolator<_dir>::value(double _x,int _seg) const
+{
+	// points copied up front so that all loads are unconditional
+	int i1 = _seg + 1 < int(mr_table.size())? _seg + 1 : _seg; // single point tables
+	point_type p0 = mr_table[_seg];
+	point_type p1 = mr_table[i1];
+	point_type front = mr_table.front();
+	point_type back = mr_table.back();
+
+	// flat outside the table
+	double v = _dir::interp(_x,p0.first,p1.first,p0.second,p1.second);
+	v = detail::select(detail::less_mask(_x,back.first),v,back.second);
+	return detail::select(detail::less_mask(front.first,_x),v,front.second);
+}
+
+
+template<typename _dir>
+void constant_interpolator<_dir>::evaluate(const double* _x,double* _y,size_type _n) const
+{
+	evaluate_blocks(*this,_x,_y,_n);
+}
+
+
+template<typename _dir>
+double constant_interpolator<_dir>::primitive(double _x,int& _hint) const
+{
+	// flat extrapolation at both ends
 	if (_x <= mr_table.front().first)
-		v = mr_table.front().second;
+		return mr_table.front().second * (_x - mr_table.front().first);
 	else if (_x >= mr_table.back().first) 
-		v = mr_table.back().second;
-	else
-	{
-		sorted_find_adaptor adapt(mr_table);
-		i0 = sorted_find(adapt,_x);
-		i1 = i0 + 1;
-		v = _dir::interp(_x,mr_table[i0].first,mr_table[i1].first,mr_table[i0].second,mr_table[i1].second);
-	}
+		return m_sums.back() + mr_table.back().second * (_x - mr_table.back().first);
 
-	return v;
+	int i = locate(_x,_hint);
+	return m_sums[i] + _dir::level(mr_table[i].second,mr_table[i+1].second) * (_x - mr_table[i].first);
+}
+
+
+template<typename _dir>
+double constant_interpolator<_dir>::integral(double _x0,double _x1) const
+{
+	int hint = -1;
+	double p0 = primitive(_x0,hint);
+	return primitive(_x1,hint) - p0;
 }
 
 
@@ -9,9 +9,38 @@
 #include "main.h"
 #include "line.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace fbox {
 namespace math {
 
+bool piecewise_integral(double _x0,double _x1,const line& _l0,const line& _l1,double& _result)
+{
+	double lo = std::min(_x0,_x1);
+	double hi = std::max(_x0,_x1);
+
+	// knots strictly inside the range, each list sorted
+	std::vector<double> k0,k1;
+	if (!_l0.knots(lo,hi,k0) || !_l1.knots(lo,hi,k1)) return false;
+
+	std::vector<double> k;
+	k.reserve(k0.size() + k1.size() + 2);
+	k.push_back(lo);
+	std::merge(k0.begin(),k0.end(),k1.begin(),k1.end(),std::back_inserter(k));
+	k.push_back(hi);
+	k.erase(std::unique(k.begin(),k.end()),k.end());
+
+	// the product is a polynomial of degree 6 or less between knots
+	gauss_legendre4 integ;
+	__prod func(_l0,_l1);
+
+	double v = 0.0;
+	for(size_type i = 1; i < k.size(); ++i) v += integ(k[i-1],k[i],func);
+
+	_result = _x1 < _x0? -v : v;
+	return true;
+}
 
 } // namespace math
 } // namespace fbox
@@ -12,7 +12,10 @@
 #include "error.h"
 #include "interpolator.h"
 #include "integrator.h"
+#include <cmath>
 #include <vector>
+#include <algorithm>
+#include <boost/static_assert.hpp>
 
 namespace fbox {
 namespace math {
@@ -25,14 +28,39 @@ public:
 	//! Interpolate point
 	virtual double operator() (double _x) const = 0;
 
+	//! Interpolate point, starting the search from the segment in _hint and leaving the segment found there.
+	//! Callers that query increasing points keep one hint per line, so most lookups only walk forward.
+	virtual double operator() (double _x,int& /*_hint*/) const { return (*this)(_x); }
+
+	//! Interpolate _n points at once. Lookups are fastest when _x is sorted in increasing order.
+	virtual void evaluate(const double* _x,double* _y,size_type _n) const
+	{
+		int hint = -1;
+		for(size_type i = 0; i < _n; ++i) _y[i] = (*this)(_x[i],hint);
+	}
+
 	//! Integrate line between two points
 	virtual double integral(double _x0,double _x1) const = 0;
 
 	//! Integrate line between two points weighted by second curve
 	virtual double integral(double _x0,double _x1,const line& _weights) const = 0;
+
+	//! Append the knots of a piecewise polynomial line (of degree 3 or less) strictly inside (_lo,_hi) to
+	//! _knots, in increasing order. Returns false, and appends nothing, if the line is not piecewise polynomial.
+	virtual bool knots(double /*_lo*/,double /*_hi*/,std::vector<double>& /*_knots*/) const { return false; }
 };
 
 
+//! Integral of the product of two piecewise polynomial lines, exact between the merged knots of both. Returns
+//! false if either line is not piecewise polynomial.
+bool piecewise_integral(
+	double _x0,			//!< Lower limit
+	double _x1,			//!< Upper limit
+	const line& _l0,	//!< First line
+	const line& _l1,	//!< Second line
+	double& _result);	//!< Integral
+
+
 //! Constant line
 class flat_line : public line
 {
@@ -42,16 +70,25 @@ public:
 
 	void setup(double _y) { m_y = _y; }
 
-	virtual double operator() (double _x) const  { return m_y; }
+	using line::operator();
+	virtual double operator() (double /*_x*/) const  { return m_y; }
+	virtual void evaluate(const double* /*_x*/,double* _y,size_type _n) const { std::fill(_y,_y + _n,m_y); }
 	virtual double integral(double _x0,double _x1) const { return m_y * (_x1 - _x0); }
 	virtual double integral(double _x0,double _x1,const line& _weights) const { return m_y * _weights.integral(_x0,_x1); }
+	virtual bool knots(double /*_lo*/,double /*_hi*/,std::vector<double>& /*_knots*/) const { return true; }
 
 protected:
 	double m_y;
 };
 
 
-//! Constant line
+//! Tabulated line. The interpolator is built lazily on first use, so instances must not be shared
+//! between threads while being modified or before they are first evaluated (see compiled_line).
+/*!
+	Lines with piecewise polynomial interpolators (see is_piecewise_polynomial) are integrated exactly by
+	their interpolator. The integrator is used for other interpolators and for weights that are not
+	piecewise polynomial.
+*/
 template<
 	typename _interp,	//!< Interpolator method 
 	typename _integ>	//!< Integrator method
@@ -94,8 +131,11 @@ public:
 	interpolated_line& add(double x,double y) { m_table.push_back(point_type(x,y)); m_update = true; return *this; }
 
 	virtual double operator() (double _x) const;
+	virtual double operator() (double _x,int& _hint) const;
+	virtual void evaluate(const double* _x,double* _y,size_type _n) const;
 	virtual double integral(double _x0,double _x1) const;
 	virtual double integral(double _x0,double _x1,const line& _weights) const;
+	virtual bool knots(double _lo,double _hi,std::vector<double>& _knots) const;
 
 protected:
 	table_type m_table;
@@ -103,6 +143,110 @@ protected:
 private:
 	mutable interpolator_type* mp_interp;
 	mutable bool m_update;
+
+	const interpolator_type& interpolator() const;
+
+	double integral_impl(double _x0,double _x1,boost::true_type) const { return interpolator().integral(_x0,_x1); }
+	double integral_impl(double _x0,double _x1,boost::false_type) const { integrator_type i; return i(_x0,_x1,*this); }
+};
+
+
+//! Polynomial stored per grid interval by compiled_line for an interpolator
+/*!
+	Each interval holds a polynomial of degree size - 1 in the position t in [0,1] within the interval,
+	fitted through size equally spaced samples of the line (both ends included). Lines with jumps have
+	no grid form (size 0). Specialise for new interpolators.
+*/
+template<typename _interp>
+struct grid_cell
+{
+	enum { size = 2 };
+
+	//! Coefficients _c, in increasing powers of t, from the samples _f
+	static void fit(const double* _f,double* _c) { _c[0] = _f[0]; _c[1] = _f[1] - _f[0]; }
+};
+
+template<typename _dir>
+struct grid_cell<constant_interpolator<_dir> >
+{
+	enum { size = 0 };
+};
+
+//! Cubic through four samples, which is exact on intervals without a spline knot
+template<>
+struct grid_cell<cubic_spline_interpolator>
+{
+	enum { size = 4 };
+
+	static void fit(const double* _f,double* _c)
+	{
+		_c[0] = _f[0];
+		_c[1] = (-11.0 * _f[0] + 18.0 * _f[1] - 9.0 * _f[2] + 2.0 * _f[3]) / 2.0;
+		_c[2] = (18.0 * _f[0] - 45.0 * _f[1] + 36.0 * _f[2] - 9.0 * _f[3]) / 2.0;
+		_c[3] = (-9.0 * _f[0] + 27.0 * _f[1] - 27.0 * _f[2] + 9.0 * _f[3]) / 2.0;
+	}
+};
+
+
+//! Immutable form of an interpolated line. Everything is computed on construction, so instances can be
+//! shared freely between threads.
+/*!
+	If a grid size is given the line is also resampled at that many equally spaced intervals over the
+	range of the table, and each interval stores the polynomial given by grid_cell: linear for linear
+	lines, cubic for cubic splines. Points inside the range then cost a multiply, a truncation and a
+	short Horner evaluation. This is exact for linear lines whose knots fall on the grid, for splines on
+	intervals without a knot, and an approximation otherwise. Constant lines have jumps and can't be
+	given a grid (a compile time error). Points outside the range always use the original interpolator.
+*/
+template<
+	typename _interp,	//!< Interpolator method 
+	typename _integ>	//!< Integrator method
+class compiled_line : public line
+{
+public:
+	typedef _interp interpolator_type;
+	typedef _integ integrator_type;
+	typedef interpolated_line<_interp,_integ> source_type;
+	typedef typename interpolator_type::table_type table_type;
+
+	//! Compile with exact interpolation
+	explicit compiled_line(const source_type& _line);
+
+	//! Compile onto a uniform grid
+	compiled_line(
+		const source_type& _line,	//!< Line to compile
+		size_type _grid);			//!< Number of uniform grid intervals, or zero to keep exact interpolation
+
+	const table_type& table() const { return m_table; }
+
+	virtual double operator() (double _x) const;
+	virtual double operator() (double _x,int& _hint) const;
+	virtual void evaluate(const double* _x,double* _y,size_type _n) const;
+	virtual double integral(double _x0,double _x1) const;
+	virtual double integral(double _x0,double _x1,const line& _weights) const;
+	virtual bool knots(double _lo,double _hi,std::vector<double>& _knots) const;
+
+private:
+	const table_type m_table;
+	const interpolator_type m_interp; // must follow m_table, which it references
+
+	enum { cell_size = grid_cell<_interp>::size };
+
+	double m_x0,m_x1,m_scale;
+	size_type m_cells;
+	std::vector<double> m_coef; // cell_size coefficients per grid interval, in powers of t = u - i with u = (x - x0) * scale
+	std::vector<double> m_sums; // integral from x0 to each grid node
+
+	double primitive(double _x) const;
+	double grid_value(double _x) const;
+
+	double integral_impl(double _x0,double _x1,boost::true_type) const;
+	double integral_impl(double _x0,double _x1,boost::false_type) const { integrator_type i; return i(_x0,_x1,*this); }
+
+	static const table_type& check(const table_type& _table);
+
+	compiled_line(const compiled_line&); // not copyable as m_interp refers to m_table
+	compiled_line& operator=(const compiled_line&);
 };
 
 
@@ -125,7 +269,7 @@ typedef interpolated_line<cubic_spline_interpolator,gauss_legendre10> cspline_li
 ////////////////////////////////////////
 
 template<typename _interp,typename _integ>
-double interpolated_line<_interp,_integ>::operator() (double _x) const
+const _interp& interpolated_line<_interp,_integ>::interpolator() const
 {
 	if (m_update)
 	{
@@ -136,34 +280,270 @@ double interpolated_line<_interp,_integ>::operator() (double _x) const
 		m_update = false;
 	}
 
-	return (*mp_interp)(_x);
+	return *mp_interp;
+}
+
+
+template<typename _interp,typename _integ>
+double interpolated_line<_interp,_integ>::operator() (double _x) const
+{
+	return interpolator()(_x);
+}
+
+
+template<typename _interp,typename _integ>
+double interpolated_line<_interp,_integ>::operator() (double _x,int& _hint) const
+{
+	return interpolator()(_x,_hint);
+}
+
+
+template<typename _interp,typename _integ>
+void interpolated_line<_interp,_integ>::evaluate(const double* _x,double* _y,size_type _n) const
+{
+	interpolator().evaluate(_x,_y,_n);
 }
 
 
 template<typename _interp,typename _integ>
 double interpolated_line<_interp,_integ>::integral(double _x0,double _x1) const
 {
-	integrator_type i;
-	return i(_x0,_x1,*this);
+	return integral_impl(_x0,_x1,is_piecewise_polynomial<_interp>());
+}
+
+
+//! Compare table points by abscissa
+struct __point_less
+{
+	typedef std::pair<double,double> point_type;
+	bool operator() (const point_type& _p,double _x) const { return _p.first < _x; }
+	bool operator() (double _x,const point_type& _p) const { return _x < _p.first; }
+};
+
+
+//! Append the abscissas of a sorted table strictly inside (_lo,_hi)
+template<typename _table_type>
+void append_knots(const _table_type& _table,double _lo,double _hi,std::vector<double>& _knots)
+{
+	typename _table_type::const_iterator itr = std::upper_bound(_table.begin(),_table.end(),_lo,__point_less());
+	typename _table_type::const_iterator end = std::lower_bound(itr,_table.end(),_hi,__point_less());
+	for(; itr < end; ++itr) _knots.push_back(itr->first);
+}
+
+
+template<typename _interp,typename _integ>
+bool interpolated_line<_interp,_integ>::knots(double _lo,double _hi,std::vector<double>& _knots) const
+{
+	if (!is_piecewise_polynomial<_interp>::value) return false;
+
+	append_knots(m_table,_lo,_hi,_knots);
+	return true;
 }
 
 
 struct __prod
 {
 	const line &l0,&l1;
-	__prod(const line& _l0,const line& _l1) : l0(_l0),l1(_l1) {}
-	double operator() (double _x) { return l0(_x) * l1(_x); }
+	int h0,h1; // quadrature points mostly increase, so lookups walk forward from the last segments
+	__prod(const line& _l0,const line& _l1) : l0(_l0),l1(_l1),h0(-1),h1(-1) {}
+	double operator() (double _x) { return l0(_x,h0) * l1(_x,h1); }
 };
 
 template<typename _interp,typename _integ>
 double interpolated_line<_interp,_integ>::integral(double _x0,double _x1,const line& _weights) const
 {
+	double v;
+	if (piecewise_integral(_x0,_x1,*this,_weights,v)) return v;
+
 	integrator_type i;
 	__prod func(*this,_weights);
 	return i(_x0,_x1,func);
 }
 
 
+
+////////////////////////////////////////
+// compiled_line
+////////////////////////////////////////
+
+template<typename _interp,typename _integ>
+compiled_line<_interp,_integ>::compiled_line(const source_type& _line)
+:	m_table(check(_line.table())),
+	m_interp(m_table),
+	m_x0(m_table.front().first),
+	m_x1(m_table.back().first),
+	m_scale(0.0),
+	m_cells(0)
+{
+}
+
+
+template<typename _interp,typename _integ>
+compiled_line<_interp,_integ>::compiled_line(const source_type& _line,size_type _grid)
+:	m_table(check(_line.table())),
+	m_interp(m_table),
+	m_x0(m_table.front().first),
+	m_x1(m_table.back().first),
+	m_scale(0.0),
+	m_cells(0)
+{
+	BOOST_STATIC_ASSERT(cell_size > 0); // lines with jumps have no grid form
+
+	if (_grid == 0 || m_x1 <= m_x0) return;
+
+	m_cells = _grid;
+	m_scale = _grid / (m_x1 - m_x0);
+	m_coef.resize(cell_size * _grid);
+
+	// samples at u = i + k / (cell_size - 1), the last one of each interval shared with the next
+	int hint = -1;
+	double f[cell_size > 0 ? cell_size : 1];
+	f[0] = m_interp(m_x0,hint);
+	for(size_type i = 0; i < _grid; ++i)
+	{
+		for(int k = 1; k < cell_size; ++k)
+		{
+			double u = i + double(k) / (cell_size - 1);
+			f[k] = m_interp(k + 1 < cell_size || i + 1 < _grid? m_x0 + u / m_scale : m_x1,hint);
+		}
+
+		grid_cell<_interp>::fit(f,&m_coef[cell_size * i]);
+		f[0] = f[cell_size - 1];
+	}
+
+	// integral of each interval is the sum of c[k] / (k + 1) over its width
+	m_sums.resize(_grid + 1);
+	for(size_type i = 0; i < _grid; ++i)
+	{
+		double v = 0.0;
+		for(int k = 0; k < cell_size; ++k) v += m_coef[cell_size * i + k] / (k + 1);
+		m_sums[i+1] = m_sums[i] + v / m_scale;
+	}
+}
+
+
+template<typename _interp,typename _integ>
+const typename compiled_line<_interp,_integ>::table_type& compiled_line<_interp,_integ>::check(const table_type& _table)
+{
+	if (!_table.size()) throw error("Empty table in compiled_line");
+	return _table;
+}
+
+
+template<typename _interp,typename _integ>
+inline double compiled_line<_interp,_integ>::grid_value(double _x) const
+{
+	double u = (_x - m_x0) * m_scale;
+	size_type i = std::min(static_cast<size_type>(u),m_cells - 1);
+	double t = u - i;
+	const double* c = &m_coef[cell_size * i];
+
+	double y = c[cell_size - 1];
+	for(int k = cell_size - 2; k >= 0; --k) y = y * t + c[k];
+	return y;
+}
+
+
+template<typename _interp,typename _integ>
+double compiled_line<_interp,_integ>::operator() (double _x) const
+{
+	if (!m_cells || !(_x >= m_x0 && _x < m_x1)) return m_interp(_x);
+	return grid_value(_x);
+}
+
+
+template<typename _interp,typename _integ>
+double compiled_line<_interp,_integ>::operator() (double _x,int& _hint) const
+{
+	if (!m_cells) return m_interp(_x,_hint);
+	return (*this)(_x);
+}
+
+
+template<typename _interp,typename _integ>
+void compiled_line<_interp,_integ>::evaluate(const double* _x,double* _y,size_type _n) const
+{
+	if (!m_cells) 
+	{
+		m_interp.evaluate(_x,_y,_n);
+		return;
+	}
+
+	for(size_type k = 0; k < _n; ++k)
+		_y[k] = _x[k] >= m_x0 && _x[k] < m_x1 ? grid_value(_x[k]) : m_interp(_x[k]);
+}
+
+
+template<typename _interp,typename _integ>
+double compiled_line<_interp,_integ>::primitive(double _x) const
+{
+	int hint = -1;
+	if (_x < m_x0) return m_interp.primitive(_x,hint);
+	if (_x >= m_x1) return m_sums.back() + m_interp.primitive(_x,hint) - m_interp.primitive(m_x1,hint);
+
+	double u = (_x - m_x0) * m_scale;
+	size_type i = std::min(static_cast<size_type>(u),m_cells - 1);
+	double t = u - i;
+	const double* c = &m_coef[cell_size * i];
+
+	double v = 0.0;
+	for(int k = cell_size - 1; k >= 0; --k) v = v * t + c[k] / (k + 1);
+	return m_sums[i] + v * t / m_scale;
+}
+
+
+template<typename _interp,typename _integ>
+double compiled_line<_interp,_integ>::integral(double _x0,double _x1) const
+{
+	return integral_impl(_x0,_x1,is_piecewise_polynomial<_interp>());
+}
+
+
+template<typename _interp,typename _integ>
+double compiled_line<_interp,_integ>::integral_impl(double _x0,double _x1,boost::true_type) const
+{
+	if (!m_cells) return m_interp.integral(_x0,_x1);
+	return primitive(_x1) - primitive(_x0);
+}
+
+
+template<typename _interp,typename _integ>
+double compiled_line<_interp,_integ>::integral(double _x0,double _x1,const line& _weights) const
+{
+	double v;
+	if (piecewise_integral(_x0,_x1,*this,_weights,v)) return v;
+
+	integrator_type i;
+	__prod func(*this,_weights);
+	return i(_x0,_x1,func);
+}
+
+
+template<typename _interp,typename _integ>
+bool compiled_line<_interp,_integ>::knots(double _lo,double _hi,std::vector<double>& _knots) const
+{
+	if (!is_piecewise_polynomial<_interp>::value) return false;
+
+	if (!m_cells)
+	{
+		append_knots(m_table,_lo,_hi,_knots);
+		return true;
+	}
+
+	// grid nodes x0 + i / scale, for i from 0 to the grid size
+	double n = double(m_cells);
+	double u0 = std::max((_lo - m_x0) * m_scale,0.0);
+	double u1 = std::min((_hi - m_x0) * m_scale,n);
+	for(double i = std::floor(u0); i <= std::ceil(u1); ++i)
+	{
+		double x = i < n? m_x0 + i / m_scale : m_x1;
+		if (x > _lo && x < _hi) _knots.push_back(x);
+	}
+
+	return true;
+}
+
+
 } // namespace math
 } // namespace fbox
 
@@ -7,11 +7,14 @@
 */
 
 #include "logger.h"
+#include "async_logger.h"
 #include "error.h"
 #include "system.h"
 #include "xml_utils.h"
 #include "date.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace fbox {
@@ -36,12 +39,8 @@ static void logger_closing_msg(std::ostream& _strm)
 }
 
 
-logger::logger()
-:	m_lv(WARNING),
-	m_perm_lv(WARNING),
-	m_temp_lv(WARNING),
-	mp_stream(&std::cerr),
-	m_head(true)
+//! Read logger settings from fbox.xml, if set
+static void logger_config(logger::level_type& _level,std::string& _file)
 {
 	TiXmlDocument doc;
 	if (doc.LoadFile(system::get_config_file()))
@@ -50,15 +49,43 @@ logger::logger()
 		if (top)
 		{
 			const char* str = fbox::xml::get_text(top,"logger","level");
-			if (str) set_trigger_level((level_type)atoi(str));
+			if (str) _level = (logger::level_type)atoi(str);
 
 			str = fbox::xml::get_text(top,"logger","file");
-			if (str) set_output(str,true);
+			if (str) _file = str;
 		}
 	}
 }
 
 
+static std::ofstream* logger_open(const std::string& _filename)
+{
+	std::ofstream* file( new std::ofstream(_filename.c_str()) );
+	if (!file->is_open())
+	{
+		delete file;
+		throw error("Failed to open log file");
+	}
+	return file;
+}
+
+
+logger::logger()
+:	m_lv(WARNING),
+	m_perm_lv(WARNING),
+	m_temp_lv(WARNING),
+	mp_stream(&std::cerr),
+	m_head(true)
+{
+	level_type lv = WARNING;
+	std::string file;
+	logger_config(lv,file);
+
+	set_trigger_level(lv);
+	if (!file.empty()) set_output(file,true);
+}
+
+
 logger::logger(std::ostream& _stream,bool _head,logger::level_type _level)
 :	m_lv(_level),
 	m_perm_lv(_level),
@@ -92,14 +119,274 @@ void logger::set_output(std::ostream& _stream,bool _head)
 
 void logger::set_output(const std::string& _filename,bool _head)
 {
-	std::ofstream* file( new std::ofstream(_filename.c_str()) );
-	if (!file && !file->is_open()) throw error("Failed to open log file");	
-
-	mp_stream.set(file,true);
+	mp_stream.set(logger_open(_filename),true);
 	if (m_head = _head) logger_opening_msg(*mp_stream);
 }
 
 
 
+//////////////////////////////////////////////////////
+// async_logger
+//////////////////////////////////////////////////////
+
+async_logger::async_logger()
+:	m_lv(logger::WARNING),
+	mp_stream(&std::cerr),
+	m_head(true),
+	m_capacity(DEFAULT_CAPACITY),
+	m_local(&async_logger::release),
+	m_stop(false),
+	m_passes(0)
+{
+	logger::level_type lv = logger::WARNING;
+	std::string file;
+	logger_config(lv,file);
+
+	m_lv = lv;
+	if (!file.empty()) mp_stream.set(logger_open(file),true);
+	start();
+}
+
+
+async_logger::async_logger(std::ostream& _stream,bool _head,logger::level_type _level,size_type _capacity)
+:	m_lv(_level),
+	mp_stream(&_stream),
+	m_head(_head),
+	m_capacity(_capacity),
+	m_local(&async_logger::release),
+	m_stop(false),
+	m_passes(0)
+{
+	start();
+}
+
+
+async_logger::async_logger(const std::string& _filename,bool _head,logger::level_type _level,size_type _capacity)
+:	m_lv(_level),
+	mp_stream(logger_open(_filename),true),
+	m_head(_head),
+	m_capacity(_capacity),
+	m_local(&async_logger::release),
+	m_stop(false),
+	m_passes(0)
+{
+	start();
+}
+
+
+async_logger::~async_logger()
+{
+	m_stop = true;
+	m_wake.notify_one();
+	m_thread.join();
+
+	if (m_head) logger_closing_msg(*mp_stream);
+
+	m_local.release();
+	for(size_type i = 0; i < m_buffers.size(); ++i) delete m_buffers[i];
+}
+
+
+void async_logger::start()
+{
+	if (m_capacity <= sizeof(ring::length_type)) throw error("async_logger ring buffers are too small to hold a record");
+	if (m_capacity > (1u << 31)) throw error("async_logger ring buffers are too large");
+
+	size_type capacity = 8;
+	while (capacity < m_capacity) capacity *= 2;
+	m_capacity = capacity;
+
+	if (m_head) logger_opening_msg(*mp_stream);
+	m_thread = boost::thread(&async_logger::run,this);
+}
+
+
+void async_logger::release(record* _rec)
+{
+	_rec->m_in_use = false;
+}
+
+
+async_logger::record& async_logger::local()
+{
+	record* r = m_local.get();
+	if (r) return *r;
+
+	// reuse the ring of a thread that has exited, once the records it left are written
+	boost::mutex::scoped_lock lock(m_mutex);
+	for(size_type i = 0; i < m_buffers.size() && !r; ++i)
+	{
+		record* c = m_buffers[i];
+		if (!c->m_in_use && c->m_ring.empty()) r = c;
+	}
+
+	if (r)
+	{
+		r->m_in_use = true;
+	}
+	else
+	{
+		r = new record(m_capacity);
+		m_buffers.push_back(r);
+	}
+
+	m_local.reset(r);
+	return *r;
+}
+
+
+async_logger::record& async_logger::begin_record()
+{
+	record& r = local();
+	r.m_buffer.clear();
+	r.clear();
+	return r;
+}
+
+
+void async_logger::end_record(record& _rec)
+{
+	char* data = _rec.m_buffer.data();
+	size_type n = _rec.m_buffer.size();
+
+	size_type max = _rec.m_ring.max_record();
+	if (n > max)
+	{
+		n = max;
+		data[n-1] = '\n';
+	}
+
+	// records are pushed whole, so the writer never sees part of one
+	while (!_rec.m_ring.push(data,n))
+	{
+		m_wake.notify_one();
+		boost::this_thread::yield();
+	}
+}
+
+
+async_logger::record_buffer::int_type async_logger::record_buffer::overflow(int_type _c)
+{
+	if (traits_type::eq_int_type(_c,traits_type::eof())) return traits_type::not_eof(_c);
+
+	size_type n = size();
+	m_buffer.resize(2 * m_buffer.size());
+	setp(&m_buffer[0],&m_buffer[0] + m_buffer.size());
+	pbump(static_cast<int>(n));
+
+	*pptr() = traits_type::to_char_type(_c);
+	pbump(1);
+	return _c;
+}
+
+
+void async_logger::flush()
+{
+	// the second pass to complete from now started after the call
+	size_type target = m_passes + 2;
+	while (m_passes < target)
+	{
+		m_wake.notify_one();
+		boost::this_thread::yield();
+	}
+
+	boost::mutex::scoped_lock lock(m_mutex);
+	mp_stream->flush();
+}
+
+
+bool async_logger::drain()
+{
+	bool written = false;
+
+	boost::mutex::scoped_lock lock(m_mutex);
+	for(size_type i = 0; i < m_buffers.size(); ++i)
+	{
+		if (m_buffers[i]->m_ring.pop(*mp_stream)) written = true;
+	}
+
+	++m_passes;
+	return written;
+}
+
+
+void async_logger::run()
+{
+	for(;;)
+	{
+		bool stop = m_stop;
+		if (drain()) continue;
+
+		// out of records: hand what was written to the output before waiting for more
+		boost::mutex::scoped_lock lock(m_mutex);
+		mp_stream->flush();
+		if (stop) break;
+
+		m_wake.timed_wait(lock,boost::posix_time::milliseconds(1));
+	}
+}
+
+
+
+////////////////////////////////////////
+// async_logger::ring
+////////////////////////////////////////
+
+void async_logger::ring::put(size_type _pos,const char* _data,size_type _n)
+{
+	size_type i = _pos & m_mask,n = std::min<size_type>(_n,m_data.size() - i);
+	std::memcpy(&m_data[i],_data,n);
+	std::memcpy(&m_data[0],_data + n,_n - n);
+}
+
+
+void async_logger::ring::get(size_type _pos,char* _data,size_type _n) const
+{
+	size_type i = _pos & m_mask,n = std::min<size_type>(_n,m_data.size() - i);
+	std::memcpy(_data,&m_data[i],n);
+	std::memcpy(_data + n,&m_data[0],_n - n);
+}
+
+
+bool async_logger::ring::push(const char* _data,size_type _n)
+{
+	size_type head = m_head.load(boost::memory_order_relaxed);
+	size_type tail = m_tail.load(boost::memory_order_acquire);
+	if (head - tail + sizeof(length_type) + _n > m_data.size()) return false;
+
+	length_type len = static_cast<length_type>(_n);
+	put(head,reinterpret_cast<const char*>(&len),sizeof(len));
+	put(head + sizeof(len),_data,_n);
+
+	m_head.store(head + sizeof(len) + _n,boost::memory_order_release);
+	return true;
+}
+
+
+bool async_logger::ring::pop(std::ostream& _strm)
+{
+	size_type tail = m_tail.load(boost::memory_order_relaxed);
+	size_type head = m_head.load(boost::memory_order_acquire);
+	if (tail == head) return false;
+
+	// write every record present, at most two pieces of the ring, then release them all at once
+	while (tail != head)
+	{
+		length_type len;
+		get(tail,reinterpret_cast<char*>(&len),sizeof(len));
+		tail += sizeof(len);
+
+		size_type i = tail & m_mask,n = std::min<size_type>(len,m_data.size() - i);
+		_strm.write(&m_data[i],n);
+		if (n < len) _strm.write(&m_data[0],len - n);
+		tail += len;
+	}
+
+	m_tail.store(tail,boost::memory_order_release);
+	return true;
+}
+
+
+
 } // namespace fbox
 
@@ -12,6 +12,7 @@
 #include "main.h"
 #include "soft_ptr.h"
 #include <boost/thread/detail/singleton.hpp>
+#include <boost/thread/mutex.hpp>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -56,6 +57,15 @@ public:
 	//! Report message level
 	level_type message_level() const { return m_temp_lv; }
 
+	//! True if messages at level _lv are written
+	bool is_enabled(level_type _lv) const { return _lv >= m_lv; }
+
+	//! Lock held by FBOX_LOG while it writes a message, so threads can share the logger through it
+	boost::mutex& mutex() { return m_mutex; }
+
+	//! Output stream, for writing whole messages under mutex()
+	std::ostream& stream() { return *mp_stream; }
+
 	//! Output operation
 	template<typename _type>
 	logger& operator<< (const _type& _str)
@@ -83,15 +93,16 @@ private:
 	level_type m_lv,m_perm_lv,m_temp_lv;
 	flex_ptr<std::ostream> mp_stream;
 	bool m_head;
+	boost::mutex m_mutex;
 };
 
 
+//! Write a message at level _lv. The message levels of the logger are left alone, so threads can log concurrently.
 #define FBOX_LOG(_lv,_msg) { \
-fbox::logger& __logger__( boost::detail::thread::singleton<fbox::logger>::instance() ); \
-	fbox::logger::level_type __old_lv__ = __logger__.message_level(); \
-	__logger__.set_message_level(_lv); \
-	__logger__ << _msg << std::endl; \
-	__logger__.set_message_level(__old_lv__); }
+	fbox::logger& __logger__( boost::detail::thread::singleton<fbox::logger>::instance() ); \
+	if (__logger__.is_enabled(_lv)) { \
+		boost::mutex::scoped_lock __lock__(__logger__.mutex()); \
+		__logger__.stream() << _msg << std::endl; } }
 
 
 #ifdef FBOX_DEBUG
@@ -116,6 +116,64 @@ inline bool is_less(double _v1,double _v2,double _tol=TINY)
 }
 
 
+//! Standard normal density
+inline double normal_pdf(double _x)
+{
+	return 0.398942280401432678 * std::exp(-0.5 * _x * _x);
+}
+
+
+//! Standard normal cumulative distribution to double precision. Hart's algorithm 5666 as given by G. West,
+//! "Better approximations to cumulative normal functions" (2005). Inline so that batch loops can use it.
+inline double normal_cdf(double _x)
+{
+	double x = std::fabs(_x);
+	double c;
+
+	if (x > 37.0) 
+	{
+		c = 0.0;
+	}
+	else if (x < 7.07106781186547)
+	{
+		double n = 3.52624965998911e-02;
+		n = n * x + 0.700383064443688;
+		n = n * x + 6.37396220353165;
+		n = n * x + 33.912866078383;
+		n = n * x + 112.079291497871;
+		n = n * x + 221.213596169931;
+		n = n * x + 220.206867912376;
+
+		double d = 8.83883476483184e-02;
+		d = d * x + 1.75566716318264;
+		d = d * x + 16.064177579207;
+		d = d * x + 86.7807322029461;
+		d = d * x + 296.564248779674;
+		d = d * x + 637.333633378831;
+		d = d * x + 793.826512519948;
+		d = d * x + 440.413735824752;
+
+		c = std::exp(-0.5 * x * x) * n / d;
+	}
+	else
+	{
+		double d = x + 0.65;
+		d = x + 4.0 / d;
+		d = x + 3.0 / d;
+		d = x + 2.0 / d;
+		d = x + 1.0 / d;
+		c = std::exp(-0.5 * x * x) / d / 2.5066282746310002;
+	}
+
+	return _x > 0.0? 1.0 - c : c;
+}
+
+
+//! Batch standard normal cumulative distribution. Same algorithm as normal_cdf(), written without branches
+//! or library calls so that the loop vectorises; results agree with it to a few units in the last place.
+void normal_cdf(const double* _x,double* _y,size_type _n);
+
+
 //! Find element in a sorted vector.
 template<
 	typename _container,	//!< Container type. Must support operator[]  and size() operations
@@ -124,28 +182,45 @@ int sorted_find(
 	const _container& v,	//!< Vector to search in
 	const _element& y)		//!< Value to find
 {
-	int _x;
+	int n(v.size());
 	int x0(0);
-	int x1(v.size()-1);
-
-	_element _y;
-	_element y0(v[x0]);
-	_element y1(v[x1]);
 
-	if (y < y0) return -1;
-	if (y >= y1) return x1;
+	if (y < v[x0]) return -1;
 
-	while( x1 - x0 > 1) {
-		_x = (x0 + x1) >> 1;
-		_y = v[_x];
-		if ( y < _y ) x1=_x, y1=_y;
-		else x0=_x, y0=_y;
+	// halve the range without branching on the comparison, so that it compiles to a conditional move
+	while (n > 1) {
+		int h = n >> 1;
+		x0 = (y < v[x0 + h])? x0 : x0 + h;
+		n -= h;
 	}
 
 	return x0;
 }	
 
 
+//! Find element in a sorted vector, starting from the result of a previous search. Searches at increasing
+//! points walk forward a few elements from the hint, anything else falls back to the full search.
+template<
+	typename _container,	//!< Container type. Must support operator[]  and size() operations
+	typename _element>		//!< Element type
+int sorted_find(
+	const _container& v,	//!< Vector to search in
+	const _element& y,		//!< Value to find
+	int& _hint)				//!< Previous result on input, result of this search on output
+{
+	int n(v.size());
+	int x0(_hint);
+
+	if (x0 >= 0 && x0 < n && !(y < v[x0]))
+	{
+		for(int k = 0; k < 4; ++k, ++x0)
+			if (x0 + 1 == n || y < v[x0 + 1]) return _hint = x0;
+	}
+
+	return _hint = sorted_find(v,y);
+}
+
+
 //! Construct an histogram of std::vector data
 void histogram(
 	const std::vector<double>& bins,	//!< Upper end of each bucket
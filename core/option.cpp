@@ -10,12 +10,54 @@
 #include "main.h"
 #include "math.h"
 #include "error.h"
-#include <boost/math/distributions/normal.hpp>
+#include "option.h"
+#include <algorithm>
 
 
 namespace fbox {
 namespace finance {
 
+//! +1 for calls and -1 for puts
+inline double option_sign(char _call_put)
+{
+	switch (_call_put)
+	{
+		case 'C': case 'c': return 1.0;
+		case 'P': case 'p': return -1.0;
+		default: throw error("Invalid option type (c/p)");
+	}
+}
+
+
+//! Black-Scholes price given the option sign
+inline double black_scholes_price(double _w,double _strike,double _maturity,double _forward,double _volatility,double _discount_factor)
+{
+	if (_volatility * _maturity < fbox::math::TINY)
+		return _discount_factor * std::max(_w * (_forward - _strike),0.);
+
+	double st = _volatility * std::sqrt(_maturity);
+	double d1 = std::log(_forward / _strike) / st + st / 2.;
+	double d2 = d1 - st;
+
+	return _w * _discount_factor * ( _forward * math::normal_cdf(_w * d1) - _strike * math::normal_cdf(_w * d2) );
+}
+
+
+//! Normal Black-Scholes price given the option sign
+inline double normal_black_scholes_price(double _w,double _strike,double _maturity,double _forward,double _volatility,double _discount_factor)
+{
+	if (_volatility * _maturity < fbox::math::TINY)
+		return _discount_factor * std::max(_w * (_forward - _strike),0.);
+
+	double fk = _forward - _strike;
+	double st = _volatility * std::sqrt(_maturity);
+	double fkst = fk / st;
+
+	double c = fk * math::normal_cdf(fkst) + st * math::normal_pdf(fkst);
+	return _discount_factor * (_w > 0.? c : c - fk);
+}
+
+
 double option_intrinsic(
 	char _call_put,
 	double _strike,
@@ -40,59 +82,174 @@ double black_scholes(
 	double _volatility,
 	double _discount_factor)
 {
-	if (_volatility * _maturity < fbox::math::TINY)
-		option_intrinsic(_call_put,_strike,_forward,_discount_factor);
+	return black_scholes_price(option_sign(_call_put),_strike,_maturity,_forward,_volatility,_discount_factor);
+}
 
-	using boost::math::normal;
-	normal s;
 
-	double tt = std::sqrt(_maturity);
-	double d1 = (std::log(_forward / _strike) + _volatility * _volatility * _maturity  / 2.) / (_volatility * tt);
-	double d2 = d1 - _volatility * tt;
+double normal_black_scholes(
+	char _call_put,
+	double _strike,
+	double _maturity,
+	double _forward,
+	double _volatility,
+	double _discount_factor)
+{
+	return normal_black_scholes_price(option_sign(_call_put),_strike,_maturity,_forward,_volatility,_discount_factor);
+}
 
-	switch (_call_put)
+
+void black_scholes(
+	char _call_put,
+	const double* _strike,
+	const double* _maturity,
+	const double* _forward,
+	const double* _volatility,
+	const double* _discount_factor,
+	double* _out,
+	size_type _n)
+{
+	double w = option_sign(_call_put);
+
+	// in blocks: d1 and d2 with the library log and sqrt, then the vectorised batch CDF on both
+	const size_type block = 128;
+	double d[2 * block],n[2 * block];
+
+	for(size_type k = 0; k < _n; k += block)
 	{
-		case 'C': case 'c':
-		return ( _discount_factor * ( _forward * cdf(s,d1) - _strike * cdf(s,d2) ) );
+		size_type m = std::min(block,_n - k);
+		const double* x = _strike + k;
+		const double* t = _maturity + k;
+		const double* f = _forward + k;
+		const double* v = _volatility + k;
+		const double* df = _discount_factor + k;
+
+		for(size_type j = 0; j < m; ++j)
+		{
+			double st = v[j] * std::sqrt(t[j]);
+			double d1 = std::log(f[j] / x[j]) / st + st / 2.;
+			d[j] = w * d1;
+			d[m + j] = w * (d1 - st);
+		}
+
+		math::normal_cdf(d,n,2 * m);
+
+		for(size_type j = 0; j < m; ++j)
+		{
+			_out[k + j] = v[j] * t[j] < fbox::math::TINY?
+				df[j] * std::max(w * (f[j] - x[j]),0.) : w * df[j] * (f[j] * n[j] - x[j] * n[m + j]);
+		}
+	}
+}
 
-		case 'P': case 'p':
-		return ( _discount_factor * ( -_forward * cdf(s,-d1) + _strike * cdf(s,-d2) ) );
 
-		default:
-		throw error("Invalid option type (c/p)");
+void normal_black_scholes(
+	char _call_put,
+	const double* _strike,
+	const double* _maturity,
+	const double* _forward,
+	const double* _volatility,
+	const double* _discount_factor,
+	double* _out,
+	size_type _n)
+{
+	double w = option_sign(_call_put);
+
+	const size_type block = 256;
+	double st[block],d[block],n[block];
+
+	for(size_type k = 0; k < _n; k += block)
+	{
+		size_type m = std::min(block,_n - k);
+		const double* x = _strike + k;
+		const double* t = _maturity + k;
+		const double* f = _forward + k;
+		const double* v = _volatility + k;
+		const double* df = _discount_factor + k;
+
+		for(size_type j = 0; j < m; ++j)
+		{
+			st[j] = v[j] * std::sqrt(t[j]);
+			d[j] = (f[j] - x[j]) / st[j];
+		}
+
+		math::normal_cdf(d,n,m);
+
+		for(size_type j = 0; j < m; ++j)
+		{
+			double fk = f[j] - x[j];
+			double c = fk * n[j] + st[j] * math::normal_pdf(d[j]);
+			_out[k + j] = v[j] * t[j] < fbox::math::TINY?
+				df[j] * std::max(w * fk,0.) : df[j] * (w > 0.? c : c - fk);
+		}
 	}
 }
 
 
-double normal_black_scholes(
+double implied_volatility(
 	char _call_put,
+	double _price,
 	double _strike,
 	double _maturity,
 	double _forward,
-	double _volatility,
-	double _discount_factor)
+	double _discount_factor,
+	double _tolerance)
 {
-	if (_volatility * _maturity < fbox::math::TINY)
-		option_intrinsic(_call_put,_strike,_forward,_discount_factor);
+	double w = option_sign(_call_put);
+	double tol = _tolerance * _discount_factor * _forward;
+	double lower = _discount_factor * std::max(w * (_forward - _strike),0.);
+	double upper = _discount_factor * (w > 0.? _forward : _strike);
 
-	using boost::math::normal;
-	normal s;
+	if (_maturity <= 0. || _price < lower - tol || _price >= upper) throw error("Option price outside no-arbitrage bounds");
+	if (_price <= lower + tol) return 0.;
 
-	double fk = _forward - _strike;
-	double st = _volatility * std::sqrt(_maturity);
-	double fkst = fk / st;
+	// bracket the solution
+	double lo = 0.,hi = 1.;
+	while (black_scholes_price(w,_strike,_maturity,_forward,hi,_discount_factor) < _price)
+	{
+		lo = hi;
+		hi *= 2.;
+		if (hi > 1e3) throw error("Implied volatility did not converge");
+	}
 
-	double c = fk * cdf(s,fkst) + st * pdf(s,fkst);
-	
-	switch (_call_put)
+	// Newton steps, falling back to bisection whenever they leave the bracket
+	double tt = std::sqrt(_maturity);
+	double v = std::min(std::max(std::sqrt(2. * std::fabs(std::log(_forward / _strike)) / _maturity),0.1),hi);
+	if (v <= lo) v = (lo + hi) / 2.;
+
+	for(int i = 0; i < 100; ++i)
 	{
-		case 'C': case 'c': return _discount_factor * c;
-		case 'P': case 'p': return _discount_factor * (c - _forward + _strike);
-		default: throw error("Invalid option type (c/p)");
+		double diff = black_scholes_price(w,_strike,_maturity,_forward,v,_discount_factor) - _price;
+		if (std::fabs(diff) < tol) return v;
+
+		if (diff > 0.) hi = v;
+		else lo = v;
+
+		double d1 = std::log(_forward / _strike) / (v * tt) + v * tt / 2.;
+		double vega = _discount_factor * _forward * math::normal_pdf(d1) * tt;
+
+		double vn = v - diff / vega;
+		v = (vn > lo && vn < hi)? vn : (lo + hi) / 2.;
 	}
+
+	throw error("Implied volatility did not converge");
+}
+
+
+void implied_volatility(
+	char _call_put,
+	const double* _price,
+	const double* _strike,
+	const double* _maturity,
+	const double* _forward,
+	const double* _discount_factor,
+	double* _out,
+	size_type _n,
+	double _tolerance)
+{
+	for(size_type i = 0; i < _n; ++i) 
+		_out[i] = implied_volatility(_call_put,_price[i],_strike[i],_maturity[i],_forward[i],_discount_factor[i],_tolerance);
 }
 
 
 } // namespace finance
 } // namespace fbox
-
@@ -44,6 +44,57 @@ double normal_black_scholes(
 	double _discount_factor=1.);	//!< Discount factor
 
 
+//! Black-Scholes prices of _n options of the same type, through the vectorised batch normal_cdf().
+//! Results agree with the single option formula to a few units in the last place.
+void black_scholes(
+	char _call_put,					//!< Determin if options are puts ('p') or calls ('c')
+	const double* _strike,			//!< Option strikes
+	const double* _maturity,		//!< Option maturities in years
+	const double* _forward,			//!< Forward values of underlying
+	const double* _volatility,		//!< Volatilities of the forward
+	const double* _discount_factor,	//!< Discount factors
+	double* _out,					//!< Option prices
+	size_type _n);					//!< Number of options
+
+
+//! Normal Black-Scholes prices of _n options of the same type, through the vectorised batch normal_cdf().
+//! Results agree with the single option formula to a few units in the last place.
+void normal_black_scholes(
+	char _call_put,					//!< Determin if options are puts ('p') or calls ('c')
+	const double* _strike,			//!< Option strikes
+	const double* _maturity,		//!< Option maturities in years
+	const double* _forward,			//!< Forward values of underlying
+	const double* _volatility,		//!< Volatilities of the forward
+	const double* _discount_factor,	//!< Discount factors
+	double* _out,					//!< Option prices
+	size_type _n);					//!< Number of options
+
+
+//! Black-Scholes implied volatility by safeguarded Newton iteration. Throws if the price is outside the 
+//! no-arbitrage bounds or the solver does not converge.
+double implied_volatility(
+	char _call_put,					//!< Determin if option is a put ('p') or call ('c')
+	double _price,					//!< Option price
+	double _strike,					//!< Option strike
+	double _maturity,				//!< Option maturity in years
+	double _forward,				//!< Forward value of underlying
+	double _discount_factor=1.,		//!< Discount factor
+	double _tolerance=1e-10);		//!< Price tolerance, relative to the discounted forward
+
+
+//! Implied volatilities of _n options of the same type
+void implied_volatility(
+	char _call_put,					//!< Determin if options are puts ('p') or calls ('c')
+	const double* _price,			//!< Option prices
+	const double* _strike,			//!< Option strikes
+	const double* _maturity,		//!< Option maturities in years
+	const double* _forward,			//!< Forward values of underlying
+	const double* _discount_factor,	//!< Discount factors
+	double* _out,					//!< Implied volatilities
+	size_type _n,					//!< Number of options
+	double _tolerance=1e-10);		//!< Price tolerance, relative to the discounted forward
+
+
 } // namespace finance
 } // namespace fbox
 
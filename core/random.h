@@ -8,6 +8,7 @@
 	Random number generators
 */
 
+#include <cmath>
 #include "main.h"
 #include "MersenneTwister.h"
 
@@ -40,6 +41,9 @@ class FBOX_DLL mersenne_twister
 public:
 	virtual double operator() () { return MTRand::rand(); }
 
+	//! Next number in sequence, excluding 0 and 1 (uses the same draw as operator())
+	double open() { return MTRand::randDblExc(); }
+
 	virtual void seed(unsigned long seed) { MTRand::seed(seed); }
 
 	virtual void save() { MTRand::save(m_save_array); }
@@ -50,6 +54,139 @@ private:
 };
 
 
+//! Stirling series remainder ln(k!) - [(k+1/2) ln(k+1) - (k+1) + ln(2 pi)/2]. Tabulated for k < 10.
+inline double stirling_tail(unsigned long _k)
+{
+	static const double table[10] = {
+		0.08106146679532726,0.04134069595540929,0.02767792568499834,0.02079067210376509,0.01664469118982119,
+		0.01387612882307075,0.01189670994589177,0.01041126526197209,0.009255462182712733,0.008330563433362871 };
+
+	if (_k < 10) return table[_k];
+	double k1 = _k + 1.0,k1sq = k1 * k1;
+	return (1.0 / 12.0 - (1.0 / 360.0 - 1.0 / 1260.0 / k1sq) / k1sq) / k1;
+}
+
+
+//! Exact binomial deviate with _n trials and success probability _p
+/*!
+	_u must return uniform deviates in (0,1) when called with no arguments. Small means (n.min(p,1-p) < 10)
+	use inversion from a single uniform, larger ones use Hormann's transformed rejection with squeeze (BTRS),
+	which accepts about nine draws in ten. The expected cost is bounded independently of _n and _p. A
+	uniform of 1 still terminates, at the point where the inverted mass underflows.
+*/
+template<typename _uniform>
+unsigned long binomial_deviate(unsigned long _n,double _p,_uniform& _u)
+{
+	if (_n == 0 || _p <= 0.0) return 0;
+	if (_p >= 1.0) return _n;
+	if (_p > 0.5) return _n - binomial_deviate(_n,1.0 - _p,_u);
+
+	const double q = 1.0 - _p;
+
+	if (_n * _p < 10.0)
+	{
+		// walk the distribution function, f(k+1) = f(k) (n-k)/(k+1) p/q
+		const double s = _p / q,a = (_n + 1.0) * s;
+		double f = std::pow(q,double(_n)),u = _u();
+		unsigned long k = 0;
+
+		// stop if the remaining mass is lost to rounding, as it is when u is 1
+		while (u > f && f > 0.0 && k < _n)
+		{
+			u -= f;
+			++k;
+			f *= a / k - s;
+		}
+
+		return k;
+	}
+
+	const double n = _n;
+	const double spq = std::sqrt(n * _p * q);
+	const double b = 1.15 + 2.53 * spq;
+	const double a = -0.0873 + 0.0248 * b + 0.01 * _p;
+	const double c = n * _p + 0.5;
+	const double vr = 0.92 - 4.2 / b;
+	const double r = _p / q;
+	const double alpha = (2.83 + 5.1 / b) * spq;
+	const double m = std::floor((n + 1.0) * _p);
+	const double h = (m + 0.5) * std::log((m + 1.0) / (r * (n - m + 1.0)))
+		+ stirling_tail((unsigned long)m) + stirling_tail((unsigned long)(n - m));
+
+	for (;;)
+	{
+		double u = _u() - 0.5;
+		double v = _u();
+		double us = 0.5 - std::fabs(u);
+		double k = std::floor((2.0 * a / us + b) * u + c);
+
+		if (k < 0.0 || k > n) continue;
+		if (us >= 0.07 && v <= vr) return (unsigned long)k;
+
+		v = std::log(v * alpha / (a / (us * us) + b));
+		if (v <= h + (n + 1.0) * std::log((n - m + 1.0) / (n - k + 1.0))
+			+ (k + 0.5) * std::log(r * (n - k + 1.0) / (k + 1.0))
+			- stirling_tail((unsigned long)k) - stirling_tail((unsigned long)(n - k)))
+			return (unsigned long)k;
+	}
+}
+
+
+//! Exact Poisson deviate with mean _mean
+/*!
+	_u must return uniform deviates in (0,1) when called with no arguments. Means below 10 are sampled by
+	inversion from a single uniform, larger ones with Hormann's transformed rejection with squeeze (PTRS),
+	which needs about 2.2 uniforms per deviate whatever the mean.
+*/
+template<typename _uniform>
+unsigned long poisson_deviate(double _mean,_uniform& _u)
+{
+	if (_mean <= 0.0) return 0;
+
+	if (_mean < 10.0)
+	{
+		double f = std::exp(-_mean),u = _u();
+		unsigned long k = 0;
+
+		// stop if the remaining mass is lost to rounding
+		while (u > f && f > 0.0)
+		{
+			u -= f;
+			++k;
+			f *= _mean / k;
+		}
+
+		return k;
+	}
+
+	const double slam = std::sqrt(_mean);
+	const double loglam = std::log(_mean);
+	const double b = 0.931 + 2.53 * slam;
+	const double a = -0.059 + 0.02483 * b;
+	const double lnalpha = std::log(1.1239 + 1.1328 / (b - 3.4));
+	const double vr = 0.9277 - 3.6224 / (b - 2.0);
+	const double ln2pi = 1.8378770664093453;
+
+	for (;;)
+	{
+		double u = _u() - 0.5;
+		double v = _u();
+		double us = 0.5 - std::fabs(u);
+		double k = std::floor((2.0 * a / us + b) * u + _mean + 0.43);
+
+		if (us >= 0.07 && v <= vr) return (unsigned long)k;
+		if (k < 0.0 || (us < 0.013 && v > us)) continue;
+
+		// ln(k!) from Stirling's series
+		double lnkf = (k + 0.5) * std::log(k + 1.0) - (k + 1.0) + 0.5 * ln2pi + stirling_tail((unsigned long)k);
+		if (std::log(v) + lnalpha - std::log(a / (us * us) + b) <= -_mean + k * loglam - lnkf)
+			return (unsigned long)k;
+	}
+}
+
+
+
+
 
 } // namespace math
 } // namespace fbox
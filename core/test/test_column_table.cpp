@@ -0,0 +1,176 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Tests of column tables and their loaders
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/cstdint.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "../column_table.h"
+#include "../line.h"
+#include "../random.h"
+
+
+BOOST_AUTO_TEST_CASE(test_parse_double)
+{
+	using namespace fbox;
+
+	const char* valid[] = { "0", "-1", "+2.5", "  3.25 ", "1e3", "1.5E-7", ".5", "5.", "0.1", "123456789012345678901234",
+		"1e-320", "1.7976931348623157e308", "0.30000000000000004", "inf", "-nan" };
+	const char* invalid[] = { "", " ", "-", "1x", "1e", "1.2.3", "e5", "1 2", "abc" };
+
+	for(size_type i = 0; i < sizeof(valid) / sizeof(valid[0]); ++i)
+	{
+		std::string s(valid[i]);
+		double v;
+		BOOST_REQUIRE(parse_double(s.data(),s.data() + s.size(),v));
+
+		double expected = std::strtod(s.c_str(),0);
+		if (expected == expected)
+			BOOST_CHECK_EQUAL(expected,v);
+		else
+			BOOST_CHECK(v != v);
+	}
+
+	for(size_type i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i)
+	{
+		std::string s(invalid[i]);
+		double v;
+		BOOST_CHECK_MESSAGE(!parse_double(s.data(),s.data() + s.size(),v),"parsed '" << s << "'");
+	}
+
+	// correctly rounded, as strtod
+	math::mersenne_twister rnd;
+	rnd.seed(1234);
+	char buf[64];
+	for(int i = 0; i < 100000; ++i)
+	{
+		std::sprintf(buf,"%.*g",1 + i % 17,(rnd() - 0.5) * std::pow(10.0,i % 40 - 20));
+		double v;
+		BOOST_REQUIRE(parse_double(buf,buf + std::strlen(buf),v));
+		BOOST_REQUIRE_EQUAL(std::strtod(buf,0),v);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(test_load_csv)
+{
+	using namespace fbox;
+
+	std::string text(
+		"curve, tenor, rate\n"
+		"EUR,1,0.01\r\n"
+		"EUR,2,0.015\n"
+		"\n"
+		"USD,1,0.02\n"
+		"USD,5,\n"
+		"EUR,3,0.02\n");
+
+	column_table t;
+	load_csv(text.data(),text.data() + text.size(),t);
+
+	BOOST_CHECK_EQUAL(3,t.columns());
+	BOOST_CHECK_EQUAL(5,t.rows());
+	BOOST_CHECK_EQUAL(2,t.index("rate"));
+	BOOST_CHECK(!t.is_numeric(0));
+	BOOST_CHECK(t.is_numeric(1));
+	BOOST_CHECK_EQUAL("USD",t.text(0)[2]);
+	BOOST_CHECK_EQUAL(0.015,t.values(2)[1]);
+	BOOST_CHECK(t.values(2)[3] != t.values(2)[3]); // empty field
+
+	std::map<std::string,math::linear_line> curves;
+	t.get_lines(0,1,2,curves);
+	BOOST_CHECK_EQUAL(2,curves.size());
+	BOOST_CHECK_EQUAL(3,curves["EUR"].table().size());
+	BOOST_CHECK_CLOSE(0.0175,curves["EUR"](2.5),1e-10);
+
+	math::linear_line l;
+	t.get_line(1,2,l,0,2);
+	BOOST_CHECK_CLOSE(0.0125,l(1.5),1e-10);
+
+	BOOST_CHECK_THROW(t.values(0),fbox::error);
+	BOOST_CHECK_THROW(t.index("spread"),fbox::error);
+
+	std::string bad("a,b\n1,2\n3\n");
+	BOOST_CHECK_THROW(load_csv(bad.data(),bad.data() + bad.size(),t),fbox::error);
+
+	bad = "1,2\n3,x\n";
+	BOOST_CHECK_THROW(load_csv(bad.data(),bad.data() + bad.size(),t,',',false),fbox::error);
+}
+
+
+BOOST_AUTO_TEST_CASE(test_load_csv_parallel)
+{
+	using namespace fbox;
+
+	std::ostringstream csv;
+	csv.precision(17);
+	csv << "id;x;y\n";
+	for(int i = 0; i < 100000; ++i) csv << "curve" << i / 20 << ';' << i % 20 << ';' << std::sqrt(i + 0.5) << '\n';
+	std::string text = csv.str();
+
+	column_table t1,t4;
+	load_csv(text.data(),text.data() + text.size(),t1,';',true,1);
+	load_csv(text.data(),text.data() + text.size(),t4,';',true,4);
+
+	BOOST_REQUIRE_EQUAL(100000,t1.rows());
+	BOOST_REQUIRE_EQUAL(t1.rows(),t4.rows());
+	BOOST_CHECK(t1.text(0) == t4.text(0));
+	BOOST_CHECK(t1.values(1) == t4.values(1));
+	BOOST_CHECK(t1.values(2) == t4.values(2));
+	BOOST_CHECK_EQUAL(std::sqrt(99999.5),t4.values(2).back());
+
+	// binary round trip through files
+	std::string csv_name = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	std::string bin_name = csv_name + ".bin";
+	{
+		std::ofstream f(csv_name.c_str(),std::ios::binary);
+		f << text;
+	}
+
+	column_table tf,tb;
+	load_csv(csv_name,tf,';');
+	save_binary(bin_name,tf);
+	load_binary(bin_name,tb);
+
+	BOOST_CHECK_EQUAL(tf.rows(),tb.rows());
+	BOOST_CHECK_EQUAL("y",tb.name(2));
+	BOOST_CHECK(t1.text(0) == tb.text(0));
+	BOOST_CHECK(t1.values(2) == tb.values(2));
+
+	BOOST_CHECK_THROW(load_binary(csv_name,tb),fbox::error);
+
+	// row counts in a corrupt header are rejected before anything is allocated for them
+	std::string bin;
+	{
+		std::ifstream f(bin_name.c_str(),std::ios::binary);
+		std::ostringstream o;
+		o << f.rdbuf();
+		bin = o.str();
+	}
+	const boost::uint64_t bad_rows[] = { 200000,0x20000001,boost::uint64_t(1) << 40 };
+	for(int k = 0; k < 3; ++k)
+	{
+		std::memcpy(&bin[8],&bad_rows[k],sizeof(boost::uint64_t));
+		{
+			std::ofstream f(bin_name.c_str(),std::ios::binary);
+			f << bin;
+		}
+		BOOST_CHECK_THROW(load_binary(bin_name,tb),fbox::error);
+		BOOST_CHECK_EQUAL(0,tb.rows());
+		BOOST_CHECK_EQUAL(0,tb.columns());
+	}
+
+	boost::filesystem::remove(csv_name);
+	boost::filesystem::remove(bin_name);
+}
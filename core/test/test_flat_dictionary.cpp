@@ -0,0 +1,154 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Tests of flat dictionaries
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_const.hpp>
+#include "../flat_dictionary.h"
+
+
+BOOST_AUTO_TEST_CASE(test_flat_dictionary)
+{
+	using namespace fbox;
+
+	dictionary_key notional("notional");
+	BOOST_CHECK(notional == dictionary_key(std::string("notional")));
+	BOOST_CHECK(&notional.str() == &dictionary_key("notional").str()); // interned
+	BOOST_CHECK(notional != dictionary_key("strike"));
+
+	flat_dictionary trade;
+	trade.insert(notional,1e6);
+	trade.insert("currency","EUR");
+	trade.insert("quantity",100);
+
+	flat_dictionary leg;
+	leg.insert("rate",0.02);
+	trade.insert("leg",leg);
+
+	BOOST_CHECK_EQUAL(4,trade.size());
+	BOOST_CHECK(trade.contains("currency"));
+	BOOST_CHECK(trade.contains(std::string("quantity")));
+	BOOST_CHECK(!trade.contains("maturity"));
+	BOOST_CHECK(!trade.find("maturity"));
+	BOOST_CHECK_EQUAL(1e6,trade[notional].as_double());
+	BOOST_CHECK_EQUAL("EUR",trade["currency"].as_string());
+	BOOST_CHECK_EQUAL(100,trade["quantity"].as_int());
+	BOOST_CHECK_EQUAL(0.02,trade["leg"].as_dictionary()["rate"].as_double());
+
+	BOOST_CHECK_THROW(trade["maturity"],flat_dictionary::error);
+	BOOST_CHECK_THROW(trade.insert("quantity",200),flat_dictionary::error);
+	trade.insert("quantity",200,true);
+	BOOST_CHECK_EQUAL(200,trade["quantity"].as_int());
+	BOOST_CHECK_EQUAL(4,trade.size());
+
+	// insertion order
+	flat_dictionary::const_iterator itr = trade.begin();
+	BOOST_CHECK_EQUAL("notional",itr->first.str());
+	BOOST_CHECK_EQUAL("leg",(++++++itr)->first.str());
+
+	// nested dictionaries are copied on write
+	flat_dictionary copy(trade);
+	copy["leg"].as_dictionary().insert("spread",0.001);
+	BOOST_CHECK(copy["leg"].as_dictionary().contains("spread"));
+	BOOST_CHECK(!static_cast<const flat_dictionary&>(trade)["leg"].as_dictionary().contains("spread"));
+
+	// a dictionary inserted by pointer is shared with the caller, and unshared before being modified
+	boost::shared_ptr<flat_dictionary> fee(new flat_dictionary);
+	fee->insert("amount",10.0);
+	copy.insert("fee",flat_dictionary::value_type(flat_dictionary::dictionary_ptr(fee)));
+	copy["fee"].as_dictionary()["amount"].as_double() = 20.0;
+	BOOST_CHECK_EQUAL(10.0,(*fee)["amount"].as_double());
+	BOOST_CHECK_EQUAL(20.0,copy["fee"].as_dictionary()["amount"].as_double());
+
+	// mutable iteration and lookup can replace values but neither keys nor shared nested dictionaries
+	BOOST_STATIC_ASSERT(boost::is_const<flat_dictionary::entry_type::first_type>::value);
+	BOOST_STATIC_ASSERT(boost::is_const<flat_dictionary::dictionary_ptr::element_type>::value);
+	for(flat_dictionary::iterator itr = copy.begin(); itr != copy.end(); ++itr)
+		if (itr->first == dictionary_key("quantity")) itr->second = 300;
+	BOOST_CHECK_EQUAL(300,copy["quantity"].as_int());
+	BOOST_CHECK_EQUAL(200,trade["quantity"].as_int());
+
+	// assignment replaces the contents, and shares nested dictionaries like a copy
+	flat_dictionary assigned;
+	assigned.insert("x",1);
+	assigned = copy;
+	BOOST_CHECK_EQUAL(copy.size(),assigned.size());
+	BOOST_CHECK(!assigned.contains("x"));
+	BOOST_CHECK_EQUAL(300,assigned["quantity"].as_int());
+	assigned["leg"].as_dictionary().insert("margin",0.01);
+	BOOST_CHECK(!static_cast<const flat_dictionary&>(copy)["leg"].as_dictionary().contains("margin"));
+
+	// conversion
+	dictionary d = trade.to_dictionary();
+	BOOST_CHECK_EQUAL(0.02,d["leg"].as_dictionary()["rate"].as_double());
+	flat_dictionary back(d);
+	BOOST_CHECK_EQUAL(4,back.size());
+	BOOST_CHECK_EQUAL("EUR",back["currency"].as_string());
+
+	// growth, with every key still found
+	flat_dictionary big;
+	for(int i = 0; i < 1000; ++i)
+	{
+		std::ostringstream key;
+		key << "key" << i;
+		big.insert(key.str(),i);
+	}
+
+	bool found = true;
+	for(int i = 0; i < 1000; ++i)
+	{
+		std::ostringstream key;
+		key << "key" << i;
+		found = found && big[key.str()].as_int() == i;
+	}
+	BOOST_CHECK(found);
+}
+
+
+BOOST_AUTO_TEST_CASE(test_flat_dictionary_binary)
+{
+	using namespace fbox;
+
+	flat_dictionary portfolio;
+	for(int i = 0; i < 100; ++i)
+	{
+		flat_dictionary trade;
+		trade.insert("notional",1e6 * (i + 1));
+		trade.insert("currency",i % 2 ? "EUR" : "USD");
+		trade.insert("quantity",-i * 1000);
+
+		std::ostringstream id;
+		id << "trade" << i;
+		portfolio.insert(id.str(),trade);
+	}
+
+	std::stringstream buf;
+	portfolio.save(buf);
+
+	flat_dictionary loaded;
+	loaded.load(buf);
+
+	BOOST_REQUIRE_EQUAL(100,loaded.size());
+	const flat_dictionary& t = loaded["trade42"].as_dictionary();
+	BOOST_CHECK_EQUAL(43e6,t["notional"].as_double());
+	BOOST_CHECK_EQUAL("USD",t["currency"].as_string());
+	BOOST_CHECK_EQUAL(-42000,t["quantity"].as_int());
+
+	// keys are written once
+	std::ostringstream text;
+	text << portfolio;
+	BOOST_CHECK(buf.str().size() < text.str().size() / 2);
+
+	std::istringstream bad(buf.str().substr(0,buf.str().size() / 2));
+	BOOST_CHECK_THROW(loaded.load(bad),flat_dictionary::error);
+	BOOST_CHECK_EQUAL(100,loaded.size()); // unchanged
+
+	std::istringstream junk("not a dictionary");
+	BOOST_CHECK_THROW(loaded.load(junk),flat_dictionary::error);
+}
@@ -65,6 +65,35 @@ struct func6 : public func2, public task_handle<addx>
 };
 
 
+template<int _n>
+struct count : public declare_task<count<_n> >
+{
+	count() : n(0) {}
+	int n;
+};
+
+//! Functor with many handlers, as pricing functors tend to be
+struct counter
+:	public functor,
+	public task_handle<count<0> >,
+	public task_handle<count<1> >,
+	public task_handle<count<2> >,
+	public task_handle<count<3> >,
+	public task_handle<count<4> >,
+	public task_handle<count<5> >,
+	public task_handle<count<6> >,
+	public task_handle<count<7> >
+{
+	virtual bool task_impl(count<0>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<1>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<2>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<3>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<4>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<5>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<6>& _tsk) { ++_tsk.n; return true; }
+	virtual bool task_impl(count<7>& _tsk) { ++_tsk.n; return true; }
+};
+
 
 BOOST_AUTO_TEST_CASE(test_functor)
 {
@@ -135,3 +164,36 @@ BOOST_AUTO_TEST_CASE(test_functor)
 	BOOST_CHECK_EQUAL(s.b,2);
 	a.c = x.c = 0;
 }
+
+
+BOOST_AUTO_TEST_CASE(test_functor_dispatch)
+{
+	func1 f1;
+	func2 f2;
+	func3 f3;
+	BOOST_CHECK(f2.handle<swap>() != 0);
+	BOOST_CHECK(f1.handle<swap>() == 0);
+	BOOST_CHECK(f1.handle<swap>() == 0); // from the table
+	BOOST_CHECK(f3.handle<add>() == static_cast<task_handle<add>*>(&f3));
+
+	// copies made through a base type dispatch as the base type
+	func1 sliced(f3);
+	add a(1,2);
+	BOOST_CHECK(sliced.apply(a));
+	BOOST_CHECK_EQUAL(3,a.c);
+	BOOST_CHECK(f3.apply(a));
+	BOOST_CHECK_EQUAL(5,a.c);
+
+	const func2& cf2 = f2;
+	BOOST_CHECK(!cf2.apply(a)); // no const handler
+
+	// many handlers
+	counter c;
+	count<0> first;
+	count<7> last;
+	BOOST_CHECK(c.apply(first));
+	BOOST_CHECK(c.apply(last));
+	BOOST_CHECK(c.apply(last));
+	BOOST_CHECK_EQUAL(1,first.n);
+	BOOST_CHECK_EQUAL(2,last.n);
+}
@@ -117,3 +117,194 @@ BOOST_AUTO_TEST_CASE(test_cs_line)
 	BOOST_CHECK_CLOSE(5.0,l(+0.0),TINY);
 	BOOST_CHECK_CLOSE(4.25,l(+1.0),TINY);
 }
+
+
+BOOST_AUTO_TEST_CASE(test_hinted_lookup)
+{
+	using namespace fbox::math;
+
+	// long table with uneven spacing
+	linear_line lin;
+	cspline_line cs;
+	right_constant_line rc;
+	for(int i = 0; i < 100000; ++i) 
+	{
+		double x = i + 0.3 * (i % 3);
+		lin.add(x,std::sin(x / 1000.0));
+		cs.add(x,std::sin(x / 1000.0));
+		rc.add(x,std::sin(x / 1000.0));
+	}
+
+	// sequential and random queries must match the cold search exactly
+	int hint_lin = -1,hint_cs = -1,hint_rc = -1;
+	for(double x = -10.0; x < 100010.0; x += 0.7)
+	{
+		BOOST_REQUIRE_EQUAL(lin(x),lin(x,hint_lin));
+		BOOST_REQUIRE_EQUAL(cs(x),cs(x,hint_cs));
+		BOOST_REQUIRE_EQUAL(rc(x),rc(x,hint_rc));
+	}
+
+	for(int i = 0; i < 10000; ++i)
+	{
+		double x = (i * 7919) % 100003 - 1.3;
+		BOOST_REQUIRE_EQUAL(lin(x),lin(x,hint_lin));
+		BOOST_REQUIRE_EQUAL(cs(x),cs(x,hint_cs));
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(test_compiled_line)
+{
+	using namespace fbox::math;
+
+	cspline_line cs;
+	linear_line lin;
+	for(int i = 0; i <= 100; ++i) 
+	{
+		cs.add(i,std::sin(i / 10.0));
+		lin.add(i,i % 2);
+	}
+
+	// exact compilation matches the source everywhere
+	compiled_line<cubic_spline_interpolator,gauss_legendre10> c1(cs);
+	for(double x = -5.0; x < 105.0; x += 0.37) BOOST_REQUIRE_EQUAL(cs(x),c1(x));
+	BOOST_CHECK_CLOSE(cs.integral(1.0,90.0),c1.integral(1.0,90.0),TINY);
+
+	// splines are reproduced on grid intervals without a knot, and approximated on the others
+	compiled_line<cubic_spline_interpolator,gauss_legendre10> c2(cs,1000);
+	compiled_line<cubic_spline_interpolator,gauss_legendre10> c4(cs,250);
+	for(double x = 0.0; x < 100.0; x += 0.37) BOOST_REQUIRE_SMALL(cs(x) - c2(x),1e-12);
+	for(double x = 0.0; x < 100.0; x += 0.37) BOOST_REQUIRE_SMALL(cs(x) - c4(x),1e-6);
+	BOOST_CHECK_CLOSE(cs.integral(1.0,90.0),c4.integral(1.0,90.0),1e-6);
+
+	// and the original interpolator is used outside the table range
+	BOOST_CHECK_EQUAL(cs(-1.0),c2(-1.0));
+	BOOST_CHECK_EQUAL(cs(101.0),c2(101.0));
+	BOOST_CHECK_CLOSE(cs(100.0),c2(100.0),1e-12);
+
+	// linear lines with knots on the grid are reproduced exactly
+	compiled_line<linear_interpolator,gauss_legendre10> c3(lin,200);
+	for(double x = 0.0; x < 100.0; x += 0.37) BOOST_REQUIRE_SMALL(lin(x) - c3(x),1e-12);
+
+	linear_line empty;
+	BOOST_CHECK_THROW((compiled_line<linear_interpolator,gauss_legendre10>(empty)),fbox::error);
+}
+
+
+BOOST_AUTO_TEST_CASE(test_line_evaluate)
+{
+	using namespace fbox::math;
+
+	linear_line lin;
+	cspline_line cs;
+	left_constant_line lc;
+	for(int i = 0; i <= 50; ++i) 
+	{
+		lin.add(i,std::cos(i / 5.0));
+		cs.add(i,std::cos(i / 5.0));
+		lc.add(i,std::cos(i / 5.0));
+	}
+	compiled_line<linear_interpolator,gauss_legendre10> cl(lin,100);
+	flat_line fl(2.0);
+
+	// sorted input followed by unsorted input
+	std::vector<double> x,y(400);
+	for(int i = 0; i < 200; ++i) x.push_back(-2.0 + i * 0.27);
+	for(int i = 0; i < 200; ++i) x.push_back((i * 37) % 53 - 0.5);
+
+	const line* lines[] = { &lin, &cs, &lc, &cl, &fl };
+	for(int j = 0; j < 5; ++j)
+	{
+		lines[j]->evaluate(&x[0],&y[0],x.size());
+		for(size_t i = 0; i < x.size(); ++i) BOOST_REQUIRE_EQUAL(y[i],(*lines[j])(x[i]));
+	}
+}
+
+
+//! Exponential of linear interpolation, which is not piecewise polynomial
+struct exp_interpolator : public fbox::math::linear_interpolator
+{
+	exp_interpolator(const table_type& _table) : fbox::math::linear_interpolator(_table) {}
+
+	double operator() (double _x) const { return std::exp(linear_interpolator::operator()(_x)); }
+	double operator() (double _x,int& _hint) const { return std::exp(linear_interpolator::operator()(_x,_hint)); }
+	void evaluate(const double* _x,double* _y,fbox::size_type _n) const { for(fbox::size_type i = 0; i < _n; ++i) _y[i] = (*this)(_x[i]); }
+};
+
+
+BOOST_AUTO_TEST_CASE(test_line_integrals)
+{
+	using namespace fbox::math;
+
+	right_constant_line rc;
+	left_constant_line lc;
+	linear_line lin;
+	cspline_line cs;
+	for(int i = 0; i <= 10; ++i) 
+	{
+		double x = i * i * 0.5, y = (i % 3) - 1.0;
+		rc.add(x,y);
+		lc.add(x,y);
+		lin.add(x,y);
+		cs.add(x,y);
+	}
+
+	// piece-wise constant and linear integrals in closed form (knots at 0, 0.5, 2, 4.5, ..., 50)
+	BOOST_CHECK_CLOSE(rc.integral(0.0,4.5),-1.0 * 0.5 + 0.0 * 1.5 + 1.0 * 2.5,1e-10);
+	BOOST_CHECK_CLOSE(lc.integral(0.0,4.5),0.0 * 0.5 + 1.0 * 1.5 - 1.0 * 2.5,1e-10);
+	BOOST_CHECK_CLOSE(lin.integral(0.0,4.5),-0.5 * 0.5 + 0.5 * 1.5 + 0.0 * 2.5,1e-10);
+	BOOST_CHECK_CLOSE(lin.integral(-2.0,0.25),-2.0 - 0.75 * 0.25,1e-10);
+	BOOST_CHECK_CLOSE(lin.integral(48.0,52.0),(-2.0 / 9.5) / 2.0 * 2.0,1e-8);
+	BOOST_CHECK_CLOSE(lin.integral(4.5,0.0),-lin.integral(0.0,4.5),1e-10);
+
+	// spline and weighted integrals against fine quadrature
+	const line* lines[] = { &rc, &lc, &lin, &cs };
+	for(int j = 0; j < 4; ++j)
+	{
+		const line& l = *lines[j];
+		double x0 = -3.3, x1 = 57.1;
+		double v = 0.0, w = 0.0, h = (x1 - x0) / 200000;
+		for(int i = 0; i < 200000; ++i) 
+		{
+			double x = x0 + (i + 0.5) * h;
+			v += l(x) * h;
+			w += l(x) * cs(x) * h;
+		}
+
+		BOOST_CHECK_SMALL(l.integral(x0,x1) - v,1e-3);
+		BOOST_CHECK_SMALL(l.integral(x0,x1,cs) - w,1e-3);
+		BOOST_CHECK_SMALL(l.integral(7.1,7.2) - 0.1 * l(7.15),1e-3);
+	}
+
+	// compiled lines integrate exactly too
+	compiled_line<cubic_spline_interpolator,gauss_legendre10> cc(cs,5000);
+	BOOST_CHECK_CLOSE(cc.integral(-3.3,57.1),cs.integral(-3.3,57.1),1e-8);
+	BOOST_CHECK_CLOSE(cc.integral(-3.3,57.1,lin),cs.integral(-3.3,57.1,lin),1e-3);
+
+	// knots strictly inside the range only
+	std::vector<double> k;
+	BOOST_CHECK(lin.knots(0.5,12.5,k));
+	BOOST_REQUIRE_EQUAL(3,k.size());
+	BOOST_CHECK_EQUAL(2.0,k[0]);
+	BOOST_CHECK_EQUAL(8.0,k[2]);
+
+	k.clear();
+	compiled_line<linear_interpolator,gauss_legendre10> cg(lin,100); // grid step 0.5
+	BOOST_CHECK(cg.knots(-10.0,1.2,k));
+	BOOST_REQUIRE_EQUAL(3,k.size());
+	BOOST_CHECK_EQUAL(0.0,k[0]);
+	BOOST_CHECK_EQUAL(1.0,k[2]);
+	k.clear();
+	BOOST_CHECK(cg.knots(49.7,60.0,k));
+	BOOST_REQUIRE_EQUAL(1,k.size());
+	BOOST_CHECK_EQUAL(50.0,k[0]);
+	BOOST_CHECK(cg.knots(60.0,70.0,k));
+	BOOST_CHECK_EQUAL(1,k.size());
+
+	// other interpolators use the integrator
+	interpolated_line<exp_interpolator,gauss_legendre10> e;
+	e.add(0.0,0.0).add(1.0,1.0);
+	BOOST_CHECK(!e.knots(0.0,1.0,k));
+	BOOST_CHECK_CLOSE(e.integral(0.0,1.0),std::exp(1.0) - 1.0,1e-6);
+	BOOST_CHECK_CLOSE(e.integral(0.0,1.0,flat_line(2.0)),2.0 * (std::exp(1.0) - 1.0),1e-6);
+}
@@ -6,10 +6,18 @@
 	Test logger class
 */
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/test/unit_test.hpp>
 #include "../logger.h"
+#include "../async_logger.h"
 #include "../system.h"
+#include "../error.h"
 
 
 BOOST_AUTO_TEST_CASE(test_logger)
@@ -49,7 +57,7 @@ BOOST_AUTO_TEST_CASE(test_file_logger)
 {
 	using namespace fbox;
 
-	std::string flnm = "c:/local/tmp/fbox.log";
+	std::string flnm = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
 	logger::level_type lv = logger::WARNING;
 
 	logger* ptr = new logger(flnm);
@@ -59,4 +67,138 @@ BOOST_AUTO_TEST_CASE(test_file_logger)
 	(*ptr).set_trigger_level(logger::NOTE); // lower trigger level to NOTE
 	(*ptr) << logger::NOTE << "test4\n"; // now the NOTE level message will print
 	delete ptr;
+
+	std::ifstream f(flnm.c_str());
+	std::string o;
+	while (f >> o && o != "test2") ;
+	BOOST_CHECK_EQUAL(o,"test2");
+	f >> o;
+	BOOST_CHECK_EQUAL(o,"test4");
+	f.close();
+	boost::filesystem::remove(flnm);
+
+	// a log file that cannot be opened is reported
+	BOOST_CHECK_THROW(logger((boost::filesystem::path(flnm) / "fbox.log").string()),fbox::error);
+}
+
+
+static void async_log_records(fbox::async_logger* _l,int _thread,int _n)
+{
+	for(int i = 0; i < _n; ++i)
+	{
+		fbox::async_logger::record& r = _l->begin_record();
+		r << _thread << ' ' << i << '\n';
+		_l->end_record(r);
+	}
+}
+
+
+static void async_log(std::ostream& _s,int _threads,int _n,fbox::size_type _capacity)
+{
+	fbox::async_logger l(_s,false,fbox::logger::NOTE,_capacity);
+
+	boost::thread_group g;
+	for(int t = 0; t < _threads; ++t) g.create_thread(boost::bind(&async_log_records,&l,t,_n));
+	g.join_all();
+	l.flush();
+}
+
+
+BOOST_AUTO_TEST_CASE(test_async_logger)
+{
+	using namespace fbox;
+
+	std::stringstream s;
+	{
+		async_logger l(s,false);
+		BOOST_CHECK(!l.is_enabled(logger::NOTE));
+		BOOST_CHECK(l.is_enabled(logger::FATAL));
+
+		async_logger::record& r1 = l.begin_record();
+		r1 << "test1\n";
+		l.end_record(r1);
+		l.flush();
+		BOOST_CHECK_EQUAL(s.str(),"test1\n");
+
+		// records longer than the ring, less their length, are cut short
+		async_logger small(s,false,logger::WARNING,16);
+		async_logger::record& r = small.begin_record();
+		r << "0123456789abcdef\n";
+		small.end_record(r);
+
+	}
+	BOOST_CHECK_EQUAL(s.str(),"test1\n0123456789a\n");
+
+	// ring sizes are rounded up to a power of two: 20 becomes 32, which holds this record whole
+	std::stringstream o;
+	{
+		async_logger odd(o,false,logger::WARNING,20);
+		async_logger::record& r = odd.begin_record();
+		r << "0123456789abcdefghijklmn\n";
+		odd.end_record(r);
+	}
+	BOOST_CHECK_EQUAL(o.str(),"0123456789abcdefghijklmn\n");
+	BOOST_CHECK_THROW(async_logger(s,false,logger::WARNING,4),fbox::error);
+
+	// records from each thread arrive whole and in order, through rings that fill up
+	const int threads = 4,n = 20000;
+	std::stringstream m;
+	async_log(m,threads,n,256);
+
+	std::vector<int> next(threads,0);
+	int t,i,count = 0;
+	while (m >> t >> i)
+	{
+		BOOST_REQUIRE(t >= 0 && t < threads);
+		BOOST_CHECK_EQUAL(i,next[t]++);
+		++count;
+	}
+	BOOST_CHECK_EQUAL(count,threads * n);
+
+	// same through rings whose requested size is not a power of two
+	std::stringstream m2;
+	async_log(m2,threads,n,200);
+	std::fill(next.begin(),next.end(),0);
+	count = 0;
+	while (m2 >> t >> i)
+	{
+		BOOST_REQUIRE(t >= 0 && t < threads);
+		BOOST_CHECK_EQUAL(i,next[t]++);
+		++count;
+	}
+	BOOST_CHECK_EQUAL(count,threads * n);
+	BOOST_CHECK_THROW(async_logger(s,false,logger::WARNING,(1u << 31) + 1),fbox::error);
+}
+
+
+static void sync_log_records(int _thread,int _n)
+{
+	for(int i = 0; i < _n; ++i) FBOX_LOG(fbox::logger::FATAL,_thread << ' ' << i);
+}
+
+
+BOOST_AUTO_TEST_CASE(test_logger_threads)
+{
+	using namespace fbox;
+
+	// FBOX_LOG from several threads writes whole messages, in order per thread
+	const int threads = 4,n = 5000;
+	std::stringstream m;
+	logger& l = boost::detail::thread::singleton<logger>::instance();
+	l.set_output(m,false);
+
+	boost::thread_group g;
+	for(int t = 0; t < threads; ++t) g.create_thread(boost::bind(&sync_log_records,t,n));
+	g.join_all();
+	l.set_output(std::cerr,false);
+
+	std::vector<int> next(threads,0);
+	int t,i,count = 0;
+	while (m >> t >> i)
+	{
+		BOOST_REQUIRE(t >= 0 && t < threads);
+		BOOST_CHECK_EQUAL(i,next[t]++);
+		++count;
+	}
+	BOOST_CHECK_EQUAL(count,threads * n);
 }
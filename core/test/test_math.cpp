@@ -7,10 +7,17 @@
 */
 
 #include <iostream>
+#include <limits>
 #include <boost/test/unit_test.hpp>
 #include <boost/test/floating_point_comparison.hpp>
 #include "../math.h"
 #include "../option.h"
+#include "../error.h"
+#include "../random.h"
+#include <boost/math/distributions/normal.hpp>
+#include <boost/math/distributions/binomial.hpp>
+#include <boost/math/distributions/poisson.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
 
 
 BOOST_AUTO_TEST_CASE(test_round)
@@ -54,3 +61,204 @@ BOOST_AUTO_TEST_CASE(test_black_scholes)
 	BOOST_REQUIRE_SMALL(black_scholes(cp,x,t,50,1e-6,d),1e-2);
 	BOOST_CHECK_CLOSE(50.0,black_scholes(cp,x,t,100,1e-6,d),1e-5);
 }
+
+
+BOOST_AUTO_TEST_CASE(test_normal_cdf)
+{
+	using namespace fbox::math;
+
+	boost::math::normal s;
+	std::vector<double> x,y(2001);
+	for(int i = -1000; i <= 1000; ++i) x.push_back(i * 0.01);
+	normal_cdf(&x[0],&y[0],x.size());
+
+	for(size_t i = 0; i < x.size(); ++i)
+	{
+		BOOST_REQUIRE_SMALL(y[i] - cdf(s,x[i]),5e-14);
+		BOOST_REQUIRE_CLOSE(y[i],normal_cdf(x[i]),1e-12);
+		BOOST_REQUIRE_SMALL(normal_pdf(x[i]) - pdf(s,x[i]),1e-15);
+	}
+
+	// relative accuracy in the lower tail
+	for(double z = -8.0; z > -37.0; z -= 0.5) BOOST_CHECK_CLOSE(normal_cdf(z),cdf(s,z),1e-5);
+
+	// the batch version across the switch between ranges and the cut off, and at infinity
+	const double inf = std::numeric_limits<double>::infinity();
+	double z[] = { -inf,-40.0,-37.5,-37.0,-36.9,-20.0,-7.08,-7.07,-1e-300,0.0,7.07,7.08,36.9,37.0,37.5,inf };
+	double w[16];
+	normal_cdf(z,w,16);
+	for(int i = 0; i < 16; ++i) BOOST_CHECK_CLOSE(w[i],normal_cdf(z[i]),1e-12);
+
+	// NaN of either sign comes out as NaN, as from the scalar version
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	double u[] = { nan,-nan,1.0 };
+	normal_cdf(u,w,3);
+	for(int i = 0; i < 2; ++i)
+	{
+		BOOST_CHECK(boost::math::isnan(w[i]));
+		BOOST_CHECK(boost::math::isnan(normal_cdf(u[i])));
+	}
+	BOOST_CHECK_CLOSE(w[2],normal_cdf(1.0),1e-12);
+}
+
+
+BOOST_AUTO_TEST_CASE(test_black_scholes_batch)
+{
+	using namespace fbox::finance;
+
+	// several blocks of the batch pricers
+	const int n = 300;
+	std::vector<double> k(n),t(n),f(n),v(n),d(n),c(n),p(n),nc(n),iv(n);
+	for(int i = 0; i < n; ++i)
+	{
+		k[i] = 60.0 + i % 50;
+		t[i] = 0.1 + 0.05 * (i % 50);
+		f[i] = 85.0;
+		v[i] = 0.1 + 0.005 * (i % 50) + 0.001 * (i / 50);
+		d[i] = std::exp(-0.03 * t[i]);
+	}
+
+	black_scholes('c',&k[0],&t[0],&f[0],&v[0],&d[0],&c[0],n);
+	black_scholes('p',&k[0],&t[0],&f[0],&v[0],&d[0],&p[0],n);
+	normal_black_scholes('c',&k[0],&t[0],&f[0],&v[0],&d[0],&nc[0],n);
+
+	boost::math::normal s;
+	for(int i = 0; i < n; ++i)
+	{
+		// batch matches single option pricing and the textbook formula
+		BOOST_REQUIRE_SMALL(c[i] - black_scholes('c',k[i],t[i],f[i],v[i],d[i]),1e-12);
+		BOOST_REQUIRE_SMALL(nc[i] - normal_black_scholes('c',k[i],t[i],f[i],v[i],d[i]),1e-12);
+
+		double d1 = (std::log(f[i] / k[i]) + v[i] * v[i] * t[i] / 2.0) / (v[i] * std::sqrt(t[i]));
+		double d2 = d1 - v[i] * std::sqrt(t[i]);
+		BOOST_CHECK_CLOSE(c[i],d[i] * (f[i] * cdf(s,d1) - k[i] * cdf(s,d2)),1e-10);
+
+		// put-call parity
+		BOOST_CHECK_SMALL(c[i] - p[i] - d[i] * (f[i] - k[i]),1e-10);
+	}
+
+	// implied volatilities reprice the options, and recover the inputs where vega is not negligible
+	implied_volatility('c',&c[0],&k[0],&t[0],&f[0],&d[0],&iv[0],n);
+	for(int i = 0; i < n; ++i) BOOST_CHECK_SMALL(black_scholes('c',k[i],t[i],f[i],iv[i],d[i]) - c[i],1e-8);
+	for(int i = 0; i < n; ++i) if (i % 50 >= 10) BOOST_CHECK_CLOSE(iv[i],v[i],1e-6);
+
+	implied_volatility('p',&p[0],&k[0],&t[0],&f[0],&d[0],&iv[0],n);
+	for(int i = 0; i < n; ++i) BOOST_CHECK_SMALL(black_scholes('p',k[i],t[i],f[i],iv[i],d[i]) - p[i],1e-8);
+	for(int i = 0; i < n; ++i) if (i % 50 >= 10) BOOST_CHECK_CLOSE(iv[i],v[i],1e-6);
+
+	BOOST_CHECK_THROW(implied_volatility('c',90.0,60.0,1.0,85.0),fbox::error);
+	BOOST_CHECK_EQUAL(black_scholes('c',60.0,1.0,85.0,0.0,0.5),12.5);
+
+	// zero volatility in a batch gives the intrinsic value
+	v[7] = 0.0;
+	black_scholes('p',&k[0],&t[0],&f[0],&v[0],&d[0],&p[0],n);
+	normal_black_scholes('c',&k[0],&t[0],&f[0],&v[0],&d[0],&nc[0],n);
+	BOOST_CHECK_EQUAL(p[7],0.0);
+	BOOST_CHECK_EQUAL(nc[7],d[7] * (f[7] - k[7]));
+}
+
+
+//! Uniform source stuck at the top of [0,1]
+struct uniform_one
+{
+	double operator()() { return 1.0; }
+};
+
+
+BOOST_AUTO_TEST_CASE(test_binomial_deviate)
+{
+	using namespace fbox::math;
+
+	mersenne_twister rnd;
+	rnd.seed(1234);
+
+	// inversion (n.p < 10), rejection (BTRS) and the p > 0.5 reflection
+	const unsigned long n[] = { 5,40,100,1000,100000,200 };
+	const double p[] = { 0.3,0.1,0.4,0.02,0.25,0.85 };
+	const int samples = 200000;
+
+	for(int i = 0; i < 6; ++i)
+	{
+		boost::math::binomial dist(double(n[i]),p[i]);
+		std::vector<double> freq(n[i] + 1,0.0);
+		double s1 = 0.0,s2 = 0.0;
+
+		for(int j = 0; j < samples; ++j)
+		{
+			unsigned long k = binomial_deviate(n[i],p[i],rnd);
+			BOOST_REQUIRE(k <= n[i]);
+			freq[k] += 1.0 / samples;
+			s1 += k;
+			s2 += double(k) * k;
+		}
+
+		double m = s1 / samples,var = s2 / samples - m * m;
+		BOOST_CHECK_SMALL(m - mean(dist),4.0 * standard_deviation(dist) / std::sqrt(double(samples)));
+		BOOST_CHECK_CLOSE(var,variance(dist),2.0);
+
+		// empirical frequencies match the probability mass function
+		for(unsigned long k = 0; k <= n[i]; ++k)
+		{
+			double f = pdf(dist,double(k));
+			BOOST_CHECK_SMALL(freq[k] - f,5.0 * std::sqrt(f / samples) + 1e-9);
+		}
+	}
+
+	BOOST_CHECK_EQUAL(binomial_deviate(10,0.0,rnd),0u);
+	BOOST_CHECK_EQUAL(binomial_deviate(10,1.0,rnd),10u);
+	BOOST_CHECK_EQUAL(binomial_deviate(0,0.5,rnd),0u);
+
+	// a uniform of exactly 1 (MTRand::rand() can return it) stops where the mass underflows, well short of
+	// _n, instead of walking every trial
+	uniform_one one;
+	BOOST_CHECK(binomial_deviate(1000000,5e-6,one) < 1000u);
+	BOOST_CHECK(binomial_deviate(1000000,1.0 - 5e-6,one) > 1000000u - 1000u);
+
+	// the open interval draw never returns either end
+	for(int j = 0; j < 1000; ++j)
+	{
+		double u = rnd.open();
+		BOOST_REQUIRE(u > 0.0 && u < 1.0);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(test_poisson_deviate)
+{
+	using namespace fbox::math;
+
+	mersenne_twister rnd;
+	rnd.seed(4321);
+
+	// inversion below a mean of 10, rejection (PTRS) above
+	const double lambda[] = { 0.05,2.5,9.9,10.0,35.0,1000.0 };
+	const int samples = 200000;
+
+	for(int i = 0; i < 6; ++i)
+	{
+		boost::math::poisson dist(lambda[i]);
+		unsigned long top = (unsigned long)(lambda[i] + 10.0 * std::sqrt(lambda[i]) + 10.0);
+		std::vector<double> freq(top + 1,0.0);
+		double s1 = 0.0,s2 = 0.0;
+
+		for(int j = 0; j < samples; ++j)
+		{
+			unsigned long k = poisson_deviate(lambda[i],rnd);
+			if (k <= top) freq[k] += 1.0 / samples;
+			s1 += k;
+			s2 += double(k) * k;
+		}
+
+		double m = s1 / samples,var = s2 / samples - m * m;
+		BOOST_CHECK_SMALL(m - lambda[i],4.0 * std::sqrt(lambda[i] / samples));
+		BOOST_CHECK_CLOSE(var,lambda[i],2.0);
+
+		for(unsigned long k = 0; k <= top; ++k)
+		{
+			double f = pdf(dist,double(k));
+			BOOST_CHECK_SMALL(freq[k] - f,5.0 * std::sqrt(f / samples) + 1e-9);
+		}
+	}
+
+	BOOST_CHECK_EQUAL(poisson_deviate(0.0,rnd),0u);
+}
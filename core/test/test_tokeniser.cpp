@@ -7,7 +7,11 @@
 */
 
 #include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
 #include "../tokeniser.h"
+#include "../error.h"
 
 
 BOOST_AUTO_TEST_CASE(test_tokeniser)
@@ -40,3 +44,96 @@ BOOST_AUTO_TEST_CASE(test_tokeniser)
 	BOOST_CHECK_EQUAL(0,tok.next(out)); // check EOF
 	BOOST_CHECK_EQUAL("word4 and grouped string",out); // token and (unseparated) group
 }
+
+
+BOOST_AUTO_TEST_CASE(test_buffer_tokeniser)
+{
+	using namespace fbox;
+
+	std::string str("word1\tword2,\"grouped string\",word\\ 3 \"this is, a \\\" delimited string\",word4\" and grouped string\"");
+
+	buffer_tokeniser tok(str.data(),str.data() + str.size(),", \t","\"","\"");
+
+	string_slice out;
+	BOOST_CHECK_EQUAL('\t',tok.next(out));
+	BOOST_CHECK(out == "word1"); // tab separator
+	BOOST_CHECK(out.data == str.data()); // not copied
+
+	BOOST_CHECK_EQUAL(',',tok.next(out));
+	BOOST_CHECK(out == "word2"); // separator ','
+
+	BOOST_CHECK_EQUAL(',',tok.next(out));
+	BOOST_CHECK_EQUAL("grouped string",out.str()); // group, escape character and space separator
+
+	BOOST_CHECK_EQUAL(' ',tok.next(out));
+	BOOST_CHECK_EQUAL("word 3",out.str()); // escape character
+
+	BOOST_CHECK_EQUAL(',',tok.next(out));
+	BOOST_CHECK_EQUAL("this is, a \" delimited string",out.str()); // group, escape character and space separator
+
+	BOOST_CHECK(tok.good());
+	BOOST_CHECK_EQUAL(0,tok.next(out)); // check end of input
+	BOOST_CHECK_EQUAL("word4 and grouped string",out.str()); // token and (unseparated) group
+	BOOST_CHECK(!tok.good());
+
+	// seek
+	std::string line("key: value\\: more; rest");
+	tok.set_input(line.data(),line.data() + line.size());
+	BOOST_CHECK(tok.seek(':',out));
+	BOOST_CHECK(out == "key");
+	BOOST_CHECK(tok.seek(';',out));
+	BOOST_CHECK_EQUAL(" value: more",out.str());
+	BOOST_CHECK(!tok.seek(':'));
+	BOOST_CHECK(!tok.good());
+
+	BOOST_CHECK_THROW(buffer_tokeniser(0,0,",","(",""),fbox::error);
+}
+
+
+BOOST_AUTO_TEST_CASE(test_buffer_tokeniser_csv)
+{
+	using namespace fbox;
+
+	// long fields take the vectorised path, short ones the tail loop
+	std::ostringstream csv;
+	for(int i = 0; i < 200; ++i)
+		csv << "row" << i << ',' << std::string(i % 37,'x') << ',' << 0.5 * i << '\n';
+
+	std::string text = csv.str();
+	std::istringstream in(text);
+	tokeniser ref(in,",\n");
+	buffer_tokeniser tok(text.data(),text.data() + text.size(),",\n");
+
+	std::string expected;
+	string_slice out;
+	size_type n = 0;
+	while (tok.good())
+	{
+		char c = tok.next(out);
+		BOOST_REQUIRE_EQUAL(ref.next(expected),c);
+		BOOST_REQUIRE_EQUAL(expected,out.str());
+		++n;
+	}
+	BOOST_CHECK_EQUAL(595,n); // three fields per row, less the six empty ones (consecutive dividers are skipped), and an empty token at the end
+
+	// the same from a memory mapped file
+	std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	{
+		std::ofstream f(filename.c_str(),std::ios::binary);
+		f << text;
+	}
+
+	{
+		mapped_file file(filename);
+		BOOST_CHECK_EQUAL(text.size(),file.size());
+
+		buffer_tokeniser ftok(file.begin(),file.end(),",\n");
+		ftok.next(out);
+		BOOST_CHECK(out == "row0");
+		BOOST_CHECK(out.data == file.begin());
+	}
+
+	boost::filesystem::remove(filename);
+	BOOST_CHECK_THROW(mapped_file m(filename),fbox::error);
+}
+
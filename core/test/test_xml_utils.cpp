@@ -7,7 +7,10 @@
 */
 
 #include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <sstream>
 #include "../xml_utils.h"
+#include "../error.h"
 
 using namespace fbox::xml;
 
@@ -44,3 +47,211 @@ BOOST_AUTO_TEST_CASE(test_make_xml)
 	std::string str("<?xml version=\"1.0\" ?><head1><direction>1</direction><asset>100.342</asset><cash>1.43</cash><head2><signal><type>test</type></signal></head2><head3 attr1=\"12\"><head4><type>test2</type></head4></head3></head1>");
 	BOOST_CHECK_EQUAL(str.c_str(),stream.str().c_str());
 }
+
+
+BOOST_AUTO_TEST_CASE(test_write_xml)
+{
+	std::stringstream stream;
+	{
+		write_xml xml(stream);
+
+		xml.open_branch("head1");
+			xml.value("direction",1);
+			xml.value("asset",100.3421);
+			xml.value("cash",1.43);
+
+			xml.open_branch("head2");
+				xml.open_branch("signal");
+					xml.value("type","test");
+				xml.close_branch();
+			xml.close_branch();
+
+			xml.open_branch("head3");
+				xml.attribute("attr1","12");
+				xml.open_branch("head4");
+					xml.value("type","test2");
+				// head4, head3 and head1 closed on destruction
+	}
+
+	// same document as make_xml
+	std::string str("<?xml version=\"1.0\" ?><head1><direction>1</direction><asset>100.342</asset><cash>1.43</cash><head2><signal><type>test</type></signal></head2><head3 attr1=\"12\"><head4><type>test2</type></head4></head3></head1>");
+	BOOST_CHECK_EQUAL(str,stream.str());
+
+	std::stringstream escaped;
+	write_xml xml(escaped,false);
+	xml.open_branch("a");
+	xml.attribute("q","\"1\" & '2'");
+	xml.open_branch("empty");
+	xml.close_branch();
+	xml.value("b","x < y > z");
+	BOOST_CHECK_THROW(xml.attribute("late","1"),fbox::error);
+	BOOST_CHECK_EQUAL(1,xml.depth());
+	xml.close();
+	BOOST_CHECK_THROW(xml.close_branch(),fbox::error);
+	BOOST_CHECK_THROW(xml.value("c",1),fbox::error);
+	BOOST_CHECK_EQUAL("<a q=\"&quot;1&quot; &amp; &apos;2&apos;\"><empty /><b>x &lt; y &gt; z</b></a>",escaped.str());
+
+	// reads back
+	pull_parser p(escaped);
+	BOOST_CHECK_EQUAL(pull_parser::START_ELEMENT,p.next());
+	BOOST_CHECK_EQUAL("\"1\" & '2'",p.attribute("q"));
+	p.next();
+	p.skip();
+	p.next();
+	BOOST_CHECK_EQUAL(pull_parser::TEXT,p.next());
+	BOOST_CHECK_EQUAL("x < y > z",p.text());
+}
+
+
+namespace {
+
+const char* s_portfolio =
+	"<?xml version=\"1.0\" ?>\n"
+	"<!DOCTYPE portfolio [ <!ELEMENT portfolio ANY> ]>\n"
+	"<portfolio name=\"test &amp; co\">\n"
+	"	<!-- two trades -->\n"
+	"	<trade id='1' type=\"swap\">\n"
+	"		<notional>1000000</notional>\n"
+	"		<currency>EUR</currency>\n"
+	"		<legs><leg/><leg rate=\"0.02\"/></legs>\n"
+	"	</trade>\n"
+	"	<trade id=\"2\">\n"
+	"		<notional>500</notional>\n"
+	"		<note><![CDATA[a < b & c]]></note>\n"
+	"		<desc>caf&#xe9; &lt;&#65;&gt;</desc>\n"
+	"	</trade>\n"
+	"	<summary><notional>1000500</notional></summary>\n"
+	"</portfolio>\n";
+
+
+class count_trades : public element_handler
+{
+public:
+	count_trades() : count(0),total(0.0) {}
+
+	virtual void element(pull_parser& _parser)
+	{
+		TiXmlElement* e = _parser.read_element(m_doc);
+		total += std::atof(get_text(e,"notional"));
+		++count;
+	}
+
+	int count;
+	double total;
+
+private:
+	TiXmlDocument m_doc;
+};
+
+
+class collect_names : public element_handler
+{
+public:
+	virtual void element(pull_parser& _parser) { names += _parser.name() + ' '; }
+
+	std::string names;
+};
+
+} // namespace
+
+
+BOOST_AUTO_TEST_CASE(test_pull_parser)
+{
+	std::istringstream in(s_portfolio);
+	pull_parser xml(in,7); // small buffer to read across refills
+
+	BOOST_CHECK_EQUAL(pull_parser::START_ELEMENT,xml.next());
+	BOOST_CHECK_EQUAL("portfolio",xml.name());
+	BOOST_CHECK_EQUAL("test & co",xml.attribute("name"));
+	BOOST_CHECK(!xml.attribute("id"));
+
+	BOOST_CHECK_EQUAL(pull_parser::START_ELEMENT,xml.next());
+	BOOST_CHECK_EQUAL("trade",xml.name());
+	BOOST_CHECK_EQUAL(2,xml.attributes());
+	BOOST_CHECK_EQUAL("type",xml.attribute_name(1));
+	BOOST_CHECK_EQUAL("1",xml.attribute_value(0));
+	BOOST_CHECK_EQUAL("/portfolio/trade",xml.path());
+
+	BOOST_CHECK_EQUAL(pull_parser::START_ELEMENT,xml.next());
+	BOOST_CHECK_EQUAL(pull_parser::TEXT,xml.next());
+	BOOST_CHECK_EQUAL("1000000",xml.text());
+	BOOST_CHECK_EQUAL(pull_parser::END_ELEMENT,xml.next());
+	BOOST_CHECK_EQUAL("notional",xml.name());
+	BOOST_CHECK_EQUAL(3,xml.depth());
+
+	xml.next();
+	xml.skip(); // currency
+	BOOST_CHECK_EQUAL(pull_parser::END_ELEMENT,xml.event());
+	BOOST_CHECK_EQUAL("currency",xml.name());
+
+	BOOST_CHECK_EQUAL(pull_parser::START_ELEMENT,xml.next()); // legs
+	BOOST_CHECK_EQUAL(pull_parser::START_ELEMENT,xml.next()); // empty leg
+	BOOST_CHECK_EQUAL(pull_parser::END_ELEMENT,xml.next());
+	BOOST_CHECK_EQUAL("leg",xml.name());
+	BOOST_CHECK_EQUAL(pull_parser::START_ELEMENT,xml.next());
+	BOOST_CHECK_EQUAL("0.02",xml.attribute("rate"));
+	BOOST_CHECK_EQUAL(pull_parser::END_ELEMENT,xml.next());
+	BOOST_CHECK_EQUAL(pull_parser::END_ELEMENT,xml.next()); // legs
+	BOOST_CHECK_EQUAL(pull_parser::END_ELEMENT,xml.next()); // trade
+
+	// second trade as a DOM
+	BOOST_CHECK_EQUAL(pull_parser::START_ELEMENT,xml.next());
+	TiXmlDocument doc;
+	TiXmlElement* trade = xml.read_element(doc);
+	BOOST_CHECK_EQUAL("2",get_attribute("id",trade));
+	BOOST_CHECK_EQUAL("500",get_text(trade,"notional"));
+	BOOST_CHECK_EQUAL("a < b & c",get_text(trade,"note"));
+	BOOST_CHECK_EQUAL("caf\xc3\xa9 <A>",get_text(trade,"desc"));
+	BOOST_CHECK_EQUAL(pull_parser::END_ELEMENT,xml.event());
+	BOOST_CHECK_EQUAL("trade",xml.name());
+
+	xml.next();
+	xml.skip(); // summary
+	BOOST_CHECK_EQUAL(pull_parser::END_ELEMENT,xml.next());
+	BOOST_CHECK_EQUAL("portfolio",xml.name());
+	BOOST_CHECK_EQUAL(pull_parser::END_DOCUMENT,xml.next());
+	BOOST_CHECK_EQUAL(pull_parser::END_DOCUMENT,xml.next());
+
+	// malformed documents
+	const char* bad[] = { "<a><b></a>", "<a>", "<a></a><b/>", "text", "<a x=1/>", "<a>&bad;</a>", "<a><!-- open" };
+	for(fbox::size_type i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i)
+	{
+		std::istringstream b(bad[i]);
+		pull_parser p(b);
+		BOOST_CHECK_THROW(while (p.next() != pull_parser::END_DOCUMENT);,fbox::error);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(test_path_dispatcher)
+{
+	count_trades trades;
+	collect_names inner,all,absolute;
+
+	path_dispatcher d;
+	d.add("trade/legs/leg",inner);
+	d.add("notional",all);
+	d.add("trade",trades);
+	d.add("/portfolio/summary",absolute);
+
+	std::istringstream in(s_portfolio);
+	pull_parser xml(in);
+	d.run(xml);
+
+	BOOST_CHECK_EQUAL(2,trades.count);
+	BOOST_CHECK_EQUAL(1000500.0,trades.total);
+	BOOST_CHECK_EQUAL("",inner.names); // consumed by the trade handler
+	BOOST_CHECK_EQUAL("notional ",all.names); // only the one in the summary is visited
+	BOOST_CHECK_EQUAL("summary ",absolute.names);
+
+	path_dispatcher d2;
+	collect_names legs;
+	d2.add("legs/leg",legs);
+
+	std::istringstream in2(s_portfolio);
+	pull_parser xml2(in2);
+	d2.run(xml2);
+	BOOST_CHECK_EQUAL("leg leg ",legs.names);
+
+	BOOST_CHECK_THROW(d2.add("a//b",legs),fbox::error);
+}
@@ -10,6 +10,16 @@
 #include "error.h"
 #include <sstream>
 #include <stdio.h>
+#include <cstring>
+#include <boost/filesystem.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define FBOX_TOKENISER_SSE2
+	#include <emmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
 
 namespace fbox {
 
@@ -91,7 +101,7 @@ char tokeniser::next(
 	char c = mp_buf->sbumpc();
 	while (c != EOF && is_divider(c)) c = mp_buf->sbumpc();
 
-	size_type i;
+	std::string::size_type i;
 	bool escon = false;
 	while (c != EOF) 
 	{
@@ -160,6 +170,297 @@ bool tokeniser::is_divider(char _c)
 }
 
 
+//////////////////////////////////////////////////////
+// string_slice
+//////////////////////////////////////////////////////
+
+std::ostream& operator<<(std::ostream& _strm,const string_slice& _s)
+{
+	return _strm.write(_s.data,_s.size);
+}
+
+
+
+//////////////////////////////////////////////////////
+// char_set
+//////////////////////////////////////////////////////
+
+void char_set::assign(const std::string& _chars)
+{
+	m_chars = _chars;
+	std::memset(m_table,0,sizeof(m_table));
+	for(size_type i = 0; i < _chars.size(); ++i) m_table[static_cast<unsigned char>(_chars[i])] = true;
+}
+
+
+#ifdef FBOX_TOKENISER_SSE2
+//! Index of the lowest set bit of a non-zero mask
+static inline int lowest_bit(int _mask)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i,_mask);
+	return static_cast<int>(i);
+#else
+	return __builtin_ctz(_mask);
+#endif
+}
+#endif
+
+
+const char* char_set::find(const char* _begin,const char* _end) const
+{
+	const char* p = _begin;
+
+#ifdef FBOX_TOKENISER_SSE2
+	// compare 16 bytes against each character of small sets, larger sets use the table
+	size_type k = m_chars.size();
+	if (k && k <= 8 && _end - p >= 16)
+	{
+		__m128i c[8];
+		for(size_type i = 0; i < k; ++i) c[i] = _mm_set1_epi8(m_chars[i]);
+
+		for(; _end - p >= 16; p += 16)
+		{
+			__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i m = _mm_cmpeq_epi8(x,c[0]);
+			for(size_type i = 1; i < k; ++i) m = _mm_or_si128(m,_mm_cmpeq_epi8(x,c[i]));
+
+			int bits = _mm_movemask_epi8(m);
+			if (bits) return p + lowest_bit(bits);
+		}
+	}
+#endif
+
+	while (p != _end && !contains(*p)) ++p;
+	return p;
+}
+
+
+
+//////////////////////////////////////////////////////
+// buffer_tokeniser
+//////////////////////////////////////////////////////
+
+buffer_tokeniser::buffer_tokeniser()
+:	mp_pos(0),
+	mp_end(0),
+	m_divider(" \t\n"),
+	m_escape('\\'),
+	m_good(false)
+{
+	update_sets();
+}
+
+
+buffer_tokeniser::buffer_tokeniser(
+	const char* _begin,
+	const char* _end,
+	const std::string& _dividers,
+	const std::string& _lgroup,
+	const std::string& _rgroup,
+	char _escape)
+:	mp_pos(_begin),
+	mp_end(_end),
+	m_lgroup(_lgroup),
+	m_rgroup(_rgroup),
+	m_divider(_dividers),
+	m_escape(_escape),
+	m_good(_begin != _end)
+{
+	if (m_lgroup.size() != m_rgroup.size()) 
+		throw error("lgroup and sgroup must be of equal size in buffer_tokeniser ctor"); 
+
+	update_sets();
+}
+
+
+void buffer_tokeniser::set_input(const char* _begin,const char* _end)
+{
+	mp_pos = _begin;
+	mp_end = _end;
+	m_good = _begin != _end;
+}
+
+
+void buffer_tokeniser::set_group(const std::string& _lgroup,const std::string& _rgroup)
+{
+	if (_lgroup.size() != _rgroup.size()) 
+		throw error("lgroup and sgroup must be of equal size in buffer_tokeniser"); 
+
+	m_lgroup = _lgroup;
+	m_rgroup = _rgroup;
+	update_sets();
+}
+
+
+void buffer_tokeniser::set_divider(const std::string& _divider)
+{
+	m_divider = _divider;
+	update_sets();
+}
+
+
+void buffer_tokeniser::set_escape(char _escape)
+{
+	m_escape = _escape;
+	update_sets();
+}
+
+
+void buffer_tokeniser::update_sets()
+{
+	m_dividers.assign(m_divider);
+	m_special.assign(m_divider + m_escape + m_lgroup);
+
+	m_group.resize(m_rgroup.size());
+	for(size_type i = 0; i < m_rgroup.size(); ++i) m_group[i].assign(std::string(1,m_rgroup[i]) + m_escape);
+}
+
+
+char buffer_tokeniser::next(string_slice& _out)
+{
+	const char* p = mp_pos;
+	while (p != mp_end && m_dividers.contains(*p)) ++p;
+
+	// plain tokens are slices of the input
+	const char* start = p;
+	p = m_special.find(p,mp_end);
+
+	if (p == mp_end)
+	{
+		_out = string_slice(start,p);
+		mp_pos = p;
+		m_good = false;
+		return 0;
+	}
+
+	if (m_dividers.contains(*p))
+	{
+		_out = string_slice(start,p);
+		mp_pos = p + 1;
+		return *p;
+	}
+
+	// escapes and groups: copy the token
+	m_scratch.assign(start,p);
+	while (p != mp_end)
+	{
+		char c = *p++;
+		std::string::size_type i;
+
+		if (c == m_escape)
+		{
+			if (p != mp_end) m_scratch += *p++;
+		}
+		else if (m_dividers.contains(c))
+		{
+			mp_pos = p;
+			_out = string_slice(m_scratch.data(),m_scratch.data() + m_scratch.size());
+			return c;
+		}
+		else if (std::string::npos != (i = m_lgroup.find(c))) // find end of group (no nesting allowed just yet)
+		{
+			mp_pos = p;
+			seek_impl(m_group[i],&m_scratch);
+			p = mp_pos;
+		}
+		else
+		{
+			const char* q = m_special.find(p,mp_end);
+			m_scratch.append(p - 1,q);
+			p = q;
+		}
+	}
+
+	mp_pos = p;
+	m_good = false;
+	_out = string_slice(m_scratch.data(),m_scratch.data() + m_scratch.size());
+	return 0;
+}
+
+
+bool buffer_tokeniser::seek(char _end,string_slice& _out)
+{
+	char_set end(std::string(1,_end) + m_escape);
+
+	const char* start = mp_pos;
+	const char* p = end.find(start,mp_end);
+	if (p != mp_end && *p == _end)
+	{
+		_out = string_slice(start,p);
+		mp_pos = p + 1;
+		return true;
+	}
+
+	m_scratch.clear();
+	bool found = seek_impl(end,&m_scratch);
+	_out = string_slice(m_scratch.data(),m_scratch.data() + m_scratch.size());
+	return found;
+}
+
+
+bool buffer_tokeniser::seek(char _end)
+{
+	return seek_impl(char_set(std::string(1,_end) + m_escape),0);
+}
+
+
+bool buffer_tokeniser::seek_impl(const char_set& _end,std::string* _out)
+{
+	const char* p = mp_pos;
+
+	while (p != mp_end)
+	{
+		const char* q = _end.find(p,mp_end);
+		if (_out) _out->append(p,q);
+		if (q == mp_end) break;
+
+		p = q + 1;
+		if (*q != m_escape)	// found target
+		{
+			mp_pos = p;
+			return true;
+		}
+
+		if (p != mp_end)	// escaped character
+		{
+			if (_out) (*_out) += *p;
+			++p;
+		}
+	}
+
+	mp_pos = mp_end;
+	m_good = false;
+	return false;
+}
+
+
+
+//////////////////////////////////////////////////////
+// mapped_file
+//////////////////////////////////////////////////////
+
+mapped_file::mapped_file(const std::string& _filename)
+{
+	using namespace boost::interprocess;
+
+	if (!boost::filesystem::exists(_filename)) throw error("File not found: " + _filename);
+	if (boost::filesystem::file_size(_filename) == 0) return; // empty files cannot be mapped
+
+	try
+	{
+		file_mapping(_filename.c_str(),read_only).swap(m_file);
+		mapped_region(m_file,read_only).swap(m_region);
+	}
+	catch (const interprocess_exception& _e)
+	{
+		throw error("Failed to map file " + _filename + ": " + _e.what());
+	}
+}
+
+
+
 void get_token(
 	const std::string& in,
 	std::string& token,
@@ -9,8 +9,11 @@
 */
 
 #include "main.h"
+#include <cstddef>
 #include <string>
 #include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 namespace fbox {
 
@@ -71,6 +74,133 @@ protected:
 };
 
 
+//! Read-only slice of a character buffer
+struct string_slice
+{
+	const char* data;
+	std::size_t size;
+
+	string_slice() : data(0),size(0) {}
+	string_slice(const char* _begin,const char* _end) : data(_begin),size(_end - _begin) {}
+
+	bool empty() const { return size == 0; }
+	std::string str() const { return std::string(data,size); }
+
+	bool operator==(const std::string& _s) const { return _s.size() == size && _s.compare(0,size,data,size) == 0; }
+	bool operator!=(const std::string& _s) const { return !(*this == _s); }
+};
+
+std::ostream& operator<<(std::ostream& _strm,const string_slice& _s);
+
+
+//! Set of characters, searched 16 at a time where SSE2 is available
+class char_set
+{
+public:
+	char_set() { assign(std::string()); }
+	explicit char_set(const std::string& _chars) { assign(_chars); }
+
+	void assign(const std::string& _chars);
+
+	bool contains(char _c) const { return m_table[static_cast<unsigned char>(_c)]; }
+
+	//! First character in [_begin,_end) that is in the set, or _end
+	const char* find(const char* _begin,const char* _end) const;
+
+private:
+	std::string m_chars;
+	bool m_table[256];
+};
+
+
+//! Extract string tokens from a character buffer without copying them
+/*!
+	Dividers, groups and escapes work as in tokeniser. Tokens are returned as slices of the buffer, so
+	the buffer must outlive them. Only tokens that contain escapes or groups are copied, into a scratch
+	buffer which is valid until the next call.
+
+	<code>
+	mapped_file f("trades.csv");
+	buffer_tokeniser tok(f.begin(),f.end(),",\n","\"","\"");
+	string_slice s;
+	while (tok.good()) { char c = tok.next(s); ... }
+	</code>
+*/
+class buffer_tokeniser
+{
+public:
+	buffer_tokeniser();
+
+	buffer_tokeniser(
+		const char* _begin,							//!< Start of the input
+		const char* _end,							//!< End of the input
+		const std::string& _dividers = " \t\n",		//!< Token dividers
+		const std::string& _lgroup = std::string(),	//!< Left grouping characters
+		const std::string& _rgroup = std::string(),	//!< Right grouping characters (size must match that of _lgroup)
+		char _escape = '\\');						//!< Escape character
+
+	//! Set new input buffer
+	void set_input(const char* _begin,const char* _end);
+
+	//! Set new left-hand and right-hand grouping characters
+	void set_group(const std::string& _lgroup,const std::string& _rgroup);
+
+	//! Set new divider characters
+	void set_divider(const std::string& _divider);
+
+	//! Set new escape character
+	void set_escape(char _escape);
+
+	//! return false once the end of the input is reached
+	bool good() const { return m_good; }
+
+	//! Current position in the input
+	const char* position() const { return mp_pos; }
+
+	//! Extract next token. Return separator character found or '\0' if the input has reached the end.
+	char next(string_slice& _out);
+
+	//! Read to the _end character, _out is the text skipped. Return false if the end of the input is reached
+	bool seek(char _end,string_slice& _out);
+
+	//! Read to the _end character. Return false if the end of the input is reached
+	bool seek(char _end);
+
+protected:
+	const char* mp_pos;
+	const char* mp_end;
+	std::string m_lgroup;
+	std::string m_rgroup;
+	std::string m_divider;
+	char m_escape;
+	bool m_good;
+
+	char_set m_dividers;			//!< Dividers
+	char_set m_special;				//!< Dividers, escape and left group characters
+	std::vector<char_set> m_group;	//!< Right group and escape character for each group
+	std::string m_scratch;
+
+	void update_sets();
+	bool seek_impl(const char_set& _end,std::string* _out);
+};
+
+
+//! Read-only memory map of a whole file
+class mapped_file
+{
+public:
+	mapped_file(const std::string& _filename);
+
+	const char* begin() const { return static_cast<const char*>(m_region.get_address()); }
+	const char* end() const { return begin() + size(); }
+	std::size_t size() const { return m_region.get_size(); }
+
+private:
+	boost::interprocess::file_mapping m_file;
+	boost::interprocess::mapped_region m_region;
+};
+
+
 //! Extract token and its arguments from line
 void get_token(
 	const std::string& in,			//!< Input string
@@ -10,6 +10,9 @@
 
 #include "xml_utils.h"
 #include "error.h"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
 
 namespace fbox {
 namespace xml {
@@ -151,6 +154,118 @@ TiXmlElement* make_xml::attribute(const std::string& _key,const std::string& _va
 
 
 
+////////////////////////////////////////
+// write_xml
+////////////////////////////////////////
+
+write_xml::write_xml(std::ostream& _out,bool _declaration)
+:	m_out(_out),
+	m_open(false),
+	m_empty(false)
+{
+	if (_declaration) m_out << "<?xml version=\"1.0\" ?>";
+}
+
+
+write_xml::~write_xml()
+{
+	try
+	{
+		close();
+	}
+	catch (...) {}
+}
+
+
+void write_xml::finish_tag()
+{
+	if (m_open)
+	{
+		m_out << '>';
+		m_open = false;
+	}
+
+	m_empty = false;
+}
+
+
+void write_xml::open_branch(const std::string& _key)
+{
+	finish_tag();
+
+	m_out << '<' << _key;
+	m_active.push_back(_key);
+	m_open = true;
+	m_empty = true;
+}
+
+
+void write_xml::close_branch()
+{
+	if (m_active.empty()) throw error("Trying to pop empty key stack");
+
+	if (m_empty)
+		m_out << " />";
+	else
+		m_out << "</" << m_active.back() << '>';
+
+	m_active.pop_back();
+	m_open = false;
+	m_empty = false;
+}
+
+
+void write_xml::close()
+{
+	while (m_active.size()) close_branch();
+	m_out.flush();
+}
+
+
+void write_xml::value(const std::string& _key,const std::string& _value)
+{
+	if (m_active.empty()) throw error("Trying to add value before master key");
+
+	finish_tag();
+	m_out << '<' << _key << '>';
+	escape(m_out,_value);
+	m_out << "</" << _key << '>';
+}
+
+
+void write_xml::attribute(const std::string& _key,const std::string& _value)
+{
+	if (m_active.empty()) throw error("Trying to add value before master key");
+	if (!m_open) throw error("Trying to add attribute " + _key + " after the content of " + m_active.back());
+
+	m_out << ' ' << _key << "=\"";
+	escape(m_out,_value);
+	m_out << '"';
+}
+
+
+void write_xml::escape(std::ostream& _out,const std::string& _text)
+{
+	std::string::size_type i = 0,j;
+	while (std::string::npos != (j = _text.find_first_of("<>&\"'",i)))
+	{
+		_out.write(_text.data() + i,j - i);
+		switch (_text[j])
+		{
+		case '<': _out << "&lt;"; break;
+		case '>': _out << "&gt;"; break;
+		case '&': _out << "&amp;"; break;
+		case '"': _out << "&quot;"; break;
+		case '\'': _out << "&apos;"; break;
+		}
+		i = j + 1;
+	}
+
+	_out.write(_text.data() + i,_text.size() - i);
+}
+
+
+
 ////////////////////////////////////////
 // make_tag
 ////////////////////////////////////////
@@ -168,6 +283,447 @@ make_tag::~make_tag()
 } 
 
 
+
+////////////////////////////////////////
+// pull_parser
+////////////////////////////////////////
+
+pull_parser::pull_parser(std::istream& _in,size_type _buffer)
+:	mp_buf(_in.rdbuf()),
+	m_buffer(std::max(1u,_buffer)),
+	mp_pos(0),
+	mp_end(0),
+	m_line(1),
+	m_event(END_DOCUMENT),
+	m_pending_end(false),
+	m_root_closed(false),
+	m_nattr(0)
+{}
+
+
+bool pull_parser::refill()
+{
+	std::streamsize n = mp_buf->sgetn(&m_buffer[0],m_buffer.size());
+	mp_pos = &m_buffer[0];
+	mp_end = mp_pos + (n > 0 ? n : 0);
+	return n > 0;
+}
+
+
+inline int pull_parser::get()
+{
+	if (mp_pos == mp_end && !refill()) return EOF;
+	if (*mp_pos == '\n') ++m_line;
+	return static_cast<unsigned char>(*mp_pos++);
+}
+
+
+inline int pull_parser::peek()
+{
+	if (mp_pos == mp_end && !refill()) return EOF;
+	return static_cast<unsigned char>(*mp_pos);
+}
+
+
+namespace {
+
+inline bool is_xml_space(int _c)
+{
+	return _c == ' ' || _c == '\t' || _c == '\n' || _c == '\r';
+}
+
+} // namespace
+
+
+void pull_parser::fail(const std::string& _msg) const
+{
+	std::ostringstream msg;
+	msg << "XML error at line " << m_line << ": " << _msg;
+	throw error(msg.str());
+}
+
+
+void pull_parser::expect(char _c)
+{
+	int c = get();
+	if (c != static_cast<unsigned char>(_c))
+	{
+		if (c == EOF) fail("Unexpected end of document");
+		fail(std::string("Expected '") + _c + "' but found '" + char(c) + "'");
+	}
+}
+
+
+void pull_parser::skip_space()
+{
+	while (is_xml_space(peek())) get();
+}
+
+
+void pull_parser::read_name(std::string& _out)
+{
+	_out.clear();
+	for(int c = peek(); c != EOF && !is_xml_space(c) && c != '/' && c != '>' && c != '=' && c != '<'; c = peek())
+		_out += static_cast<char>(get());
+
+	if (_out.empty()) fail("Missing name");
+}
+
+
+void pull_parser::read_to(const std::string& _end,std::string* _out)
+{
+	std::string tail;
+	for(;;)
+	{
+		int c = get();
+		if (c == EOF) fail("Unexpected end of document looking for " + _end);
+
+		if (_out) (*_out) += static_cast<char>(c);
+		tail += static_cast<char>(c);
+		if (tail.size() > _end.size()) tail.erase(0,1);
+		if (tail == _end) break;
+	}
+
+	if (_out) _out->resize(_out->size() - _end.size());
+}
+
+
+void pull_parser::read_text(char _end,std::string& _out)
+{
+	for(;;)
+	{
+		// copy runs of plain characters straight from the buffer
+		const char* p = mp_pos;
+		while (p != mp_end && *p != _end && *p != '&' && *p != '\n') ++p;
+		_out.append(mp_pos,p);
+		mp_pos = p;
+
+		int c = peek();
+		if (c == EOF || c == static_cast<unsigned char>(_end)) return;
+
+		if (c == '&')
+		{
+			get();
+			read_entity(_out);
+		}
+		else
+			_out += static_cast<char>(get()); // new line or end of the buffer
+	}
+}
+
+
+void pull_parser::read_entity(std::string& _out)
+{
+	std::string e;
+	for(int c = get(); c != ';'; c = get())
+	{
+		if (c == EOF || e.size() > 10) fail("Unterminated entity");
+		e += static_cast<char>(c);
+	}
+
+	if (e == "lt") _out += '<';
+	else if (e == "gt") _out += '>';
+	else if (e == "amp") _out += '&';
+	else if (e == "quot") _out += '"';
+	else if (e == "apos") _out += '\'';
+	else if (e.size() > 1 && e[0] == '#')
+	{
+		char* end;
+		unsigned long u = e[1] == 'x' ? std::strtoul(e.c_str() + 2,&end,16) : std::strtoul(e.c_str() + 1,&end,10);
+		if (*end || u > 0x10ffff) fail("Invalid character reference &" + e + ";");
+
+		// UTF-8
+		if (u < 0x80)
+			_out += static_cast<char>(u);
+		else if (u < 0x800)
+		{
+			_out += static_cast<char>(0xc0 | (u >> 6));
+			_out += static_cast<char>(0x80 | (u & 0x3f));
+		}
+		else if (u < 0x10000)
+		{
+			_out += static_cast<char>(0xe0 | (u >> 12));
+			_out += static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+			_out += static_cast<char>(0x80 | (u & 0x3f));
+		}
+		else
+		{
+			_out += static_cast<char>(0xf0 | (u >> 18));
+			_out += static_cast<char>(0x80 | ((u >> 12) & 0x3f));
+			_out += static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+			_out += static_cast<char>(0x80 | (u & 0x3f));
+		}
+	}
+	else
+		fail("Unknown entity &" + e + ";");
+}
+
+
+void pull_parser::read_tag()
+{
+	read_name(m_name);
+
+	m_nattr = 0;
+	for(;;)
+	{
+		skip_space();
+		int c = peek();
+
+		if (c == '>')
+		{
+			get();
+			break;
+		}
+
+		if (c == '/')
+		{
+			get();
+			expect('>');
+			m_pending_end = true;
+			break;
+		}
+
+		if (c == EOF) fail("Unexpected end of document in tag " + m_name);
+
+		if (m_nattr == m_attr.size()) m_attr.resize(m_nattr + 1);
+		std::pair<std::string,std::string>& a = m_attr[m_nattr++];
+
+		read_name(a.first);
+		skip_space();
+		expect('=');
+		skip_space();
+
+		int q = get();
+		if (q != '"' && q != '\'') fail("Expected quoted value for attribute " + a.first);
+
+		a.second.clear();
+		read_text(static_cast<char>(q),a.second);
+		expect(static_cast<char>(q));
+	}
+
+	m_stack.push_back(m_name);
+	m_event = START_ELEMENT;
+}
+
+
+pull_parser::event_type pull_parser::next()
+{
+	// closed elements stay on the stack until the parser moves on
+	if (m_event == END_ELEMENT) m_stack.pop_back();
+
+	if (m_pending_end)
+	{
+		m_pending_end = false;
+		m_root_closed = m_stack.size() == 1;
+		return m_event = END_ELEMENT;
+	}
+
+	for(;;)
+	{
+		int c = peek();
+
+		if (c == EOF)
+		{
+			if (!m_stack.empty()) fail("Unexpected end of document in element " + m_stack.back());
+			return m_event = END_DOCUMENT;
+		}
+
+		if (c != '<')
+		{
+			m_text.clear();
+			read_text('<',m_text);
+
+			bool blank = true;
+			for(size_type i = 0; blank && i < m_text.size(); ++i) blank = is_xml_space(m_text[i]);
+			if (blank) continue;
+
+			if (m_stack.empty()) fail("Text outside the root element");
+			return m_event = TEXT;
+		}
+
+		get();
+		c = peek();
+
+		if (c == '?')			// declaration or processing instruction
+		{
+			read_to("?>",0);
+		}
+		else if (c == '!')
+		{
+			get();
+			c = peek();
+
+			if (c == '-')		// comment
+			{
+				expect('-');
+				expect('-');
+				read_to("-->",0);
+			}
+			else if (c == '[')	// CDATA
+			{
+				std::string tag;
+				for(int i = 0; i < 7; ++i) tag += static_cast<char>(get());
+				if (tag != "[CDATA[") fail("Unknown markup <!" + tag);
+
+				m_text.clear();
+				read_to("]]>",&m_text);
+				if (m_stack.empty()) fail("Text outside the root element");
+				return m_event = TEXT;
+			}
+			else				// document type
+			{
+				int depth = 0;
+				for(c = get(); c != '>' || depth > 0; c = get())
+				{
+					if (c == EOF) fail("Unexpected end of document in document type");
+					if (c == '[') ++depth;
+					if (c == ']') --depth;
+				}
+			}
+		}
+		else if (c == '/')		// end tag
+		{
+			get();
+			read_name(m_name);
+			skip_space();
+			expect('>');
+
+			if (m_stack.empty() || m_stack.back() != m_name) fail("Unexpected end tag " + m_name);
+			m_root_closed = m_stack.size() == 1;
+			return m_event = END_ELEMENT;
+		}
+		else
+		{
+			if (m_root_closed) fail("More than one root element");
+			read_tag();
+			return m_event;
+		}
+	}
+}
+
+
+std::string pull_parser::path() const
+{
+	std::string p;
+	for(size_type i = 0; i < m_stack.size(); ++i) p += '/' + m_stack[i];
+	return p;
+}
+
+
+const char* pull_parser::attribute(const std::string& _name) const
+{
+	for(size_type i = 0; i < m_nattr; ++i) if (m_attr[i].first == _name) return m_attr[i].second.c_str();
+	return 0;
+}
+
+
+TiXmlElement* pull_parser::read_element(TiXmlDocument& _doc)
+{
+	if (m_event != START_ELEMENT) throw error("read_element must be called on the start of an element");
+
+	_doc.Clear();
+
+	std::vector<TiXmlElement*> open;
+	for(;;)
+	{
+		switch (m_event)
+		{
+		case START_ELEMENT:
+		{
+			TiXmlElement* e = new TiXmlElement(m_name);
+			for(size_type i = 0; i < m_nattr; ++i) e->SetAttribute(m_attr[i].first,m_attr[i].second);
+
+			if (open.empty())
+				_doc.LinkEndChild(e);
+			else
+				open.back()->LinkEndChild(e);
+
+			open.push_back(e);
+			break;
+		}
+
+		case TEXT:
+			open.back()->LinkEndChild(new TiXmlText(m_text));
+			break;
+
+		case END_ELEMENT:
+			open.pop_back();
+			if (open.empty()) return _doc.RootElement();
+			break;
+
+		case END_DOCUMENT:
+			fail("Unexpected end of document");
+		}
+
+		next();
+	}
+}
+
+
+void pull_parser::skip()
+{
+	if (m_event != START_ELEMENT) throw error("skip must be called on the start of an element");
+
+	size_type d = m_stack.size();
+	while (next() != END_ELEMENT || m_stack.size() != d);
+}
+
+
+
+////////////////////////////////////////
+// path_dispatcher
+////////////////////////////////////////
+
+void path_dispatcher::add(const std::string& _path,element_handler& _handler)
+{
+	route_type r;
+	r.absolute = !_path.empty() && _path[0] == '/';
+	r.handler = &_handler;
+
+	std::string::size_type i = r.absolute ? 1 : 0,j;
+	do
+	{
+		j = _path.find('/',i);
+		std::string name = _path.substr(i,j == std::string::npos ? std::string::npos : j - i);
+		if (name.empty()) throw error("Invalid element path " + _path);
+
+		r.names.push_back(name);
+		i = j + 1;
+	}
+	while (j != std::string::npos);
+
+	m_routes.push_back(r);
+}
+
+
+bool path_dispatcher::matches(const route_type& _route,const std::vector<std::string>& _elements)
+{
+	size_type n = _route.names.size();
+	if (_elements.size() < n || (_route.absolute && _elements.size() != n)) return false;
+
+	size_type offset = _elements.size() - n;
+	for(size_type i = n; i-- > 0;) if (_route.names[i] != _elements[offset + i]) return false;
+	return true;
+}
+
+
+void path_dispatcher::run(pull_parser& _parser)
+{
+	while (_parser.next() != pull_parser::END_DOCUMENT)
+	{
+		if (_parser.event() != pull_parser::START_ELEMENT) continue;
+
+		for(size_type i = 0; i < m_routes.size(); ++i)
+		{
+			if (!matches(m_routes[i],_parser.elements())) continue;
+
+			m_routes[i].handler->element(_parser);
+			if (_parser.event() != pull_parser::START_ELEMENT) break; // consumed
+		}
+	}
+}
+
+
 } // namespace xml
 } // namespace fbox
 
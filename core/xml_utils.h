@@ -11,7 +11,13 @@
 
 #include "main.h"
 #include <tinyxml/tinyxml.h>
+#include <istream>
+#include <ostream>
+#include <sstream>
 #include <stack>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace fbox {
 namespace xml {
@@ -95,6 +101,78 @@ TiXmlElement* make_xml::value(const std::string& _key,const _value_type& _value)
 
 
 
+//! Write an XML document as it is built
+/*!
+	Streaming counterpart of make_xml, with the same interface: elements are written out as soon as
+	they are complete, so memory use is bounded by the depth of the document rather than its size.
+	Attributes must be added before the content of their element. Values are escaped.
+*/
+class write_xml
+{
+public:
+	write_xml(std::ostream& _out,bool _declaration=true);
+
+	//! Close any open branches
+	~write_xml();
+
+	//! Open a new heading
+	void open_branch(const std::string& _key);
+
+	//! Close last heading
+	void close_branch();
+
+	//! Close all headings
+	void close();
+
+	//! Add string valued item
+	void value(const std::string& _key,const std::string& _value);
+
+	//! Add generic item
+	template<typename _value_type>
+	void value(const std::string& _key,const _value_type& _value);
+
+	//! Add string valued attribute to the last heading opened
+	void attribute(const std::string& _key,const std::string& _value);
+
+	//! Add generic attribute to the last heading opened
+	template<typename _value_type>
+	void attribute(const std::string& _key,const _value_type& _value);
+
+	//! Number of open headings
+	size_type depth() const { return m_active.size(); }
+
+	//! Write _text with XML special characters escaped
+	static void escape(std::ostream& _out,const std::string& _text);
+
+protected:
+	std::ostream& m_out;
+	std::vector<std::string> m_active;
+	bool m_open;	//!< Start tag of the last heading is not finished yet
+	bool m_empty;	//!< Last heading has no content yet
+
+	void finish_tag();
+};
+
+
+template<typename _value_type>
+void write_xml::value(const std::string& _key,const _value_type& _value)
+{
+	std::stringstream a;
+	a << _value;
+	value(_key,a.str());
+}
+
+
+template<typename _value_type>
+void write_xml::attribute(const std::string& _key,const _value_type& _value)
+{
+	std::stringstream a;
+	a << _value;
+	attribute(_key,a.str());
+}
+
+
+
 //! Create a single XML tag with attributes
 /*!
 	The implementation allows nested syntax:
@@ -126,6 +204,160 @@ private:
 };
 
 
+
+//! Streaming XML parser
+/*!
+	Reads a document one item at a time, holding only a fixed size input buffer, the names of the open
+	elements and the current item, so documents of any size can be read in bounded memory. Whitespace
+	between elements, comments, processing instructions and the document type are skipped, entities
+	are decoded and CDATA sections are returned as text.
+
+	Elements of interest can be read whole into a TiXmlDocument, to use the DOM utilities above on
+	one element at a time:
+
+	<code>
+	std::ifstream in("portfolio.xml");
+	pull_parser xml(in);
+	TiXmlDocument trade;
+
+	while (xml.next() != pull_parser::END_DOCUMENT)
+	{
+		if (xml.event() == pull_parser::START_ELEMENT && xml.name() == "trade")
+		{
+			TiXmlElement* e = xml.read_element(trade);
+			const char* notional = get_text(e,"notional");
+			...
+		}
+	}
+	</code>
+*/
+class pull_parser
+{
+public:
+	enum event_type
+	{
+		START_ELEMENT,	//!< Element opened: name() and attributes are set
+		END_ELEMENT,	//!< Element closed: name() is set
+		TEXT,			//!< Text inside an element: text() is set
+		END_DOCUMENT	//!< Nothing left to read
+	};
+
+	enum { DEFAULT_BUFFER = 1 << 16 }; //!< Default input buffer size, in bytes
+
+	explicit pull_parser(std::istream& _in,size_type _buffer=DEFAULT_BUFFER);
+
+	//! Read the next item. Throws on malformed input.
+	event_type next();
+
+	//! Last item read (END_DOCUMENT before the first)
+	event_type event() const { return m_event; }
+
+	//! Name of the element opened or closed
+	const std::string& name() const { return m_name; }
+
+	//! Text read
+	const std::string& text() const { return m_text; }
+
+	//! Names of the open elements, outermost first. Includes the element opened or closed.
+	const std::vector<std::string>& elements() const { return m_stack; }
+
+	//! Number of open elements
+	size_type depth() const { return m_stack.size(); }
+
+	//! Path to the current element, as in /portfolio/trade
+	std::string path() const;
+
+	//! Current line in the input
+	size_type line() const { return m_line; }
+
+	//! Attributes of the element opened
+	size_type attributes() const { return m_nattr; }
+	const std::string& attribute_name(size_type _i) const { return m_attr.at(_i).first; }
+	const std::string& attribute_value(size_type _i) const { return m_attr.at(_i).second; }
+
+	//! Value of attribute _name of the element opened, or 0 if it has none
+	const char* attribute(const std::string& _name) const;
+
+	//! Read the element just opened and all its content into _doc, replacing its contents, and return
+	//! it. The parser is left on the end of the element.
+	TiXmlElement* read_element(TiXmlDocument& _doc);
+
+	//! Skip the content of the element just opened. The parser is left on the end of the element.
+	void skip();
+
+private:
+	std::streambuf* mp_buf;
+	std::vector<char> m_buffer;
+	const char* mp_pos;
+	const char* mp_end;
+	size_type m_line;
+
+	event_type m_event;
+	bool m_pending_end;			//!< Element opened was empty (<tag/>)
+	bool m_root_closed;
+	std::string m_name;
+	std::string m_text;
+	std::vector<std::string> m_stack;
+	std::vector<std::pair<std::string,std::string> > m_attr; //!< Strings are reused between elements
+	size_type m_nattr;
+
+	bool refill();
+	int get();
+	int peek();
+	void expect(char _c);
+	void skip_space();
+	void read_name(std::string& _out);
+	void read_to(const std::string& _end,std::string* _out);
+	void read_text(char _end,std::string& _out);
+	void read_entity(std::string& _out);
+	void read_tag();
+	void fail(const std::string& _msg) const;
+};
+
+
+//! Receives elements matched by a path_dispatcher
+class element_handler
+{
+public:
+	virtual ~element_handler() {}
+
+	//! Called on the start of a matching element. Handlers can read the element attributes, and either
+	//! leave the parser where it is, to have the content visited, or consume the whole element with
+	//! read_element() or skip().
+	virtual void element(pull_parser& _parser) = 0;
+};
+
+
+//! Calls handlers on the elements matching their paths as a document streams through
+/*!
+	Paths are element names separated by '/'. Absolute paths, starting with '/', match from the root
+	of the document; relative paths match the innermost elements, so "trade" matches every trade
+	element and "trades/trade" only those directly inside a trades element.
+*/
+class path_dispatcher
+{
+public:
+	//! Call _handler on the elements matching _path. Handlers are called in the order they are added,
+	//! until one consumes the element.
+	void add(const std::string& _path,element_handler& _handler);
+
+	//! Read the whole document
+	void run(pull_parser& _parser);
+
+private:
+	struct route_type
+	{
+		std::vector<std::string> names;
+		bool absolute;
+		element_handler* handler;
+	};
+
+	std::vector<route_type> m_routes;
+
+	static bool matches(const route_type& _route,const std::vector<std::string>& _elements);
+};
+
+
 } // namespace xml
 } // namespace fbox
 
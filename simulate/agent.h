@@ -13,6 +13,7 @@
 #include <fbox/random.h>
 #include <fbox/xml_utils.h>
 #include <iostream>
+#include <vector>
 
 namespace fbox {
 namespace simulate {
@@ -32,6 +33,10 @@ public:
 
 	//! Generate new deviate
 	double rnd() { return m_rnd(); }
+	double operator() () { return m_rnd(); }
+
+	//! Generate new deviate in (0,1)
+	double rnd_open() { return m_rnd.open(); }
 	
 	//! Retrieve current path weight
 	double weight() const { return m_weight; }
@@ -72,6 +77,11 @@ public:
 
 	virtual bool is_live() const = 0; //!< False if agent no longer changing
 
+	//! Called by a caller that is about to stop updating this agent because it is no longer live. Appends to
+	//! _deps, in update order, the agents that <code>update()</code> still reaches and returns true, so that
+	//! the caller can update those directly. Returns false (the default) to stay on the caller's schedule.
+	virtual bool unschedule(std::vector<basic_agent_type*>& /*_deps*/) { return false; }
+
 	//! Set initial time and perform any other operations required before starting the simulation
 	virtual void init(
 		const time_type& _start,	//!< Simulation start time
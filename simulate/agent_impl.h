@@ -26,9 +26,13 @@
 */
 
 #include <list>
+#include <map>
+#include <vector>
 #include <boost/smart_ptr.hpp>
+#include <boost/pointee.hpp>
 #include <fbox/logger.h>
 #include "agent.h"
+#include "dump.h"
 
 
 namespace fbox {
@@ -80,6 +84,13 @@ public:
 	virtual const state_type& state() const { return m_state; }
 	virtual bool is_live() const { return m_live; }
 
+	//! A stopped agent only forwards updates to the agents on its own schedule, so its caller can take those
+	virtual bool unschedule(std::vector<typename parent_type::basic_agent_type*>& _deps)
+	{
+		m_linked_policy.scheduled(_deps);
+		return true;
+	}
+
 	//! Initialise agent for simulation: Recurse all connected agentes, set starting time, then call 
 	//! <code>init_impl()</code>. Finally saves the current agent value to be recovered by <code>reset()</code>.
 	virtual void init(
@@ -167,6 +178,15 @@ struct default_delink_policy
 
 
 //! Linked object policy for a variable sized dependency list
+/*!
+	Dependents that are no longer live after an update are dropped from the update schedule for the rest
+	of the path, whether or not the agents they depend on are still live. A dropped dependent hands over
+	the agents it still updated (see <code>basic_agent::unschedule()</code>), which take its place in the
+	schedule unless an earlier entry already updates them. Every agent is therefore still updated at the
+	same point of the step as without pruning, so random drivers reached only through a matured agent
+	keep drawing and the path's random stream is unchanged. The schedule is rebuilt, in connection order,
+	on the first update after a reset or a change in the list.
+*/
 template
 <
 	typename _linked_type, //!< The linked type must support dereference operators and have pointer-like behaviour
@@ -178,10 +198,22 @@ public:
 	typedef _linked_type linked_type;
 	typedef _delink_policy delinked_policy;
 
+	typedef typename boost::pointee<linked_type>::type::basic_agent_type agent_type;
+
 	typedef std::list<linked_type> linked_list_type;
 	typedef typename linked_list_type::iterator iterator;
 	typedef typename linked_list_type::const_iterator const_iterator;
 
+	linked_list_policy() : m_step(0),m_stale(true) {}
+	linked_list_policy(const linked_list_policy& _p) : mp_linked(_p.mp_linked),m_step(0),m_stale(true) {}
+
+	linked_list_policy& operator=(const linked_list_policy& _p)
+	{
+		mp_linked = _p.mp_linked;
+		m_stale = true;
+		return *this;
+	}
+
 	~linked_list_policy()
 	{
 		delinked_policy::delink(mp_linked);
@@ -203,27 +235,63 @@ public:
 		typename linked_list_type::iterator itr = mp_linked.begin();
 		typename linked_list_type::iterator end = mp_linked.end();
 		for (; itr != end; ++itr) (*itr)->reset();
+		m_stale = true;
 	}
 
 	template<typename _time_type>
 	void update(const _time_type& _time)
 	{
-		typename linked_list_type::iterator itr = mp_linked.begin();
-		typename linked_list_type::iterator end = mp_linked.end();
-		for (; itr != end; ++itr) (*itr)->update(_time); 
+		if (m_stale)
+		{
+			m_schedule.clear();
+			m_adopted.clear();
+			typename linked_list_type::iterator itr = mp_linked.begin();
+			typename linked_list_type::iterator end = mp_linked.end();
+			for (; itr != end; ++itr) m_schedule.push_back(entry_type(&**itr,false));
+			m_step = 0;
+			m_stale = false;
+		}
+
+		++m_step;
+		m_next.clear();
+		for (size_type i = 0; i < m_schedule.size(); ++i)
+		{
+			const entry_type& e = m_schedule[i];
+			if (e.second && !place(e.first)) continue; // moved ahead by a dependent dropped earlier in this step
+
+			e.first->update(_time);
+			if (e.first->is_live() || !e.first->unschedule(m_deps)) m_next.push_back(e);
+			else adopt();
+		}
+		m_schedule.swap(m_next);
+	}
+
+	//! Append the agents updated by this policy, in update order
+	void scheduled(std::vector<agent_type*>& _agents) const
+	{
+		if (!m_stale) 
+		{
+			for (size_type i = 0; i < m_schedule.size(); ++i) _agents.push_back(m_schedule[i].first);
+			return;
+		}
+
+		typename linked_list_type::const_iterator itr = mp_linked.begin();
+		typename linked_list_type::const_iterator end = mp_linked.end();
+		for (; itr != end; ++itr) _agents.push_back(&**itr);
 	}
 
 	void clear() 
 	{
 		delinked_policy::delink(mp_linked);
 		mp_linked.clear();
+		m_stale = true;
 	}
 
-	void connect(const linked_type _agent) { mp_linked.push_back(_agent); }
+	void connect(const linked_type _agent) { mp_linked.push_back(_agent); m_stale = true; }
 
 	size_type count_connected() const { return mp_linked.size(); }
 
-	linked_list_type& dependents() { return mp_linked; }
+	linked_list_type& dependents() { m_stale = true; return mp_linked; }
 	const linked_list_type& dependents() const { return mp_linked; }
 
 	iterator begin() { return mp_linked.begin(); }
@@ -234,15 +302,42 @@ public:
 
 	void dump(std::ostream& _strm) const
 	{
-		fbox::xml::make_tag(_strm,fbox::type_id(*this,true),false).attr("ptr",this);
+		std::string n = fbox::type_id(*this,true);
+		fbox::xml::make_tag(_strm,n,false).attr("ptr",this);
 		typename linked_list_type::const_iterator itr = mp_linked.begin();
 		typename linked_list_type::const_iterator top = mp_linked.end();
-		for (; itr != top; ++itr) (*itr)->dump(_strm);
-		_strm << '>';
+		for (; itr != top; ++itr) dump_agent(_strm,**itr);
+		_strm << "</" << n << '>';
 	}
 
 protected:
 	linked_list_type mp_linked;
+
+private:
+	typedef std::pair<agent_type*,bool> entry_type;	//!< Scheduled agent, and whether it was taken over from a dropped dependent
+
+	std::vector<entry_type> m_schedule,m_next;		//!< Update schedule in the current path, and the next one being built
+	std::vector<agent_type*> m_deps;				//!< Agents handed over by a dependent being dropped
+	std::map<agent_type*,size_type> m_adopted;		//!< Agents taken over in the current path, and the last step they were placed
+	size_type m_step;								//!< Updates since the schedule was rebuilt
+	bool m_stale;									//!< Schedule must be rebuilt before the next update
+
+	//! Mark _a as placed in the next schedule. False if it already was in this step.
+	bool place(agent_type* _a)
+	{
+		size_type& step = m_adopted[_a];
+		if (step == m_step) return false;
+		step = m_step;
+		return true;
+	}
+
+	//! Put the agents handed over by a dropped dependent in its place. An agent already placed in this step
+	//! is not repeated, and one placed further down the schedule is moved up here, where it is first updated.
+	void adopt()
+	{
+		for (size_type i = 0; i < m_deps.size(); ++i) if (place(m_deps[i])) m_next.push_back(entry_type(m_deps[i],true));
+		m_deps.clear();
+	}
 };
 
 
@@ -272,6 +367,10 @@ public:
 	template<typename _time_type>
 	void update(const _time_type& _time) { mp_linked->update(_time); }
 
+	//! Append the linked agent, if any
+	template<typename _agent_type>
+	void scheduled(std::vector<_agent_type*>& _agents) const { if (mp_linked != 0) _agents.push_back(&*mp_linked); }
+
 	void clear() { delink_policy::delink(mp_linked); mp_linked = 0; }
 	void connect(const linked_type _agent) { mp_linked = _agent; }
 
@@ -282,9 +381,10 @@ public:
 	void dump(std::ostream& _strm) const
 	{
 		if (mp_linked == 0) throw error("Missing underlying agent in single_item_linked_policy");
-		fbox::xml::make_tag(_strm,fbox::type_id(*this,true),false).attr("ptr",this);
-		mp_linked->dump(_strm);
-		_strm << '>';
+		std::string n = fbox::type_id(*this,true);
+		fbox::xml::make_tag(_strm,n,false).attr("ptr",this);
+		dump_agent(_strm,*mp_linked);
+		_strm << "</" << n << '>';
 	}
 
 protected:
@@ -304,6 +404,9 @@ public:
 	template<typename _time_type>
 	void update(const _time_type& _time) {}
 
+	template<typename _agent_type>
+	void scheduled(std::vector<_agent_type*>& /*_agents*/) const {}
+
 	size_type count_connected() const { return 0; }
 
 	void dump(std::ostream& _strm) const {}
@@ -74,12 +74,13 @@ class curve
 :	public standalone_cached_agent_impl<double>
 {
 public:
-	void setup(shared_ptr<math::line> _line) { mp_line = _line; }
+	void setup(shared_ptr<math::line> _line) { mp_line = _line; m_hint = -1; }
 
 protected:
 	shared_ptr<math::line> mp_line;
-	virtual void reset_impl() { m_state = (*mp_line)(time()); }
-	virtual bool update_impl() { m_state = (*mp_line)(time()); return true; }
+	int m_hint; //!< Last segment looked up, times only move forward
+	virtual void reset_impl() { m_state = (*mp_line)(time(),m_hint); }
+	virtual bool update_impl() { m_state = (*mp_line)(time(),m_hint); return true; }
 };
 
 
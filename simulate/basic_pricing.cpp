@@ -8,6 +8,7 @@
 
 #include "basic_pricing.h"
 #include "../core/option.h"
+#include "../core/random.h"
 
 namespace fbox {
 namespace simulate {
@@ -227,42 +228,35 @@ void portfolio_events::init_impl()
 }
 
 
+namespace {
+
+//! Uniform source in (0,1) from a generator: an exact 1 would send the inversion to the top of the support
+struct open_uniform
+{
+	open_uniform(generator* _rnd) : rnd(_rnd) {}
+	double operator() () { return rnd->rnd_open(); }
+	generator* rnd;
+};
+
+} // namespace
+
+
 bool portfolio_events::update_impl()
 {
 	size_type n0 = mp_counter->state();
 	double dt = time_interval() / 365.0;
 	double h = mp_h->state();
-	
-	// dp		event probability of each individual name since the last update
-	// p0k		probability of 0,1,... or k events (k starts at 0)
-	// ln0k		logarithm of the p0k
-	// pk1		probability of k+1 or more events
-	
-	size_type n = n0;
-	double dp = 1.0 - std::exp(-h*dt);
-	double ln0k = n * std::log(1.0 - dp);
-	double p0k = ln0k > -20.0 ? std::exp(ln0k) : 0.0;
-	double pk1 = 1. - p0k;
 
-	// check events while there are still survivors and event probability is higher than 1e-5
-	while (n && pk1 > 1e-5)
-	{
-		// no event, stop recursion
-		if (rnd() > pk1) break;
-
-		// probability for next recursion step
-		ln0k += std::log( n * dp / (n0 - n + 1.0) / (1.0 - dp) );
-		if (ln0k > -20.0) // slight improvement in efficiency from avoiding recalculation of exp
-		{
-			p0k += std::exp(ln0k); // WARNING!!! can't understand why += (instead of =) seems to work
-			pk1 = 1.0 - p0k;
-		}
-
-		n += m_impact;
-	}
+	// each surviving name has an event since the last update with probability dp, so the number of
+	// events is exactly binomial
+	double dp = 1.0 - std::exp(-h*dt);
+	open_uniform u(mp_rnd);
+	long k = math::binomial_deviate(n0,dp,u);
+	long n = long(n0) + m_impact * k;
+	if (n < 0) n = 0;
 
-	mp_counter->setup(n);
-	m_state = n0 - n;
+	mp_counter->setup(size_type(n));
+	m_state = n0 - size_type(n);
 
 	return true;
 }
@@ -110,11 +110,9 @@ protected:
 
 //! Size of a portfolio of names subject to termination events (default, death, etc.) 
 /*!
-	Events are determined using a recursion that tests for the probability of 1 or more 
-	events, then if that suceeds, for the probability of 2 or more and so on up until such 
-	a test fails. It is best suited to small portfolios or very unlikely events and not 
-	very efficient for large N.p1 values, where N is the size of the portfolio and p1 the 
-	individual event probability.
+	The number of events in each step is drawn exactly from the binomial distribution of N
+	names with individual event probability p1 (see math::binomial_deviate). The expected
+	cost per step does not grow with N or p1.
 
 	The agent's state carries information on how many events have accured in the last time
 	step. The counting process retains the information on how many names survive at each
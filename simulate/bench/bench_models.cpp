@@ -0,0 +1,139 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Timings of model agents
+*/
+
+
+#include <ctime>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include <fbox/option.h>
+#include "../basic_agents.h"
+#include "../models.h"
+#include "../pipeline.h"
+
+
+using namespace fbox::simulate;
+
+
+BOOST_AUTO_TEST_CASE(bench_pipeline)
+{
+	const int steps = 200000;
+
+	boost::shared_ptr<gaussian_variate> g( new gaussian_variate );
+	boost::shared_ptr<basic_lognormal> x( new basic_lognormal );
+	x->setup(g,0.05,0.2,100.0);
+
+	typedef chain<uniform_stage,chain<normal_stage,lognormal_stage> > gbm_stages;
+	boost::shared_ptr<pipeline<gbm_stages> > p( new pipeline<gbm_stages> );
+	p->stages().second().second().setup(0.05,0.2,100.0);
+
+	generator rnd1,rnd2;
+	rnd1.set_seed(1234);
+	rnd2.set_seed(1234);
+	x->init(0,steps,&rnd1);
+	p->init(0,steps,&rnd2);
+	x->reset();
+	p->reset();
+
+	// both spend most of each step in the inverse normal distribution, see bench_pipeline_dispatch for the links
+	std::clock_t c0 = std::clock();
+	for(int i = 1; i <= steps; ++i) x->update(i);
+	std::clock_t c1 = std::clock();
+	for(int i = 1; i <= steps; ++i) p->update(i);
+	std::clock_t c2 = std::clock();
+
+	BOOST_CHECK_EQUAL(p->state(),x->state());
+	BOOST_MESSAGE("Lognormal steps: " << 1e9 * double(c1 - c0) / CLOCKS_PER_SEC / steps << "ns linked, "
+		<< 1e9 * double(c2 - c1) / CLOCKS_PER_SEC / steps << "ns in a pipeline");
+}
+
+
+//! Normal deviates replayed from a table, so that timings leave out the inverse distribution
+class normal_table
+:	public standalone_agent_impl<double>
+{
+public:
+	void setup(const std::vector<double>* _values) { mp_values = _values; m_next = 0; }
+
+protected:
+	const std::vector<double>* mp_values;
+	std::size_t m_next;
+
+	virtual void reset_impl() { m_next = 0; }
+	virtual bool update_impl() { m_state = (*mp_values)[m_next++ % mp_values->size()]; return true; }
+};
+
+
+//! Linked counterpart of payoff_stage
+class payoff_agent
+:	public single_agent_impl<double>
+{
+public:
+	void setup(double_agent_ptr _underlying,char _call_put,double _strike)
+	{
+		connect(mp_underlying = _underlying);
+		m_cp = _call_put;
+		m_strike = _strike;
+	}
+
+protected:
+	double_agent_ptr mp_underlying;
+	char m_cp;
+	double m_strike;
+
+	virtual void init_impl() { update_impl(); }
+	virtual bool update_impl() { m_state = fbox::finance::option_intrinsic(m_cp,m_strike,mp_underlying->state(),1.0); return true; }
+};
+
+
+BOOST_AUTO_TEST_CASE(bench_pipeline_dispatch)
+{
+	const int steps = 2000000;
+
+	std::vector<double> normals;
+	generator rnd;
+	rnd.set_seed(1234);
+	boost::math::normal dist;
+	for(int i = 0; i < 4096; ++i) normals.push_back(boost::math::quantile(dist,rnd.rnd()));
+
+	// diffusions and a payoff as linked agents, and as stages of one agent, fed by the same deviates.
+	// Each diffusion is driven by the one before it, so every stage is a multiply-add or two.
+	boost::shared_ptr<normal_table> n1( new normal_table ),n2( new normal_table );
+	n1->setup(&normals);
+	n2->setup(&normals);
+
+	boost::shared_ptr<basic_diffusion> x1( new basic_diffusion ),x2( new basic_diffusion ),x3( new basic_diffusion );
+	x1->setup(n1,0.0,1.0);
+	x2->setup(x1,0.0,1.0);
+	x3->setup(x2,0.0,1.0,100.0);
+	boost::shared_ptr<payoff_agent> c( new payoff_agent );
+	c->setup(x3,'c',100.0);
+
+	typedef chain<diffusion_stage,chain<diffusion_stage,chain<diffusion_stage,payoff_stage> > > call_stages;
+	boost::shared_ptr<pipeline<call_stages> > p( new pipeline<call_stages> );
+	p->set_source(n2);
+	p->stages().first().setup(0.0,1.0);
+	p->stages().second().first().setup(0.0,1.0);
+	p->stages().second().second().first().setup(0.0,1.0,100.0);
+	p->stages().second().second().second().setup('c',100.0);
+
+	generator rnd1,rnd2;
+	c->init(0,steps,&rnd1);
+	p->init(0,steps,&rnd2);
+	c->reset();
+	p->reset();
+
+	std::clock_t c0 = std::clock();
+	for(int i = 1; i <= steps; ++i) c->update(i);
+	std::clock_t c1 = std::clock();
+	for(int i = 1; i <= steps; ++i) p->update(i);
+	std::clock_t c2 = std::clock();
+
+	BOOST_CHECK_CLOSE(p->state(),c->state(),1e-9);
+	BOOST_MESSAGE("Three diffusions and a payoff from tabulated normals: " << 1e9 * double(c1 - c0) / CLOCKS_PER_SEC / steps
+		<< "ns linked (5 agents), " << 1e9 * double(c2 - c1) / CLOCKS_PER_SEC / steps << "ns in a pipeline (2 agents)");
+}
@@ -0,0 +1,10 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Master benchmark file. Timings are reported as messages: run with --log_level=message
+*/
+
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
@@ -94,6 +94,9 @@ public:
 		m_itr = m_cache.insert(m_itr,cached_type(_time,m_state,m_live));
 	}
 
+	//! A stopped cached agent does not update its dependents any more
+	virtual bool unschedule(std::vector<typename parent_type::basic_agent_type*>& /*_deps*/) { return true; }
+
 protected:
 	struct cached_type
 	{
@@ -6,6 +6,7 @@
 	Coupon instrument agents
 */
 
+#include <algorithm>
 #include "coupon_instruments.h"
 
 
@@ -52,7 +53,7 @@ void fixed_payment::setup(
 
 	m_amount = _amount;
 	
-	time_type t;
+	time_type t = time_type();
 	coupon_impl::setup(t,t,t,_pay,1.0);
 }
 
@@ -104,7 +105,7 @@ void fixed_coupon::setup(
 
 	m_amount = _rate * _year_fraction;
 
-	time_type t;
+	time_type t = time_type();
 	coupon_impl::setup(t,_start,_end,_pay,_year_fraction);
 }
 
@@ -226,6 +227,226 @@ bool float_coupon::update_impl()
 }
 
 
+
+//////////////////////////////////////////////////////
+// coupon_leg
+//////////////////////////////////////////////////////
+
+namespace {
+
+//! Orders coupon indices by payment date
+template<typename _time_type>
+struct pay_order
+{
+	pay_order(const std::vector<_time_type>& _pay) : pay(_pay) {}
+	bool operator() (size_type _a,size_type _b) const { return pay[_a] < pay[_b]; }
+	const std::vector<_time_type>& pay;
+};
+
+//! Apply permutation _order to _v
+template<typename _type>
+void permute(std::vector<_type>& _v,const std::vector<size_type>& _order)
+{
+	std::vector<_type> tmp;
+	tmp.reserve(_v.size());
+	for(size_type i = 0; i < _order.size(); ++i) tmp.push_back(_v[_order[i]]);
+	_v.swap(tmp);
+}
+
+} // namespace
+
+
+void coupon_leg::setup(yield_curve_ptr _yc)
+{
+	mp_yc = _yc;
+	clear();
+}
+
+
+void coupon_leg::clear()
+{
+	clear_connected();
+	if (mp_yc) connect(mp_yc);
+
+	m_type.clear();
+	m_fix.clear();
+	m_accrual_start.clear();
+	m_accrual_end.clear();
+	m_pay.clear();
+	m_year_fraction.clear();
+	m_multiplier.clear();
+	m_amount.clear();
+	m_index.clear();
+	m_fixed.clear();
+}
+
+
+size_type coupon_leg::size() const
+{
+	return m_pay.size();
+}
+
+
+void coupon_leg::add_payment(
+	const time_type& _pay,
+	double _amount)
+{
+	time_type t = time_type();
+	add(FIXED,t,t,t,_pay,1.0,0.0,_amount);
+}
+
+
+void coupon_leg::add_fixed(
+	const time_type& _start,
+	const time_type& _end,
+	const time_type& _pay,
+	double _rate,
+	double _year_fraction)
+{
+	add(FIXED,time_type(),_start,_end,_pay,_year_fraction,0.0,_rate * _year_fraction);
+}
+
+
+void coupon_leg::add_float(
+	const time_type& _fix,
+	const time_type& _start,
+	const time_type& _end,
+	const time_type& _pay,
+	double _multiplier,
+	double _year_fraction)
+{
+	add(VANILLA,_fix,_start,_end,_pay,_year_fraction,_multiplier,0.0);
+}
+
+
+void coupon_leg::add_float(
+	const time_type& _fix,
+	const time_type& _start,
+	const time_type& _end,
+	const time_type& _pay,
+	double_agent_ptr _index,
+	double _multiplier,
+	double _year_fraction)
+{
+	if (!_index) throw fbox::error("Missing index in coupon_leg");
+	add(INDEXED,_fix,_start,_end,_pay,_year_fraction,_multiplier,0.0,_index);
+	connect(_index);
+}
+
+
+void coupon_leg::add(
+	coupon_type _type,
+	const time_type& _fix,
+	const time_type& _start,
+	const time_type& _end,
+	const time_type& _pay,
+	double _year_fraction,
+	double _multiplier,
+	double _amount,
+	double_agent_ptr _index)
+{
+	if (_pay < _fix) throw fbox::error("Payment date before fixing");
+	if (_end < _start) throw fbox::error("Accrual end date before start");
+
+	m_type.push_back(_type);
+	m_fix.push_back(_fix);
+	m_accrual_start.push_back(_start);
+	m_accrual_end.push_back(_end);
+	m_pay.push_back(_pay);
+	m_year_fraction.push_back(_year_fraction);
+	m_multiplier.push_back(_multiplier);
+	m_amount.push_back(_amount);
+	m_index.push_back(_index);
+	m_fixed.push_back(_type == FIXED);
+}
+
+
+void coupon_leg::init_impl()
+{
+	if (!mp_yc) throw fbox::error("coupon_leg agent not set correctly");
+
+	for(size_type i = 0; i < size(); ++i)
+		if (m_type[i] != FIXED && m_fix[i] < m_start) throw fbox::error("fixing date set before simulation start date in coupon_leg");
+
+	// sort coupons by payment date, so that settled coupons are always a prefix of the arrays
+	std::vector<size_type> order(size());
+	for(size_type i = 0; i < order.size(); ++i) order[i] = i;
+	std::stable_sort(order.begin(),order.end(),pay_order<time_type>(m_pay));
+
+	permute(m_type,order);
+	permute(m_fix,order);
+	permute(m_accrual_start,order);
+	permute(m_accrual_end,order);
+	permute(m_pay,order);
+	permute(m_year_fraction,order);
+	permute(m_multiplier,order);
+	permute(m_amount,order);
+	permute(m_index,order);
+	permute(m_fixed,order);
+
+	m_df.resize(size());
+	m_state.clear();
+}
+
+
+void coupon_leg::reset_impl()
+{
+	m_next = 0;
+	for(size_type i = 0; i < size(); ++i) m_fixed[i] = (m_type[i] == FIXED);
+	update_impl();
+}
+
+
+bool coupon_leg::update_impl()
+{
+	if (m_state.matured)
+	{
+		m_state.flow = m_state.value = 0.0;
+		return false;
+	}
+
+	// settle coupons paid since the last update
+	m_state.flow = 0.0;
+	for(; m_next < size() && is_paid(m_next); ++m_next) m_state.flow += m_amount[m_next];
+
+	size_type n = size() - m_next;
+	if (n == 0)
+	{
+		m_state.value = 0.0;
+		m_state.matured = true;
+		return true;
+	}
+
+	// set floating amounts still open
+	for(size_type i = m_next; i < size(); ++i)
+	{
+		if (m_fixed[i]) continue;
+
+		if (m_type[i] == INDEXED)
+			m_amount[i] = m_index[i]->state() * m_multiplier[i] * m_year_fraction[i];
+		else
+			m_amount[i] = m_multiplier[i] * (mp_yc->discount(m_accrual_start[i]) / mp_yc->discount(m_accrual_end[i]) - 1.0) * m_year_fraction[i];
+
+		if (m_time + 0.1 >= m_fix[i]) m_fixed[i] = true;
+	}
+
+	mp_yc->discount(&m_pay[m_next],&m_df[0],n);
+
+	double v = 0.0;
+	for(size_type i = 0; i < n; ++i) v += m_amount[m_next + i] * m_df[i];
+	m_state.value = v;
+
+	return true;
+}
+
+
+bool coupon_leg::is_paid(size_type _i) const
+{
+	return m_type[_i] == FIXED ? m_time >= m_pay[_i] : m_time + 0.1 >= m_pay[_i];
+}
+
+
+
 } // namespace instruments
 } // namespace simulate
 } // namespace fbox
@@ -8,6 +8,7 @@
 	Coupon instrument agents
 */
 
+#include <vector>
 #include <fbox/main.h>
 #include "instruments.h"
 
@@ -124,6 +125,98 @@ protected:
 
 
 
+
+//! Coupon leg priced as a single agent
+/*!
+	Equivalent to a portfolio of fixed_payment, fixed_coupon, vanilla_float_coupon and float_coupon
+	agents with unit weights, with the coupon terms held in parallel arrays sorted by payment date
+	instead. Each step advances a cursor over the coupons paid since the last update, fixes any floating
+	rates still open and discounts all outstanding payments with a single batch call to the curve.
+*/
+class coupon_leg
+:	public instrument_agent
+{
+public:
+	void setup(yield_curve_ptr _yc);
+
+	//! Remove all coupons
+	void clear();
+
+	//! Number of coupons
+	size_type size() const;
+
+	//! Fixed amount paid at _pay (as fixed_payment)
+	void add_payment(
+		const time_type& _pay,
+		double _amount);
+
+	//! Fixed rate coupon (as fixed_coupon)
+	void add_fixed(
+		const time_type& _start,
+		const time_type& _end,
+		const time_type& _pay,
+		double _rate,
+		double _year_fraction);
+
+	//! Floating coupon on the curve's own forward rate (as vanilla_float_coupon)
+	void add_float(
+		const time_type& _fix,
+		const time_type& _start,
+		const time_type& _end,
+		const time_type& _pay,
+		double _multiplier,
+		double _year_fraction);
+
+	//! Floating coupon on a generic index (as float_coupon)
+	void add_float(
+		const time_type& _fix,
+		const time_type& _start,
+		const time_type& _end,
+		const time_type& _pay,
+		double_agent_ptr _index,
+		double _multiplier,
+		double _year_fraction);
+
+protected:
+	enum coupon_type
+	{
+		FIXED = 'f',
+		VANILLA = 'v',
+		INDEXED = 'i'
+	};
+
+	yield_curve_ptr mp_yc;
+
+	std::vector<char> m_type;
+	std::vector<time_type> m_fix,m_accrual_start,m_accrual_end,m_pay;
+	std::vector<double> m_year_fraction,m_multiplier,m_amount;
+	std::vector<double_agent_ptr> m_index;	//!< Null unless the coupon is INDEXED
+	std::vector<char> m_fixed;				//!< True once the coupon amount is set for good
+
+	size_type m_next;						//!< First coupon not yet paid
+	std::vector<double> m_df;				//!< Discount factor buffer
+
+	virtual void init_impl();
+	virtual void reset_impl();
+	virtual bool update_impl();
+
+private:
+	void add(
+		coupon_type _type,
+		const time_type& _fix,
+		const time_type& _start,
+		const time_type& _end,
+		const time_type& _pay,
+		double _year_fraction,
+		double _multiplier,
+		double _amount,
+		double_agent_ptr _index = double_agent_ptr());
+
+	bool is_paid(size_type _i) const;
+};
+
+
+
 } // namespace instruments
 } // namespace simulate
 } // namespace fbox
@@ -0,0 +1,112 @@
+#ifndef __FBOX_SIMULATE_DUMP_H__
+#define __FBOX_SIMULATE_DUMP_H__
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Introspection of whole agent graphs
+*/
+
+#include <ostream>
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include <fbox/main.h>
+#include <fbox/xml_utils.h>
+
+namespace fbox {
+namespace simulate {
+
+
+//! Agents written so far by dump_graph(), attached to the output stream while it runs
+class dump_context
+{
+public:
+	explicit dump_context(std::ios_base& _strm) : mr_strm(_strm),mp_prev(_strm.pword(index()))
+	{
+		_strm.pword(index()) = this;
+	}
+
+	~dump_context() { mr_strm.pword(index()) = mp_prev; }
+
+	//! Context attached to _strm, if any
+	static dump_context* get(std::ios_base& _strm) { return static_cast<dump_context*>(_strm.pword(index())); }
+
+	//! Id of _agent, and true if it was not written before
+	std::pair<size_type,bool> visit(const void* _agent)
+	{
+		std::pair<id_map::iterator,bool> r = m_ids.insert(id_map::value_type(_agent,m_ids.size() + 1));
+		return std::make_pair(r.first->second,r.second);
+	}
+
+private:
+	typedef boost::unordered_map<const void*,size_type> id_map;
+
+	std::ios_base& mr_strm;
+	void* mp_prev;
+	id_map m_ids;
+
+	static int index() { static const int i = std::ios_base::xalloc(); return i; }
+
+	dump_context(const dump_context&);
+	dump_context& operator=(const dump_context&);
+};
+
+
+//! Dump a dependency of an agent. Inside dump_graph() each agent is written once, in an element
+//! holding its id, and later occurrences are written as references to that id. Elsewhere this is
+//! the same as calling dump().
+template<typename _agent_type>
+void dump_agent(std::ostream& _strm,const _agent_type& _agent)
+{
+	dump_context* c = dump_context::get(_strm);
+	if (!c)
+	{
+		_agent.dump(_strm);
+		return;
+	}
+
+	std::pair<size_type,bool> v = c->visit(dynamic_cast<const void*>(&_agent));
+	if (!v.second)
+	{
+		fbox::xml::make_tag(_strm,"ref").attr("id",v.first);
+		return;
+	}
+
+	fbox::xml::make_tag(_strm,"agent",false).attr("id",v.first);
+
+	_agent.dump(_strm);
+	_strm << "</agent>";
+}
+
+
+//! Write the agents reachable from _roots as an XML document, each agent once
+/*!
+	Agents are written as they are visited, so the only memory used is the table of agents already
+	written. Shared dependencies appear in full where they are first reached and as
+	<code>&lt;ref id="..."/&gt;</code> everywhere else.
+*/
+template<typename _agent_ptr>
+void dump_graph(std::ostream& _strm,const std::vector<_agent_ptr>& _roots)
+{
+	dump_context context(_strm);
+
+	_strm << "<?xml version=\"1.0\" ?><graph>";
+	for(size_type i = 0; i < _roots.size(); ++i) dump_agent(_strm,*_roots[i]);
+	_strm << "</graph>";
+}
+
+
+//! Single root version of the above
+template<typename _agent_ptr>
+void dump_graph(std::ostream& _strm,const _agent_ptr& _root)
+{
+	dump_graph(_strm,std::vector<_agent_ptr>(1,_root));
+}
+
+
+
+} // namespace simulate
+} // namespace fbox
+
+#endif
@@ -0,0 +1,357 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Build expressions from text formulas
+*/
+
+#include <cctype>
+#include <cstdlib>
+#include "expression_parser.h"
+
+namespace fbox {
+namespace simulate {
+
+
+//////////////////////////////////////////////////////
+// expression_parser
+//////////////////////////////////////////////////////
+
+namespace {
+
+const std::string no_token;
+
+bool is_number(const std::string& _s,double& _value)
+{
+	const char* begin = _s.c_str();
+	char* end = 0;
+	_value = std::strtod(begin,&end);
+	return !_s.empty() && end == begin + _s.size();
+}
+
+} // namespace
+
+
+bool expression_parser::node_key::operator<(const node_key& _k) const
+{
+	if (kind != _k.kind) return kind < _k.kind;
+	if (name != _k.name) return name < _k.name;
+	if (value != _k.value) return value < _k.value;
+	for(int i = 0; i < 3; ++i) if (arg[i] != _k.arg[i]) return arg[i] < _k.arg[i];
+	return false;
+}
+
+
+void expression_parser::define(const std::string& _name,double_agent_ptr _agent)
+{
+	if (!_agent) throw error("Null agent defined as '" + _name + "' in expression_parser");
+	m_constants.erase(_name);
+	m_agents[_name] = _agent;
+}
+
+
+void expression_parser::define(const std::string& _name,double _value)
+{
+	m_agents.erase(_name);
+	m_constants[_name] = _value;
+}
+
+
+expression_parser::expr_ptr expression_parser::parse(const std::string& _formula)
+{
+	tokenise(_formula);
+
+	expr_ptr e = comparison();
+	if (m_pos != m_tokens.size()) throw error("Unexpected '" + peek() + "' in formula '" + _formula + "'");
+
+	use(e);
+	return e;
+}
+
+
+size_type expression_parser::shared() const
+{
+	size_type n = 0;
+	for(node_map::const_iterator itr = m_nodes.begin(); itr != m_nodes.end(); ++itr)
+	{
+		shared_expression* s = dynamic_cast<shared_expression*>(itr->second.get());
+		if (s && s->is_shared()) ++n;
+	}
+	return n;
+}
+
+
+void expression_parser::clear()
+{
+	m_nodes.clear();
+	m_uses.clear();
+	m_used.clear();
+}
+
+
+void expression_parser::use(const expr_ptr& _e)
+{
+	shared_expression* s = dynamic_cast<shared_expression*>(_e.get());
+	if (s && ++m_uses[s] > 1) s->set_shared(true);
+}
+
+
+void expression_parser::tokenise(const std::string& _formula)
+{
+	// not fbox::tokeniser or buffer_tokeniser: they skip runs of dividers, so operators next to each
+	// other (S*-K, a<=b) would be lost, and they would split numbers such as 1e-2 at the sign
+	static const std::string symbols("+-*/^(),<>=!");
+
+	m_tokens.clear();
+	m_pos = 0;
+
+	size_type i = 0,n = _formula.size();
+	while (i < n)
+	{
+		char c = _formula[i];
+
+		if (std::isspace(static_cast<unsigned char>(c)))
+		{
+			++i;
+		}
+		else if (std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+		{
+			const char* begin = _formula.c_str() + i;
+			char* end = 0;
+			std::strtod(begin,&end);
+			if (end == begin) throw error("Malformed number in formula '" + _formula + "'");
+			m_tokens.push_back(std::string(begin,static_cast<const char*>(end)));
+			i += end - begin;
+		}
+		else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_')
+		{
+			size_type j = i + 1;
+			while (j < n && (std::isalnum(static_cast<unsigned char>(_formula[j])) || _formula[j] == '_')) ++j;
+			m_tokens.push_back(_formula.substr(i,j - i));
+			i = j;
+		}
+		else if (symbols.find(c) != std::string::npos)
+		{
+			// two character comparisons
+			size_type len = (i + 1 < n && _formula[i+1] == '=' && std::string("<>=!").find(c) != std::string::npos) ? 2 : 1;
+			m_tokens.push_back(_formula.substr(i,len));
+			i += len;
+		}
+		else
+		{
+			throw error("Unexpected character '" + std::string(1,c) + "' in formula '" + _formula + "'");
+		}
+	}
+}
+
+
+const std::string& expression_parser::peek() const
+{
+	return m_pos < m_tokens.size() ? m_tokens[m_pos] : no_token;
+}
+
+
+std::string expression_parser::take()
+{
+	if (m_pos == m_tokens.size()) throw error("Unexpected end of formula");
+	return m_tokens[m_pos++];
+}
+
+
+void expression_parser::expect(const std::string& _token)
+{
+	if (take() != _token) throw error("Expected '" + _token + "' in formula");
+}
+
+
+expression_parser::expr_ptr expression_parser::comparison()
+{
+	expr_ptr a = additive();
+
+	const std::string& op = peek();
+	if (op == "<" || op == "<=" || op == ">" || op == ">=" || op == "==" || op == "!=")
+	{
+		std::string o = take();
+		a = apply(o,a,additive());
+	}
+
+	return a;
+}
+
+
+expression_parser::expr_ptr expression_parser::additive()
+{
+	expr_ptr a = multiplicative();
+	while (peek() == "+" || peek() == "-")
+	{
+		std::string o = take();
+		a = apply(o,a,multiplicative());
+	}
+	return a;
+}
+
+
+expression_parser::expr_ptr expression_parser::multiplicative()
+{
+	expr_ptr a = unary();
+	while (peek() == "*" || peek() == "/")
+	{
+		std::string o = take();
+		a = apply(o,a,unary());
+	}
+	return a;
+}
+
+
+expression_parser::expr_ptr expression_parser::unary()
+{
+	if (peek() == "-")
+	{
+		take();
+		return apply("neg",unary());
+	}
+
+	if (peek() == "+") take();
+	return power();
+}
+
+
+expression_parser::expr_ptr expression_parser::power()
+{
+	expr_ptr a = primary();
+	if (peek() == "^")
+	{
+		take();
+		a = apply("^",a,unary());
+	}
+	return a;
+}
+
+
+expression_parser::expr_ptr expression_parser::primary()
+{
+	std::string t = take();
+
+	if (t == "(")
+	{
+		expr_ptr e = comparison();
+		expect(")");
+		return e;
+	}
+
+	double v;
+	if (is_number(t,v)) return constant(v);
+
+	if (peek() == "(")
+	{
+		take();
+		return call(t);
+	}
+
+	return variable(t);
+}
+
+
+expression_parser::expr_ptr expression_parser::call(const std::string& _name)
+{
+	std::vector<expr_ptr> args;
+	if (peek() != ")")
+	{
+		args.push_back(comparison());
+		while (peek() == ",")
+		{
+			take();
+			args.push_back(comparison());
+		}
+	}
+	expect(")");
+
+	size_type n = 0;
+	if (_name == "exp" || _name == "log" || _name == "sqrt" || _name == "abs") n = 1;
+	else if (_name == "max" || _name == "min" || _name == "pow") n = 2;
+	else if (_name == "if") n = 3;
+	else throw error("Unknown function '" + _name + "' in formula");
+
+	if (args.size() != n) throw error("Wrong number of arguments to '" + _name + "' in formula");
+
+	args.resize(3);
+	return apply(_name == "pow" ? std::string("^") : _name,args[0],args[1],args[2]);
+}
+
+
+expression_parser::expr_ptr expression_parser::constant(double _value)
+{
+	node_key key('c',std::string(),_value);
+	node_map::iterator itr = m_nodes.find(key);
+	if (itr != m_nodes.end()) return itr->second;
+
+	expr_ptr e( new constant_expression<double>(_value) );
+	m_nodes.insert(std::make_pair(key,e));
+	return e;
+}
+
+
+expression_parser::expr_ptr expression_parser::variable(const std::string& _name)
+{
+	std::map<std::string,double>::const_iterator c = m_constants.find(_name);
+	if (c != m_constants.end()) return constant(c->second);
+
+	std::map<std::string,double_agent_ptr>::const_iterator a = m_agents.find(_name);
+	if (a == m_agents.end()) throw error("Undefined name '" + _name + "' in formula");
+
+	node_key key('v',std::string(),0.0,a->second.get());
+	node_map::iterator itr = m_nodes.find(key);
+	if (itr != m_nodes.end()) return itr->second;
+
+	expr_ptr e( new state_linked_expression<double_agent>(a->second) );
+	m_nodes.insert(std::make_pair(key,e));
+	m_used.push_back(a->second);
+	return e;
+}
+
+
+expression_parser::expr_ptr expression_parser::apply(const std::string& _op,expr_ptr _a,expr_ptr _b,expr_ptr _c)
+{
+	using namespace operators;
+	typedef shared_ptr<basic_expression<bool> > bool_ptr;
+
+	// hash-consing: the same operation on the same nodes is the same node, with the same arguments
+	node_key key('o',_op,0.0,_a.get(),_b.get(),_c.get());
+	node_map::iterator itr = m_nodes.find(key);
+	if (itr != m_nodes.end()) return itr->second;
+
+	expr_ptr e;
+	if (_op == "+") e.reset( new binary_expression<sum>(_a,_b) );
+	else if (_op == "-") e.reset( new binary_expression<difference>(_a,_b) );
+	else if (_op == "*") e.reset( new binary_expression<product>(_a,_b) );
+	else if (_op == "/") e.reset( new binary_expression<division>(_a,_b) );
+	else if (_op == "^") e.reset( new binary_expression<operators::power>(_a,_b) );
+	else if (_op == "neg") e.reset( new unary_expression<negate>(_a) );
+	else if (_op == "exp") e.reset( new unary_expression<natural_exponent>(_a) );
+	else if (_op == "log") e.reset( new unary_expression<natural_logarithm>(_a) );
+	else if (_op == "sqrt") e.reset( new unary_expression<square_root>(_a) );
+	else if (_op == "abs") e.reset( new unary_expression<absolute_value>(_a) );
+	else if (_op == "max") e.reset( new binary_expression<maximum>(_a,_b) );
+	else if (_op == "min") e.reset( new binary_expression<minimum>(_a,_b) );
+	else if (_op == "<") e.reset( new expression_converter<bool,double>(bool_ptr( new binary_expression<less_than>(_a,_b) )) );
+	else if (_op == "<=") e.reset( new expression_converter<bool,double>(bool_ptr( new binary_expression<less_or_equal>(_a,_b) )) );
+	else if (_op == ">") e.reset( new expression_converter<bool,double>(bool_ptr( new binary_expression<greater_than>(_a,_b) )) );
+	else if (_op == ">=") e.reset( new expression_converter<bool,double>(bool_ptr( new binary_expression<greater_or_equal>(_a,_b) )) );
+	else if (_op == "==") e.reset( new expression_converter<bool,double>(bool_ptr( new binary_expression<equal>(_a,_b) )) );
+	else if (_op == "!=") e.reset( new expression_converter<bool,double>(bool_ptr( new binary_expression<not_equal>(_a,_b) )) );
+	else if (_op == "if") e.reset( new select<double>(bool_ptr( new expression_converter<double,bool>(_a) ),_b,_c) );
+	else throw error("Unknown operator '" + _op + "' in formula");
+
+	use(_a);
+	if (_b) use(_b);
+	if (_c) use(_c);
+
+	e.reset( new shared_expression(e) );
+	m_nodes.insert(std::make_pair(key,e));
+	return e;
+}
+
+
+} // namespace simulate
+} // namespace fbox
@@ -0,0 +1,132 @@
+#ifndef __FBOX_SIMULATE_EXPRESSION_PARSER_H__
+#define __FBOX_SIMULATE_EXPRESSION_PARSER_H__
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Build expressions from text formulas
+*/
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fbox/main.h>
+#include "expressions.h"
+
+namespace fbox {
+namespace simulate {
+
+
+//! Parse text formulas into expressions
+/*!
+	Formulas refer to agents and constants by the names they are defined with, and may use
+	<code>+ - * / ^</code>, the comparisons <code>< <= > >= == !=</code> (1 if true, 0 otherwise),
+	parentheses and the functions <code>exp log sqrt abs max min pow if</code>, where
+	<code>if(c,a,b)</code> only evaluates the branch selected by c.
+
+	Nodes are hash-consed: the same subexpression, in the same or in any later formula from the same
+	parser, is always the same node. Nodes used more than once, as arguments of different nodes or as
+	formulas, are marked shared (see shared_expression) and are evaluated once per init, reset or update
+	by the expression agents. A node found again only under the same parent is not shared.
+
+	<code>
+	expression_parser parser;
+	parser.define("S",spot);
+	parser.define("K",100.0);
+	parser.define("df",discount);
+
+	multi_expression_agent payoff;
+	payoff.setup(2);
+	payoff.set_all(0,parser.parse("max(S-K,0)*df"));
+	payoff.set_all(1,parser.parse("max(S-K,0)>0"));
+	parser.connect(payoff);
+	</code>
+*/
+class expression_parser
+{
+public:
+	typedef shared_ptr<basic_expression<double> > expr_ptr;
+
+	//! Name the state of _agent
+	void define(const std::string& _name,double_agent_ptr _agent);
+
+	//! Name a constant
+	void define(const std::string& _name,double _value);
+
+	//! Expression for _formula
+	expr_ptr parse(const std::string& _formula);
+
+	//! Connect all the agents referenced so far to _agent
+	template<typename _agent_type>
+	void connect(_agent_type& _agent) const
+	{
+		for(size_type i = 0; i < m_used.size(); ++i) _agent.linked().connect(m_used[i]);
+	}
+
+	//! Number of distinct nodes built so far
+	size_type size() const { return m_nodes.size(); }
+
+	//! Number of those nodes that are shared
+	size_type shared() const;
+
+	//! Forget all nodes (names are kept)
+	void clear();
+
+private:
+	//! Node identity: kind, operator name and the identity of the arguments
+	struct node_key
+	{
+		char kind;
+		std::string name;
+		double value;
+		const void* arg[3];
+
+		node_key(char _kind,const std::string& _name,double _value = 0.0,const void* _a = 0,const void* _b = 0,const void* _c = 0)
+		:	kind(_kind),name(_name),value(_value)
+		{
+			arg[0] = _a;
+			arg[1] = _b;
+			arg[2] = _c;
+		}
+
+		bool operator<(const node_key& _k) const;
+	};
+
+	typedef std::map<node_key,expr_ptr> node_map;
+
+	std::map<std::string,double_agent_ptr> m_agents;
+	std::map<std::string,double> m_constants;
+	std::vector<double_agent_ptr> m_used;
+	node_map m_nodes;
+	std::map<const shared_expression*,size_type> m_uses;	//!< Number of parents of each node, formulas included
+
+	std::vector<std::string> m_tokens;
+	size_type m_pos;
+
+	void tokenise(const std::string& _formula);
+	const std::string& peek() const;
+	std::string take();
+	void expect(const std::string& _token);
+
+	expr_ptr comparison();
+	expr_ptr additive();
+	expr_ptr multiplicative();
+	expr_ptr unary();
+	expr_ptr power();
+	expr_ptr primary();
+	expr_ptr call(const std::string& _name);
+
+	expr_ptr constant(double _value);
+	expr_ptr variable(const std::string& _name);
+	expr_ptr apply(const std::string& _op,expr_ptr _a,expr_ptr _b = expr_ptr(),expr_ptr _c = expr_ptr());
+
+	//! Count a use of _e, and mark it shared from the second one
+	void use(const expr_ptr& _e);
+};
+
+
+} // namespace simulate
+} // namespace fbox
+
+#endif
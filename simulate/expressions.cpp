@@ -6,12 +6,209 @@
 	Expression handling and attached agents
 */
 
+#include <algorithm>
 #include "expressions.h"
 
 namespace fbox {
 namespace simulate {
 
 
+//////////////////////////////////////////////////////
+// expression_program
+//////////////////////////////////////////////////////
+
+double expression_program::run(evaluation_round* _round)
+{
+	double* r = &m_registers[0];
+	size_type top = 0;
+	size_type pc = 0,end = m_code.size();
+
+	while (pc < end)
+	{
+		const instruction& i = m_code[pc++];
+
+		switch (i.code)
+		{
+		case CONSTANT: r[top++] = i.value; break;
+		case LEAF: r[top++] = m_leaves[i.arg].first(m_leaves[i.arg].second); break;
+		case NEGATE: r[top-1] = -r[top-1]; break;
+		case ADD: --top; r[top-1] = r[top-1] + r[top]; break;
+		case SUBTRACT: --top; r[top-1] = r[top-1] - r[top]; break;
+		case MULTIPLY: --top; r[top-1] = r[top-1] * r[top]; break;
+		case DIVIDE: --top; r[top-1] = r[top-1] / r[top]; break;
+		case MAXIMUM: --top; r[top-1] = std::max(r[top-1],r[top]); break;
+		case MINIMUM: --top; r[top-1] = std::min(r[top-1],r[top]); break;
+		case UNARY: r[top-1] = m_unary[i.arg].first(m_unary[i.arg].second,r[top-1]); break;
+		case BINARY: --top; r[top-1] = m_binary[i.arg].first(m_binary[i.arg].second,r[top-1],r[top]); break;
+		case TERNARY: top -= 2; r[top-1] = m_ternary[i.arg].first(m_ternary[i.arg].second,r[top-1],r[top],r[top+1]); break;
+		case BRANCH: if (r[--top] == 0.0) pc = i.arg; break;
+		case JUMP: pc = i.arg; break;
+		case CACHED: if (_round && _round->find(m_cached[i.arg].first,r[top])) { ++top; pc = m_cached[i.arg].second; } break;
+		case STORE: if (_round) _round->store(m_cached[i.arg].first,r[top-1]); break;
+		default: throw error("Invalid expression_program instruction");
+		}
+	}
+
+	return r[0];
+}
+
+
+void expression_program::clear()
+{
+	m_code.clear();
+	m_leaves.clear();
+	m_unary.clear();
+	m_binary.clear();
+	m_ternary.clear();
+	m_cached.clear();
+	m_registers.assign(1,0.0);
+	m_depth = m_fence = 0;
+}
+
+
+void expression_program::constant(double _value)
+{
+	push(instruction(CONSTANT,0,_value),1);
+}
+
+
+void expression_program::unary(unary_function _f,const void* _op,opcode _native)
+{
+	if (foldable(1))
+	{
+		m_code.back().value = _f(_op,m_code.back().value);
+		return;
+	}
+
+	if (_native != NONE)
+	{
+		push(instruction(_native),0);
+	}
+	else
+	{
+		m_unary.push_back(std::make_pair(_f,_op));
+		push(instruction(UNARY,m_unary.size() - 1),0);
+	}
+}
+
+
+void expression_program::binary(binary_function _f,const void* _op,opcode _native)
+{
+	if (foldable(2))
+	{
+		double b = pop_constant();
+		m_code.back().value = _f(_op,m_code.back().value,b);
+		return;
+	}
+
+	if (_native != NONE)
+	{
+		push(instruction(_native),-1);
+	}
+	else
+	{
+		m_binary.push_back(std::make_pair(_f,_op));
+		push(instruction(BINARY,m_binary.size() - 1),-1);
+	}
+}
+
+
+void expression_program::ternary(ternary_function _f,const void* _op)
+{
+	if (foldable(3))
+	{
+		double c = pop_constant();
+		double b = pop_constant();
+		m_code.back().value = _f(_op,m_code.back().value,b,c);
+		return;
+	}
+
+	m_ternary.push_back(std::make_pair(_f,_op));
+	push(instruction(TERNARY,m_ternary.size() - 1),-2);
+}
+
+
+bool expression_program::constant_top() const
+{
+	return foldable(1);
+}
+
+
+double expression_program::pop_constant()
+{
+	if (!foldable(1)) throw error("No constant to remove from expression_program");
+
+	double v = m_code.back().value;
+	m_code.pop_back();
+	--m_depth;
+	return v;
+}
+
+
+size_type expression_program::branch()
+{
+	push(instruction(BRANCH),-1);
+	return m_code.size() - 1;
+}
+
+
+size_type expression_program::jump()
+{
+	push(instruction(JUMP),0);
+
+	// only one branch of a select leaves its value on the stack
+	--m_depth;
+	return m_code.size() - 1;
+}
+
+
+void expression_program::label(size_type _jump)
+{
+	m_code[_jump].arg = m_fence = m_code.size();
+}
+
+
+size_type expression_program::cached(const void* _key)
+{
+	// a hit pushes the value the code after it would leave on the stack
+	m_cached.push_back(std::make_pair(_key,size_type(0)));
+	push(instruction(CACHED,m_cached.size() - 1),0);
+	return m_code.size() - 1;
+}
+
+
+void expression_program::store(size_type _cached)
+{
+	// constants need no caching
+	if (_cached + 2 == m_code.size() && foldable(1))
+	{
+		m_code.erase(m_code.begin() + _cached);
+		m_cached.pop_back();
+		return;
+	}
+
+	push(instruction(STORE,m_code[_cached].arg),0);
+	m_cached[m_code[_cached].arg].second = m_fence = m_code.size();
+}
+
+
+void expression_program::push(const instruction& _instr,int _depth)
+{
+	m_code.push_back(_instr);
+	m_depth += _depth;
+	if (m_depth > m_registers.size()) m_registers.resize(m_depth);
+}
+
+
+bool expression_program::foldable(size_type _n) const
+{
+	if (m_code.size() < m_fence + _n) return false;
+	for(size_type i = m_code.size() - _n; i < m_code.size(); ++i) if (m_code[i].code != CONSTANT) return false;
+	return true;
+}
+
+
+
 //////////////////////////////////////////////////////
 // expression_agent
 //////////////////////////////////////////////////////
@@ -20,56 +217,74 @@ expression_agent::expression_agent()
 :	mp_init(new constant_expression<double>(0.0)),
 	mp_reset(mp_init),
 	mp_update(mp_reset)
-{}
+{
+	m_init_code.compile(*mp_init);
+	m_reset_code = m_update_code = m_init_code;
+}
 
 
 expression_agent::expression_agent(const expression_agent& _expr)
 :	mp_init(_expr.mp_init),
 	mp_reset(_expr.mp_reset),
-	mp_update(_expr.mp_update)
+	mp_update(_expr.mp_update),
+	m_init_code(_expr.m_init_code),
+	m_reset_code(_expr.m_reset_code),
+	m_update_code(_expr.m_update_code)
 {}
 
 
 void expression_agent::setup(double_expression_ptr _expression)
 {
-	mp_init.reset( new constant_expression<double>(0.0) );
-	mp_reset = mp_update = _expression;
+	set_init(double_expression_ptr( new constant_expression<double>(0.0) ));
+	set_reset(_expression);
+	set_update(_expression);
 }
 
 
 void expression_agent::set_init(double_expression_ptr _expression)
 {
 	mp_init = _expression;
+	m_init_code.compile(*mp_init);
 }
 
 
 void expression_agent::set_reset(double_expression_ptr _expression)
 {
 	mp_reset = _expression;
+	m_reset_code.compile(*mp_reset);
 }
 
 
 void expression_agent::set_update(double_expression_ptr _expression)
 {
 	mp_update = _expression;
+	m_update_code.compile(*mp_update);
 }
 
 
 void expression_agent::init_impl()
 {
-	m_state = mp_init->value();
+	// recompile, in case more expressions came to share parts with ours since they were set
+	m_init_code.compile(*mp_init);
+	m_reset_code.compile(*mp_reset);
+	m_update_code.compile(*mp_update);
+
+	m_round.next();
+	m_state = m_init_code.run(&m_round);
 }
 
 
 void expression_agent::reset_impl()
 {
-	m_state = mp_reset->value();
+	m_round.next();
+	m_state = m_reset_code.run(&m_round);
 }
 
 
 bool expression_agent::update_impl()
 {
-	m_state = mp_update->value();
+	m_round.next();
+	m_state = m_update_code.run(&m_round);
 	return true;
 }
 
@@ -82,13 +297,19 @@ multi_expression_agent::expression_item::expression_item()
 :	init(new constant_expression<double>(0.0)),
 	reset(new constant_expression<double>(0.0)),
 	update(new constant_expression<double>(0.0))
-{}
+{
+	init_code.compile(*init);
+	reset_code = update_code = init_code;
+}
 
 
 multi_expression_agent::expression_item::expression_item(const multi_expression_agent::expression_item& _expr)
 :	init(_expr.init),
 	reset(_expr.reset),
-	update(_expr.update)
+	update(_expr.update),
+	init_code(_expr.init_code),
+	reset_code(_expr.reset_code),
+	update_code(_expr.update_code)
 {}
 
 
@@ -103,6 +324,7 @@ void multi_expression_agent::set_init(size_type _index,double_expression_ptr _ex
 {
 	if (_index >= m_vec.size()) throw error("Index exceeds multi_expression_agent's dimension");
 	m_vec[_index].init = _expression;
+	m_vec[_index].init_code.compile(*_expression);
 }
 
 
@@ -110,6 +332,7 @@ void multi_expression_agent::set_reset(size_type _index,double_expression_ptr _e
 {
 	if (_index >= m_vec.size()) throw error("Index exceeds multi_expression_agent's dimension");
 	m_vec[_index].reset = _expression;
+	m_vec[_index].reset_code.compile(*_expression);
 }
 
 
@@ -117,32 +340,44 @@ void multi_expression_agent::set_update(size_type _index,double_expression_ptr _
 {
 	if (_index >= m_vec.size()) throw error("Index exceeds multi_expression_agent's dimension");
 	m_vec[_index].update = _expression;
+	m_vec[_index].update_code.compile(*_expression);
 }
 
 
 void multi_expression_agent::set_all(size_type _index,double_expression_ptr _expression)
 {
-	if (_index >= m_vec.size()) throw error("Index exceeds multi_expression_agent's dimension");
-	m_vec[_index].init.reset( new constant_expression<double>(0.0) );
-	m_vec[_index].reset = m_vec[_index].update = _expression;
+	set_init(_index,double_expression_ptr( new constant_expression<double>(0.0) ));
+	set_reset(_index,_expression);
+	set_update(_index,_expression);
 }
 
 
 void multi_expression_agent::init_impl()
 {
-	for(size_type i = 0; i != m_vec.size(); ++i) m_state[i] = m_vec[i].init->value();
+	// recompile, in case more expressions came to share parts with ours since they were set
+	for(size_type i = 0; i != m_vec.size(); ++i)
+	{
+		m_vec[i].init_code.compile(*m_vec[i].init);
+		m_vec[i].reset_code.compile(*m_vec[i].reset);
+		m_vec[i].update_code.compile(*m_vec[i].update);
+	}
+
+	m_round.next();
+	for(size_type i = 0; i != m_vec.size(); ++i) m_state[i] = m_vec[i].init_code.run(&m_round);
 }
 
 
 void multi_expression_agent::reset_impl()
 {
-	for(size_type i = 0; i != m_vec.size(); ++i) m_state[i] = m_vec[i].reset->value();
+	m_round.next();
+	for(size_type i = 0; i != m_vec.size(); ++i) m_state[i] = m_vec[i].reset_code.run(&m_round);
 }
 
 
 bool multi_expression_agent::update_impl()
 {
-	for(size_type i = 0; i != m_vec.size(); ++i) m_state[i] = m_vec[i].update->value();
+	m_round.next();
+	for(size_type i = 0; i != m_vec.size(); ++i) m_state[i] = m_vec[i].update_code.run(&m_round);
 	return true;
 }
 
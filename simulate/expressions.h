@@ -8,12 +8,183 @@
 	Expression handling and attached agents
 */
 
+#include <vector>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/unordered_map.hpp>
 #include <fbox/main.h>
+#include <fbox/error.h>
 #include "agent_impl.h"
+#include "operators.h"
 
 namespace fbox {
 namespace simulate {
 
+template<typename _type> class basic_expression;
+
+
+//! True for the value types held in the registers of expression programs (see expression_register)
+template<typename _type> struct is_register_type : boost::false_type {};
+template<> struct is_register_type<double> : boost::true_type {};
+template<> struct is_register_type<float> : boost::true_type {};
+template<> struct is_register_type<int> : boost::true_type {};
+template<> struct is_register_type<long> : boost::true_type {};
+template<> struct is_register_type<unsigned int> : boost::true_type {};
+template<> struct is_register_type<unsigned long> : boost::true_type {};
+template<> struct is_register_type<bool> : boost::true_type {};
+
+
+//! Values of shared expressions (see shared_expression) computed in one evaluation round
+/*!
+	Owned by whoever runs expression programs and passed to <code>expression_program::run()</code>.
+	Programs run with the same round compute each shared expression once, until <code>next()</code>
+	starts a new round. Nothing is cached for programs run without a round. A round must not be used
+	by two threads at once.
+*/
+class evaluation_round
+{
+public:
+	evaluation_round() : m_round(1) {}
+
+	//! Forget all values
+	void next() { ++m_round; }
+
+	//! Value stored for _key in this round, if any
+	bool find(const void* _key,double& _value) const
+	{
+		value_map::const_iterator itr = m_values.find(_key);
+		if (itr == m_values.end() || itr->second.first != m_round) return false;
+
+		_value = itr->second.second;
+		return true;
+	}
+
+	//! Store the value of _key for the rest of this round
+	void store(const void* _key,double _value) { m_values[_key] = std::make_pair(m_round,_value); }
+
+private:
+	typedef boost::unordered_map<const void*,std::pair<size_type,double> > value_map;
+
+	value_map m_values;
+	size_type m_round;
+};
+
+
+//! Expression flattened into postfix code for a stack machine
+/*!
+	Expressions compile themselves (see <code>basic_expression::compile</code>) into instructions
+	over a register stack. Operators the interpreter knows become native instructions, all others are
+	called through function pointers on the operator objects of their nodes, and any other expression
+	is evaluated as an opaque leaf through its virtual <code>value()</code>, as are operators whose
+	argument or result is not a scalar (see is_register_type). Operations whose arguments are all
+	constants are folded when compiled, with the operator objects as they are then. A select compiles to conditional jumps, so only the branch taken is evaluated.
+	Shared expressions compile to cached code, skipped when the evaluation_round given to
+	<code>run()</code> already holds their value.
+*/
+class expression_program
+{
+public:
+	enum opcode
+	{
+		NONE,
+		CONSTANT,
+		LEAF,
+		NEGATE,
+		ADD,
+		SUBTRACT,
+		MULTIPLY,
+		DIVIDE,
+		MAXIMUM,
+		MINIMUM,
+		UNARY,
+		BINARY,
+		TERNARY,
+		BRANCH,		//!< Pop condition and jump if false
+		JUMP,
+		CACHED,		//!< Push the value stored in the round and jump past the code computing it, if there is one
+		STORE		//!< Store the top of the stack in the round
+	};
+
+	typedef double (*leaf_function)(void*);
+	typedef double (*unary_function)(const void*,double); //!< Called with the operator object given when compiled
+	typedef double (*binary_function)(const void*,double,double);
+	typedef double (*ternary_function)(const void*,double,double,double);
+
+	expression_program() : m_registers(1,0.0),m_depth(0),m_fence(0) {}
+
+	//! Replace the program with the code for _expr
+	template<typename _type> void compile(basic_expression<_type>& _expr)
+	{
+		BOOST_STATIC_ASSERT(is_register_type<_type>::value);
+		clear();
+		_expr.compile(*this);
+	}
+
+	//! Evaluate the program, reusing the values of shared expressions already computed in _round, if given
+	double run(evaluation_round* _round = 0);
+
+	//! Remove all code
+	void clear();
+
+	//! Number of instructions
+	size_type size() const { return m_code.size(); }
+
+	//! True if the program folded to a single constant
+	bool is_constant() const { return m_code.size() == 1 && m_code[0].code == CONSTANT; }
+
+	//! \name Code generation, used by expressions' compile()
+	//@{
+	void constant(double _value);
+	template<typename _type> void leaf(basic_expression<_type>* _expr);
+	void unary(unary_function _f,const void* _op = 0,opcode _native = NONE);
+	void binary(binary_function _f,const void* _op = 0,opcode _native = NONE);
+	void ternary(ternary_function _f,const void* _op = 0);
+
+	bool constant_top() const; //!< True if the last value pushed is a foldable constant
+	double pop_constant(); //!< Remove that constant and return its value
+
+	size_type branch(); //!< Emit a conditional jump to be set by <code>label()</code>
+	size_type jump(); //!< Emit an unconditional jump to be set by <code>label()</code>
+	void label(size_type _jump); //!< Point the jump at _jump to the next instruction
+
+	size_type cached(const void* _key); //!< Start the code of a value cached under _key, ended by <code>store()</code>
+	void store(size_type _cached); //!< End the cached code started at _cached
+	//@}
+
+private:
+	struct instruction
+	{
+		opcode code;
+		size_type arg;
+		double value;
+		instruction(opcode _code,size_type _arg = 0,double _value = 0.0) : code(_code),arg(_arg),value(_value) {}
+	};
+
+	std::vector<instruction> m_code;
+	std::vector<std::pair<leaf_function,void*> > m_leaves;
+	std::vector<std::pair<unary_function,const void*> > m_unary;
+	std::vector<std::pair<binary_function,const void*> > m_binary;
+	std::vector<std::pair<ternary_function,const void*> > m_ternary;
+	std::vector<std::pair<const void*,size_type> > m_cached;	//!< Key and end of each cached code
+	std::vector<double> m_registers;
+	size_type m_depth;	//!< Stack depth at the end of the code
+	size_type m_fence;	//!< Code before this point is a jump target and can't be folded
+
+	void push(const instruction& _instr,int _depth);
+	bool foldable(size_type _n) const; //!< True if the last _n instructions are foldable constants
+};
+
+
+//! Register value of an expression result, for the types in is_register_type
+inline double expression_register(double _v) { return _v; }
+inline double expression_register(float _v) { return _v; }
+inline double expression_register(int _v) { return _v; }
+inline double expression_register(long _v) { return double(_v); }
+inline double expression_register(unsigned int _v) { return _v; }
+inline double expression_register(unsigned long _v) { return double(_v); }
+inline double expression_register(bool _v) { return _v ? 1.0 : 0.0; }
+
+
 //! Expression interface
 template<typename _type>
 class basic_expression
@@ -21,8 +192,73 @@ class basic_expression
 public:
 	typedef _type value_type;
 	virtual value_type value() = 0;
+
+	//! Append code evaluating this expression to _program. Expressions are opaque leaves by default.
+	virtual void compile(expression_program& _program) { compile_leaf(_program,is_register_type<_type>()); }
+
+protected:
+	void compile_leaf(expression_program& _program,boost::true_type) { _program.leaf(this); }
+
+	//! Not reached: expressions reading non-scalar expressions compile as leaves themselves, and programs
+	//! only compile scalar expressions
+	void compile_leaf(expression_program&,boost::false_type) { throw error("Expression type can't be compiled"); }
+};
+
+
+template<typename _type>
+double leaf_value(void* _expr)
+{
+	return expression_register(static_cast<basic_expression<_type>*>(_expr)->value());
+}
+
+
+template<typename _type>
+void expression_program::leaf(basic_expression<_type>* _expr)
+{
+	m_leaves.push_back(std::make_pair(&leaf_value<_type>,static_cast<void*>(_expr)));
+	push(instruction(LEAF,m_leaves.size() - 1),1);
+}
+
+
+//! Calls to the operator object of an expression node from register values
+template<typename _operator>
+struct operator_call
+{
+	typedef typename _operator::source_type source_type;
+
+	static double unary(const void* _op,double _a)
+	{
+		return expression_register((*static_cast<const _operator*>(_op))(source_type(_a)));
+	}
+
+	static double binary(const void* _op,double _a,double _b)
+	{
+		return expression_register((*static_cast<const _operator*>(_op))(source_type(_a),source_type(_b)));
+	}
+
+	static double ternary(const void* _op,double _a,double _b,double _c)
+	{
+		return expression_register((*static_cast<const _operator*>(_op))(source_type(_a),source_type(_b),source_type(_c)));
+	}
 };
 
+
+//! True if nodes of _operator compile to calls of the operator, rather than to opaque leaves
+template<typename _operator>
+struct is_compiled_operator : boost::integral_constant<bool,
+	is_register_type<typename _operator::source_type>::value && is_register_type<typename _operator::target_type>::value> {};
+
+
+//! Native instruction for an operator, if any
+template<typename _operator> struct native_operation { static const expression_program::opcode code = expression_program::NONE; };
+template<> struct native_operation<operators::negate> { static const expression_program::opcode code = expression_program::NEGATE; };
+template<> struct native_operation<operators::sum> { static const expression_program::opcode code = expression_program::ADD; };
+template<> struct native_operation<operators::difference> { static const expression_program::opcode code = expression_program::SUBTRACT; };
+template<> struct native_operation<operators::product> { static const expression_program::opcode code = expression_program::MULTIPLY; };
+template<> struct native_operation<operators::division> { static const expression_program::opcode code = expression_program::DIVIDE; };
+template<> struct native_operation<operators::maximum> { static const expression_program::opcode code = expression_program::MAXIMUM; };
+template<> struct native_operation<operators::minimum> { static const expression_program::opcode code = expression_program::MINIMUM; };
+
 //! Constant expression
 template<typename _type>
 class constant_expression : public basic_expression<_type>
@@ -32,9 +268,13 @@ public:
 
 	constant_expression(value_type _arg) : m_arg(_arg) {}
 	virtual value_type value() { return m_arg; }
+	virtual void compile(expression_program& _program) { compile(_program,is_register_type<_type>()); }
 
 protected:
 	value_type m_arg;
+
+	void compile(expression_program& _program,boost::true_type) { _program.constant(expression_register(m_arg)); }
+	void compile(expression_program& _program,boost::false_type) { this->compile_leaf(_program,boost::false_type()); }
 };
 
 
@@ -51,9 +291,21 @@ public:
 	unary_expression(expr_ptr _arg) : mp_arg(_arg) {}
 	virtual value_type value() { return m_op(mp_arg->value()); }
 
+	operator_type& get_operation() { return m_op; }
+
+	virtual void compile(expression_program& _program) { compile(_program,is_compiled_operator<operator_type>()); }
+
 protected:
 	operator_type m_op;
 	expr_ptr mp_arg;
+
+	void compile(expression_program& _program,boost::true_type)
+	{
+		mp_arg->compile(_program);
+		_program.unary(&operator_call<operator_type>::unary,&m_op,native_operation<operator_type>::code);
+	}
+
+	void compile(expression_program& _program,boost::false_type) { this->compile_leaf(_program,is_register_type<value_type>()); }
 };
 
 
@@ -70,9 +322,22 @@ public:
 	binary_expression(expr_ptr _arg1,expr_ptr _arg2) : mp_arg1(_arg1),mp_arg2(_arg2) {}
 	virtual value_type value() { return m_op(mp_arg1->value(),mp_arg2->value()); }
 
+	operator_type& get_operation() { return m_op; }
+
+	virtual void compile(expression_program& _program) { compile(_program,is_compiled_operator<operator_type>()); }
+
 protected:
 	operator_type m_op;
 	expr_ptr mp_arg1,mp_arg2;
+
+	void compile(expression_program& _program,boost::true_type)
+	{
+		mp_arg1->compile(_program);
+		mp_arg2->compile(_program);
+		_program.binary(&operator_call<operator_type>::binary,&m_op,native_operation<operator_type>::code);
+	}
+
+	void compile(expression_program& _program,boost::false_type) { this->compile_leaf(_program,is_register_type<value_type>()); }
 };
 
 
@@ -89,9 +354,23 @@ public:
 	ternary_expression(expr_ptr _arg1,expr_ptr _arg2,expr_ptr _arg3) : mp_arg1(_arg1),mp_arg2(_arg2),mp_arg3(_arg3) {}
 	virtual value_type value() { return m_op(mp_arg1->value(),mp_arg2->value(),mp_arg3->value()); }
 
+	operator_type& get_operation() { return m_op; }
+
+	virtual void compile(expression_program& _program) { compile(_program,is_compiled_operator<operator_type>()); }
+
 protected:
 	operator_type m_op;
 	expr_ptr mp_arg1,mp_arg2,mp_arg3;
+
+	void compile(expression_program& _program,boost::true_type)
+	{
+		mp_arg1->compile(_program);
+		mp_arg2->compile(_program);
+		mp_arg3->compile(_program);
+		_program.ternary(&operator_call<operator_type>::ternary,&m_op);
+	}
+
+	void compile(expression_program& _program,boost::false_type) { this->compile_leaf(_program,is_register_type<value_type>()); }
 };
 
 
@@ -110,6 +389,24 @@ public:
 	
 	virtual double value() { return (mp_cond->value()? mp_yes->value() : mp_no->value()); }
 
+	virtual void compile(expression_program& _program)
+	{
+		mp_cond->compile(_program);
+
+		if (_program.constant_top())
+		{
+			(_program.pop_constant() != 0.0 ? mp_yes : mp_no)->compile(_program);
+			return;
+		}
+
+		size_type no = _program.branch();
+		mp_yes->compile(_program);
+		size_type end = _program.jump();
+		_program.label(no);
+		mp_no->compile(_program);
+		_program.label(end);
+	}
+
 protected:
 	bool_expr_ptr mp_cond;	
 	expr_ptr mp_yes,mp_no;
@@ -134,8 +431,62 @@ public:
 	
 	virtual value_type value() { return static_cast<value_type>(mp_src->value()); }
 
+	virtual void compile(expression_program& _program)
+	{
+		compile(_program,boost::integral_constant<bool,is_register_type<source_type>::value && is_register_type<value_type>::value>());
+	}
+
 protected:
 	source_ptr mp_src;	
+
+	void compile(expression_program& _program,boost::true_type)
+	{
+		mp_src->compile(_program);
+		_program.unary(&convert);
+	}
+
+	void compile(expression_program& _program,boost::false_type) { this->compile_leaf(_program,is_register_type<value_type>()); }
+
+	static double convert(const void*,double _v) { return expression_register(static_cast<value_type>(static_cast<source_type>(_v))); }
+};
+
+
+//! Expression used in several places, evaluated at most once per evaluation round
+/*!
+	Unless marked as shared the expression compiles inline into its parents, like any other. Shared, it
+	compiles to cached code (see evaluation_round), so that a subexpression used by several outputs of an
+	expression agent is computed once per init, reset or update. Marking only changes the code compiled
+	afterwards, which expression agents redo on init. <code>value()</code> caches nothing.
+*/
+class shared_expression : public basic_expression<double>
+{
+public:
+	typedef shared_ptr<basic_expression<double> > expr_ptr;
+
+	shared_expression(expr_ptr _arg) : mp_arg(_arg),m_shared(false) {}
+
+	virtual double value() { return mp_arg->value(); }
+
+	virtual void compile(expression_program& _program)
+	{
+		if (!m_shared)
+		{
+			mp_arg->compile(_program);
+			return;
+		}
+
+		size_type c = _program.cached(this);
+		mp_arg->compile(_program);
+		_program.store(c);
+	}
+
+	void set_shared(bool _shared) { m_shared = _shared; }
+	bool is_shared() const { return m_shared; }
+	expr_ptr argument() const { return mp_arg; }
+
+protected:
+	expr_ptr mp_arg;
+	bool m_shared;
 };
 
 
@@ -263,7 +614,7 @@ shared_ptr<basic_linked_expression<_agent_type,_return_type> > make_linked_expre
 }
 
 
-//! Generic expression agent
+//! Generic expression agent. Expressions are compiled (see expression_program) as they are set.
 class expression_agent
 :	public multi_agent_impl<double>
 {
@@ -284,6 +635,8 @@ protected:
 	double_expression_ptr mp_init;
 	double_expression_ptr mp_reset;
 	double_expression_ptr mp_update;
+	expression_program m_init_code,m_reset_code,m_update_code; //!< Compiled expressions
+	evaluation_round m_round; //!< Shared expressions computed in the current init, reset or update
 
 	virtual void init_impl();
 	virtual void reset_impl();
@@ -292,7 +645,7 @@ protected:
 
 
 
-//! Expression agent that supports multiple separate calculations
+//! Expression agent that supports multiple separate calculations. Expressions are compiled as they are set.
 class multi_expression_agent
 :	public multi_agent_impl<std::vector<double> >
 {
@@ -314,12 +667,15 @@ protected:
 		double_expression_ptr reset;
 		double_expression_ptr update;
 
+		expression_program init_code,reset_code,update_code; //!< Compiled expressions
+
 		expression_item(); //!< initialise all linked expressions to null constants
 		expression_item(const expression_item& _expr);
 	};
 
 	typedef std::vector<expression_item> expression_vector;
 	expression_vector m_vec;
+	evaluation_round m_round; //!< Shared expressions computed in the current init, reset or update
 
 	virtual void init_impl();
 	virtual void reset_impl();
@@ -6,6 +6,7 @@
 	Instrument agents
 */
 
+#include <typeinfo>
 #include "instruments.h"
 #include "../core/option.h"
 
@@ -244,10 +245,18 @@ bool cash::flow_connector::update_impl()
 void portfolio::clear()
 {
 	m_names.clear();
+	m_netted.clear();
+	m_schedules.clear();
 	mp_cash.reset();
 }
 
 
+void portfolio::set_netting(bool _netting)
+{
+	m_netting = _netting;
+}
+
+
 void portfolio::set_cash_account(
 	double_agent_ptr _rate,
 	double _initial_value,
@@ -269,7 +278,17 @@ void portfolio::add_instrument(
 	double _weight)
 {
 	double_agent_ptr w( new constant<double>(_weight) );
-	add_instrument(_instrument,w);
+
+	deterministic_flows* d = m_netting ? dynamic_cast<deterministic_flows*>(_instrument.get()) : 0;
+	if (d && net(*d,_weight))
+	{
+		m_names.push_back( item_type(_instrument,w) );
+		m_netted.push_back(true);
+	}
+	else
+	{
+		add_instrument(_instrument,w);
+	}
 }
 
 
@@ -278,14 +297,78 @@ void portfolio::add_instrument(
 	double_agent_ptr _weight)
 {
 	m_names.push_back( item_type(_instrument,_weight) );
+	m_netted.push_back(false);
 	
 	connect(_instrument);
 	connect(_weight);
 }
 
 
+bool portfolio::net(const deterministic_flows& _instrument,double _weight)
+{
+	deterministic_flows::flows_type flows;
+	yield_curve_ptr yc = _instrument.deterministic_cashflows(flows);
+	if (!yc) return false;
+
+	std::vector<netted_flows>::iterator s = m_schedules.begin();
+	while (s != m_schedules.end() && s->yc != yc) ++s;
+
+	if (s == m_schedules.end())
+	{
+		m_schedules.push_back(netted_flows());
+		s = m_schedules.end() - 1;
+		s->yc = yc;
+		connect(yc);
+	}
+
+	s->members.push_back( std::make_pair(&_instrument,_weight) );
+	return true;
+}
+
+
+void portfolio::init_impl()
+{
+	std::vector<netted_flows>::iterator s = m_schedules.begin();
+	for(; s != m_schedules.end(); ++s)
+	{
+		// read the flows again, in case the instruments changed since they were added
+		std::map<time_type,double> net;
+		for(size_type i = 0; i < s->members.size(); ++i)
+		{
+			deterministic_flows::flows_type flows;
+			if (s->members[i].first->deterministic_cashflows(flows) != s->yc)
+				throw error("Netted instrument changed its discount curve");
+
+			double w = s->members[i].second;
+			for(size_type j = 0; j < flows.size(); ++j) net[flows[j].first] += w * flows[j].second;
+		}
+
+		s->times.clear();
+		s->amounts.clear();
+
+		std::map<time_type,double>::const_iterator itr = net.begin();
+		for(; itr != net.end(); ++itr)
+		{
+			s->times.push_back(itr->first);
+			s->amounts.push_back(itr->second);
+		}
+
+		// flows at or before the start are never paid
+		s->next0 = 0;
+		while (s->next0 < s->times.size() && s->times[s->next0] <= m_start + .1) ++s->next0;
+		s->df.resize(s->times.size());
+	}
+}
+
+
 void portfolio::reset_impl()
 {
+	std::vector<netted_flows>::iterator s = m_schedules.begin();
+	for(; s != m_schedules.end(); ++s) s->next = s->next0;
+
+	m_live.clear();
+	for(size_type i = 0; i < m_names.size(); ++i) if (!m_netted[i]) m_live.push_back(i);
+
 	update_impl();
 }
 
@@ -293,9 +376,31 @@ void portfolio::reset_impl()
 bool portfolio::update_impl()
 {
 	m_state.clear();
-	vec_type::iterator itr = m_names.begin();
-	vec_type::iterator end = m_names.end();
-	for(; itr != end; ++itr) m_state += itr->first->state() * itr->second->state();
+
+	// instruments that stop updating with a nil state no longer contribute for the rest of the path
+	size_type n = 0;
+	for(size_type i = 0; i < m_live.size(); ++i)
+	{
+		const item_type& item = m_names[m_live[i]];
+		const instrument_state& state = item.first->state();
+		m_state += state * item.second->state();
+
+		if (item.first->is_live() || state.value != 0.0 || state.flow != 0.0) m_live[n++] = m_live[i];
+	}
+	m_live.resize(n);
+
+	std::vector<netted_flows>::iterator s = m_schedules.begin();
+	for(; s != m_schedules.end(); ++s)
+	{
+		size_type top = s->times.size();
+		for(; s->next < top && s->times[s->next] <= m_time + .1; ++s->next) m_state.flow += s->amounts[s->next];
+
+		size_type n = top - s->next;
+		if (n == 0) continue;
+
+		s->yc->discount(&s->times[s->next],&s->df[0],n);
+		for(size_type i = 0; i < n; ++i) m_state.value += s->amounts[s->next + i] * s->df[i];
+	}
 
 	if (mp_cash)
 	{
@@ -343,6 +448,9 @@ void fixed_leg::set_schedule(
 	for(time_type t = _start + _period; t < _end - .1; t += _period) m_flows.push_back( flow_type(t,_amount) );
 	m_flows.push_back( flow_type(_end,_amount) );
 	m_flows.back().amount += _payout;
+
+	m_times.clear();
+	for(flows_vec_type::const_iterator itr = m_flows.begin(); itr != m_flows.end(); ++itr) m_times.push_back(itr->time);
 }
 
 
@@ -355,12 +463,26 @@ size_type fixed_leg::size()
 void fixed_leg::clear()
 {
 	m_flows.clear();
+	m_times.clear();
 }
 
 
 void fixed_leg::add(const time_type& _time,double _amount)
 {
 	m_flows.push_back( flow_type(_time,_amount) );
+	m_times.push_back(_time);
+}
+
+
+yield_curve_ptr fixed_leg::deterministic_cashflows(flows_type& _flows) const
+{
+	// derived legs (risky_leg, portfolio_fixed_leg, ...) pay differently unless they say otherwise
+	if (typeid(*this) != typeid(fixed_leg)) return yield_curve_ptr();
+
+	for(flows_vec_type::const_iterator itr = m_flows.begin(); itr != m_flows.end(); ++itr)
+		_flows.push_back( std::make_pair(itr->time,itr->amount) );
+
+	return mp_yc;
 }
 
 
@@ -396,19 +518,35 @@ bool fixed_leg::update_impl()
 	m_state.value = 0.0;
 	m_state.flow = seek(time()); // leg since last update
 	
-	flows_vec_type::const_iterator end = m_flows.end();
-	if (m_itr == end) 
-	{
+	if (m_itr == m_flows.end()) 
 		m_state.matured = true;
-	}
 	else
+		m_state.value = present_value();
+
+	return true;
+}
+
+
+double fixed_leg::present_value(yield_curve_ptr _sc)
+{
+	size_type i0 = m_itr - m_flows.begin(); // next flow
+	size_type n = m_flows.size() - i0;
+	if (n == 0) return 0.0;
+
+	m_df.resize(n);
+	mp_yc->discount(&m_times[i0],&m_df[0],n);
+
+	if (_sc)
 	{
-		flows_vec_type::const_iterator itr = m_itr; // points to the next flow
-		for(; itr != end; ++itr)
-			m_state.value += itr->amount * mp_yc->discount(itr->time);
+		m_sf.resize(n);
+		_sc->discount(&m_times[i0],&m_sf[0],n);
+		for(size_type i = 0; i < n; ++i) m_df[i] *= m_sf[i];
 	}
 
-	return true;
+	double v = 0.0;
+	for(size_type i = 0; i < n; ++i) v += m_flows[i0+i].amount * m_df[i];
+
+	return v;
 }
 
 
@@ -565,9 +703,7 @@ bool risky_leg::update_impl()
 		}
 		else // if still live calculate present value
 		{
-			flows_vec_type::const_iterator itr = m_itr; // points to the next flow
-			for(; itr != end; ++itr)
-				m_state.value += itr->amount * mp_yc->discount(itr->time) * mp_sc->discount(itr->time);
+			m_state.value = present_value(mp_sc);
 		}
 	}
 
@@ -629,9 +765,7 @@ bool portfolio_fixed_leg::update_impl()
 	}
 	else
 	{
-		flows_vec_type::const_iterator itr = m_itr; // points to the next flow
-		for(; itr != end; ++itr)
-			m_state.value += itr->amount * mp_yc->discount(itr->time) * mp_sc->discount(itr->time);
+		m_state.value = present_value(mp_sc);
 
 		// apply recovery to terminated events on the average value at this and the last node
 		m_state.flow += (m_state.value + m_last_pv) / 2.0 * m_recovery_rate * (m_last_size - sz);
@@ -698,12 +832,20 @@ bool portfolio_event_leg::update_impl()
 		size_type events = mp_events->state();
 		m_state.flow = events * m_payout;
 
-		double s0(1.0),s1(1.0);
-		for(time_type t = time(); t < m_maturity; t += m_istep)
+		m_times.clear();
+		for(time_type t = time(); t < m_maturity; t += m_istep) m_times.push_back(t);
+
+		size_type n = m_times.size();
+		m_df.resize(n);
+		m_sf.resize(n);
+		mp_yc->discount(&m_times[0],&m_df[0],n);
+		mp_sc->discount(&m_times[0],&m_sf[0],n);
+
+		double s0 = 1.0;
+		for(size_type i = 0; i < n; ++i)
 		{
-			s1 = mp_sc->discount(t);
-			m_state.value += mp_yc->discount(t) * (s0 - s1);
-			s0 = s1;
+			m_state.value += m_df[i] * (s0 - m_sf[i]);
+			s0 = m_sf[i];
 		}
 		m_state.value *= m_payout * sz;
 	}
@@ -8,6 +8,8 @@
 	Instrument agents
 */
 
+#include <map>
+#include <vector>
 #include <boost/math/distributions/normal.hpp>
 #include <fbox/main.h>
 #include "agent_impl.h"
@@ -52,6 +54,26 @@ typedef multi_agent_impl<instrument_state> instrument_agent;
 typedef shared_ptr<instrument_agent> instrument_agent_ptr;
 
 
+//! Interface for instruments that pay fixed amounts on known dates, valued off a single discount curve
+/*!
+	A flow at time t is paid by the first update at or after t - 0.1 and is worth its amount times the
+	discount factor to t until then. Flows at or before the simulation start are never paid.
+*/
+class deterministic_flows
+{
+public:
+	typedef std::vector<std::pair<instrument_agent::time_type,double> > flows_type;
+
+	virtual ~deterministic_flows() {}
+
+	//! Append the flows to _flows and return their discount curve. A null curve means the flows are not
+	//! deterministic (or the instrument does not follow the payment convention above) and can't be netted.
+	//! Netting is opt-in per class: an implementation must not report flows for derived classes that
+	//! did not override it, since they may change how the flows are paid.
+	virtual yield_curve_ptr deterministic_cashflows(flows_type& _flows) const = 0;
+};
+
+
 //! User defined instrument
 class basic_instrument
 :	public instrument_agent
@@ -139,11 +161,22 @@ protected:
 	instead. Instead any instrument leg are absorbed by the account. To iinspect net instrument leg 
 	one can look at the flow paramter of the account itself that reflects  any flow in our out of the
 	account.
+
+	With netting enabled, instruments added with a constant weight that expose deterministic_flows are
+	not simulated at all. Their weighted flows are merged by date into one schedule per discount curve,
+	and each step the portfolio discounts every outstanding date once with a batch call to the curve.
+	The cost then scales with the number of distinct dates rather than the number of trades. Netted
+	instruments are not connected to the portfolio, so their states are never updated: they are still
+	listed by instrument(), and netted() tells them apart. The schedules are built from the netted
+	instruments on every init(), so flows changed after add_instrument() are picked up, but a netted
+	instrument must keep its discount curve.
 */
 class portfolio
 :	public instrument_agent
 {
 public:
+	portfolio() : m_netting(false) {}
+
 	void clear();
 
 	void set_cash_account(
@@ -152,12 +185,17 @@ public:
 		double _loan_spread = 0.0,
 		double _deposit_spread = 0.0);
 	
+	//! Net deterministic cashflows by date (off by default). Only affects instruments added afterwards.
+	void set_netting(bool _netting);
+
 	void add_instrument(instrument_agent_ptr _instrument,double _weight = 1.0);
 	void add_instrument(instrument_agent_ptr _instrument,double_agent_ptr _weight);
 
 	shared_ptr<fbox::simulate::instruments::cash> cash_account() const { return mp_cash; }
+	//! Instrument _i in the order added. The state() of netted instruments is not updated by the portfolio.
 	instrument_agent_ptr instrument(size_type _i) const { return m_names[_i].first; }
 	double_agent_ptr weight(size_type _i) const { return m_names[_i].second; }
+	bool netted(size_type _i) const { return m_netted[_i] != 0; } //!< True if instrument _i is netted
 
 protected:
 	shared_ptr<fbox::simulate::instruments::cash> mp_cash;
@@ -166,14 +204,34 @@ protected:
 	typedef std::vector<item_type> vec_type;
 	vec_type m_names;
 
+	virtual void init_impl();
 	virtual void reset_impl();
 	virtual bool update_impl();
+
+private:
+	//! Netted flows discounted off one curve
+	struct netted_flows
+	{
+		yield_curve_ptr yc;
+		std::vector<std::pair<const deterministic_flows*,double> > members;	//!< Netted instruments and their weights
+		std::vector<time_type> times;		//!< Net flow dates and amounts, built by init
+		std::vector<double> amounts,df;
+		size_type next,next0;				//!< First flow still to be paid, now and at the start
+	};
+
+	bool m_netting;
+	std::vector<char> m_netted;				//!< True for the instruments in m_names that are netted
+	std::vector<size_type> m_live;			//!< Instruments still contributing in the current path
+	std::vector<netted_flows> m_schedules;
+
+	bool net(const deterministic_flows& _instrument,double _weight); //!< Add to a schedule if possible
 };
 
 
 //! Cashflow leg pricing agent
 class fixed_leg
-:	public instrument_agent
+:	public instrument_agent,
+	public deterministic_flows
 {
 public:
 	//! Initial setup, optionally with equally spaced schedule
@@ -202,6 +260,9 @@ public:
 	//! Add single flow
 	void add(const time_type& _time,double _amount);
 
+	//! Flows of a fixed_leg proper. Derived classes are not netted unless they override this.
+	virtual yield_curve_ptr deterministic_cashflows(flows_type& _flows) const;
+
 protected:
 	struct flow_type
 	{
@@ -217,9 +278,16 @@ protected:
 
 	double seek(const time_type& _time);
 
+	//! Present value of the flows still outstanding, optionally weighted by the survival curve _sc
+	double present_value(yield_curve_ptr _sc = yield_curve_ptr());
+
 	virtual void init_impl();
 	virtual void reset_impl();
 	virtual bool update_impl();
+
+private:
+	std::vector<time_type> m_times;	//!< Flow times, kept contiguous for the batch discount calls
+	std::vector<double> m_df,m_sf;	//!< Discount and survival factor buffers
 };
 
 
@@ -328,6 +396,8 @@ protected:
 
 private:
 	time_type m_istep;
+	std::vector<time_type> m_times;	//!< NPV integration times
+	std::vector<double> m_df,m_sf;	//!< Discount and survival factor buffers
 };
 
 
@@ -9,6 +9,7 @@
 #include "models.h"
 #include "../core/xml_utils.h"
 #include "../core/math.h"
+#include "../core/random.h"
 
 
 namespace fbox {
@@ -148,8 +149,13 @@ bool basic_ou::update_impl()
 {
 	double mrl = mp_level->state();
 	double dt = year_fraction.yf(time_interval());
-	double emdt = std::exp(-m_speed * dt);
-	m_state = m_state * emdt + mrl * (1.0 - emdt) + sqrt(m_vol * m_vol * (1.0 - emdt * emdt) / (2.0 * m_speed)) * mp_rnd->state();
+	double kdt = m_speed * dt;
+	double emdt = std::exp(-kdt);
+
+	// exact variance (1 - exp(-2.k.dt)) / 2k, expanded when the reversion speed is negligible
+	double v = kdt > 1e-2? (1.0 - emdt * emdt) / (2.0 * m_speed) : dt * (1.0 - kdt + 2.0 * kdt * kdt / 3.0);
+
+	m_state = m_state * emdt + mrl * (1.0 - emdt) + m_vol * std::sqrt(v) * mp_rnd->state();
 	return true;
 }
 
@@ -210,21 +216,36 @@ bool basic_event::update_impl()
 // basic_jump
 //////////////////////////////////////////////////////
 
-bool basic_jump::update_impl()
+namespace {
+
+//! Uniform source returning a given first deviate, then falling back to a generator
+struct driven_uniform
 {
-	double q = mp_intensity->state() * year_fraction.yf(time_interval());
-	double pk = std::exp(-q);
-	double p = pk;
-	double k = 0.0;
-	
-	while (mp_rnd->state() > p) 
+	driven_uniform(double _first,generator* _rnd) : first(_first),used(false),rnd(_rnd) {}
+
+	double operator() ()
 	{
-		++k;
-		pk *= q / k;
-		p += pk;
+		if (used) return rnd->rnd();
+		used = true;
+		return first;
 	}
 
-	m_state += k;
+	double first;
+	bool used;
+	generator* rnd;
+};
+
+} // namespace
+
+
+bool basic_jump::update_impl()
+{
+	double q = mp_intensity->state() * year_fraction.yf(time_interval());
+
+	// the driver supplies the first uniform, so small intensities invert exactly as before; rejection
+	// at large intensities draws any further uniforms from the path generator
+	driven_uniform u(mp_rnd->state(),agent_impl_type::mp_rnd);
+	m_state += math::poisson_deviate(q,u);
 
 	return true;
 }
@@ -34,7 +34,7 @@ protected:
 };
 
 
-//! Diffusion process with constant parameters
+//! Diffusion process with constant parameters. Updates are exact for any step size.
 class basic_diffusion
 :	public single_agent_impl<double>
 {
@@ -57,7 +57,7 @@ protected:
 };
 
 
-//! Lognormal diffusion process with constant parameters
+//! Lognormal diffusion process with constant parameters. Updates are exact for any step size.
 class basic_lognormal
 :	public single_agent_impl<double>
 {
@@ -80,7 +80,8 @@ protected:
 };
 
 
-//! Orstein-Uhlenbeck process with constant vol and reversion speed parameters
+//! Orstein-Uhlenbeck process with constant vol and reversion speed parameters. Updates use the exact
+//! transition density, taking the reversion level as constant over each step.
 class basic_ou
 :	public multi_agent_impl<double>
 {
@@ -126,6 +127,10 @@ protected:
 
 
 //! Simple jump counting process
+/*!
+	Jumps in each step are Poisson with mean intensity x year fraction, sampled exactly at any intensity
+	(see math::poisson_deviate). The random driver provides the first uniform of every draw.
+*/
 class basic_jump
 :	public basic_event
 {
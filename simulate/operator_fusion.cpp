@@ -0,0 +1,270 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Collapse trees of operator agents into single agents
+*/
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include "operator_fusion.h"
+
+namespace fbox {
+namespace simulate {
+
+
+//////////////////////////////////////////////////////
+// fused_operator
+//////////////////////////////////////////////////////
+
+void fused_operator::add_source(double_agent_ptr _source)
+{
+	node_type n;
+	n.op = fused_operation(fused_operation::LEAF);
+	n.args = std::find(m_sources.begin(),m_sources.end(),_source) - m_sources.begin();
+	n.value = n.last = 0.0;
+	n.live = true;
+
+	if (n.args == m_sources.size())
+	{
+		m_sources.push_back(_source);
+		if (_source) connect(_source);
+	}
+
+	m_nodes.push_back(n);
+}
+
+
+void fused_operator::add_operator(double_agent_ptr _agent,const fused_operation& _op,size_type _args)
+{
+	node_type n;
+	n.op = _op;
+	n.args = _args;
+	n.value = n.last = 0.0;
+	n.live = true;
+
+	m_nodes.push_back(n);
+	m_parts.push_back(_agent);
+}
+
+
+void fused_operator::init_impl()
+{
+	if (m_nodes.empty()) throw error("fused_operator has no operators");
+
+	size_type depth = 0;
+	for(size_type i = 0; i < m_nodes.size(); ++i)
+	{
+		const node_type& n = m_nodes[i];
+		if (n.op.kind == fused_operation::LEAF)
+		{
+			if (!m_sources[n.args]) throw error("Missing underlying agent in fused_operator");
+			++depth;
+		}
+		else
+		{
+			if (n.args < 1) throw error("binary_operator requires at least 1 underlying agent");
+			if (n.args > depth) throw error("Malformed fused_operator");
+			depth -= n.args - 1;
+		}
+	}
+
+	if (depth != 1) throw error("Malformed fused_operator");
+}
+
+
+bool fused_operator::evaluate(bool _reset)
+{
+	m_stack.clear();
+
+	for(size_type i = 0; i < m_nodes.size(); ++i)
+	{
+		node_type& n = m_nodes[i];
+		const fused_operation& op = n.op;
+
+		if (op.kind == fused_operation::LEAF)
+		{
+			const double_agent_ptr& s = m_sources[n.args];
+			n.value = s->state();
+			n.live = s->is_live();
+		}
+		else
+		{
+			const size_type* a = &m_stack[m_stack.size() - n.args];
+			const node_type& x = m_nodes[a[0]];
+
+			// operators whose sources are no longer live keep their state, as the agents would
+			if (_reset || n.live)
+			{
+				switch (op.kind)
+				{
+				case fused_operation::UNARY:
+					n.value = op.unary(op.op,x.value);
+					break;
+
+				case fused_operation::CUMULATIVE:
+					n.value = _reset ? x.value : op.binary(op.op,x.value,n.value);
+					break;
+
+				case fused_operation::SEQUENTIAL:
+					if (_reset) n.last = op.has_initial ? op.initial : x.value;
+					n.value = op.binary(op.op,x.value,n.last);
+					n.last = x.value;
+					break;
+
+				case fused_operation::BINARY:
+				{
+					bool live = x.live;
+					n.value = x.value;
+					for(size_type k = 1; k < n.args; ++k)
+					{
+						const node_type& y = m_nodes[a[k]];
+						live = live || y.live;
+						n.value = op.binary(op.op,n.value,y.value);
+					}
+					n.live = _reset || live;
+					break;
+				}
+
+				default:
+					throw error("Unknown operation in fused_operator");
+				}
+
+				if (op.kind != fused_operation::BINARY) n.live = _reset || x.live;
+			}
+
+			m_stack.resize(m_stack.size() - n.args);
+		}
+
+		m_stack.push_back(i);
+	}
+
+	const node_type& root = m_nodes.back();
+	m_state = root.value;
+	return root.live;
+}
+
+
+
+//////////////////////////////////////////////////////
+// fuse_operators
+//////////////////////////////////////////////////////
+
+namespace {
+
+typedef fusable_operator<double,double,default_time_type> fusable_type;
+
+
+class fusion_pass
+{
+public:
+	fusion_pass() : m_eliminated(0) {}
+
+	//! Count the readers of each operator reachable from _root
+	void add_root(const double_agent_ptr& _root)
+	{
+		m_roots.insert(_root.get());
+		count(_root);
+	}
+
+	//! Fused equivalent of _agent
+	double_agent_ptr fuse(const double_agent_ptr& _agent)
+	{
+		if (!dynamic_cast<fusable_type*>(_agent.get())) return _agent;
+
+		fused_map::iterator itr = m_fused.find(_agent.get());
+		if (itr != m_fused.end()) return itr->second;
+
+		shared_ptr<fused_operator> f( new fused_operator );
+		bool changed = false;
+		emit(*f,_agent,changed);
+
+		// a lone operator is only replaced when its sources were
+		double_agent_ptr r = _agent;
+		if (f->size() > 1 || changed)
+		{
+			r = f;
+			m_eliminated += f->size() - 1;
+		}
+
+		m_fused[_agent.get()] = r;
+		return r;
+	}
+
+	size_type eliminated() const { return m_eliminated; }
+
+private:
+	typedef std::map<const double_agent*,double_agent_ptr> fused_map;
+
+	std::set<const double_agent*> m_roots;
+	std::set<const double_agent*> m_visited;
+	std::map<const double_agent*,size_type> m_readers;
+	fused_map m_fused;
+	size_type m_eliminated;
+
+	void count(const double_agent_ptr& _agent)
+	{
+		fusable_type* op = dynamic_cast<fusable_type*>(_agent.get());
+		if (!op || !m_visited.insert(_agent.get()).second) return;
+
+		std::vector<double_agent_ptr> sources;
+		op->get_sources(sources);
+		for(size_type i = 0; i < sources.size(); ++i)
+		{
+			++m_readers[sources[i].get()];
+			count(sources[i]);
+		}
+	}
+
+	//! Append the tree of operators rooted at _agent to _f in postfix order
+	void emit(fused_operator& _f,const double_agent_ptr& _agent,bool& _changed)
+	{
+		fusable_type* op = dynamic_cast<fusable_type*>(_agent.get());
+
+		std::vector<double_agent_ptr> sources;
+		op->get_sources(sources);
+		for(size_type i = 0; i < sources.size(); ++i)
+		{
+			const double_agent_ptr& s = sources[i];
+			if (dynamic_cast<fusable_type*>(s.get()) && m_readers[s.get()] == 1 && !m_roots.count(s.get()))
+			{
+				emit(_f,s,_changed);
+			}
+			else
+			{
+				double_agent_ptr r = fuse(s);
+				_changed = _changed || r != s;
+				_f.add_source(r);
+			}
+		}
+
+		_f.add_operator(_agent,op->get_fused(),sources.size());
+	}
+};
+
+} // namespace
+
+
+size_type fuse_operators(std::vector<double_agent_ptr>& _roots)
+{
+	fusion_pass pass;
+	for(size_type i = 0; i < _roots.size(); ++i) pass.add_root(_roots[i]);
+	for(size_type i = 0; i < _roots.size(); ++i) _roots[i] = pass.fuse(_roots[i]);
+	return pass.eliminated();
+}
+
+
+size_type fuse_operators(double_agent_ptr& _root)
+{
+	std::vector<double_agent_ptr> roots(1,_root);
+	size_type n = fuse_operators(roots);
+	_root = roots[0];
+	return n;
+}
+
+
+
+} // namespace simulate
+} // namespace fbox
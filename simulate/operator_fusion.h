@@ -0,0 +1,85 @@
+#ifndef __FBOX_SIMULATE_OPERATOR_FUSION_H__
+#define __FBOX_SIMULATE_OPERATOR_FUSION_H__
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Collapse trees of operator agents into single agents
+*/
+
+#include <vector>
+#include <fbox/main.h>
+#include "agent_impl.h"
+#include "operators.h"
+
+namespace fbox {
+namespace simulate {
+
+
+//! Evaluates a whole tree of double valued operator agents inline
+/*!
+	The operators are held in postfix order, each reading the values of the ones before it, and keep
+	the semantics of the agents they replace: cumulative and sequential operators carry their state
+	across updates, and an operator whose sources are no longer live stops updating. Only the agents at
+	the leaves of the tree are connected. Built by fuse_operators().
+*/
+class fused_operator
+:	public multi_agent_impl<double,default_time_type,double_agent_ptr>
+{
+public:
+	//! Append a leaf reading the state of _source
+	void add_source(double_agent_ptr _source);
+
+	//! Append _agent, operating on the last _args operators or leaves
+	void add_operator(double_agent_ptr _agent,const fused_operation& _op,size_type _args);
+
+	//! Number of operator agents evaluated by this one
+	size_type size() const { return m_parts.size(); }
+
+protected:
+	struct node_type
+	{
+		fused_operation op;
+		size_type args;		//!< Number of arguments (operators) or index of the source (leaves)
+		double value,last;
+		bool live;
+	};
+
+	std::vector<node_type> m_nodes;
+	std::vector<double_agent_ptr> m_sources;
+	std::vector<double_agent_ptr> m_parts;	//!< Keep the fused agents, and so their operations, alive
+	std::vector<size_type> m_stack;
+
+	virtual void init_impl();
+	virtual void reset_impl() { evaluate(true); }
+	virtual bool update_impl() { return evaluate(false); }
+
+	bool evaluate(bool _reset);
+};
+
+
+//! Fuse the operator agents reachable from _roots
+/*!
+	Follows the sources of unary, binary, cumulative and sequential double valued operators from each
+	root. An operator read by exactly one other operator and not itself a root is folded into its reader,
+	so that each maximal tree becomes one fused_operator, which replaces the root of the tree in _roots.
+	Operators read in more than one place are fused on their own and shared.
+
+	The pass only sees the edges between the agents reachable from _roots: any operator also read by
+	agents outside that graph must be passed as a root. Connect consumers of the roots to the agents
+	returned in _roots, after the pass.
+
+	Returns the number of agents eliminated.
+*/
+size_type fuse_operators(std::vector<double_agent_ptr>& _roots);
+
+//! Single root version of the above
+size_type fuse_operators(double_agent_ptr& _root);
+
+
+
+} // namespace simulate
+} // namespace fbox
+
+#endif
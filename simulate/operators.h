@@ -8,6 +8,7 @@
 	Operator based on standard agents 
 */
 
+#include <vector>
 #include <fbox/main.h>
 #include <fbox/math.h>
 #include "agent_impl.h"
@@ -19,6 +20,67 @@ namespace fbox {
 namespace simulate {
 
 
+//! One operator agent as evaluated inline by fused_operator. The operation object is referred to by
+//! address and called through the function pointers, which convert to and from double.
+struct fused_operation
+{
+	enum kind_type
+	{
+		LEAF = 'l',			//!< Source agent
+		UNARY = 'u',		//!< unary_operator
+		CUMULATIVE = 'c',	//!< cumulative_operator
+		SEQUENTIAL = 's',	//!< sequential_operator
+		BINARY = 'b'		//!< binary_operator
+	};
+
+	kind_type kind;
+	const void* op;
+	double (*unary)(const void*,double);
+	double (*binary)(const void*,double,double);
+	bool has_initial;	//!< sequential_operator only
+	double initial;		//!< sequential_operator only
+
+	fused_operation(kind_type _kind = LEAF)
+	:	kind(_kind),op(0),unary(0),binary(0),has_initial(false),initial(0.0) {}
+};
+
+
+//! Calls to an operation object through fused_operation
+template<typename _op_type>
+struct fused_call
+{
+	typedef typename _op_type::source_type source_type;
+
+	static double unary(const void* _op,double _a)
+	{
+		return static_cast<double>((*static_cast<const _op_type*>(_op))(static_cast<source_type>(_a)));
+	}
+
+	static double binary(const void* _op,double _a,double _b)
+	{
+		return static_cast<double>((*static_cast<const _op_type*>(_op))(static_cast<source_type>(_a),static_cast<source_type>(_b)));
+	}
+};
+
+
+//! Interface of the operator agents below, used by fuse_operators() to look through them
+template<typename _source_type,typename _target_type,typename _time_type>
+class fusable_operator
+{
+public:
+	typedef boost::shared_ptr<basic_valued_agent<_source_type,_time_type> > source_agent_ptr;
+
+	virtual ~fusable_operator() {}
+
+	//! Append the agents this operator reads, in order, to _sources
+	virtual void get_sources(std::vector<source_agent_ptr>& _sources) const = 0;
+
+	//! Inline form of this operator
+	virtual fused_operation get_fused() const = 0;
+};
+
+
+
 //! Unary operator
 template
 <
@@ -33,7 +95,8 @@ class unary_operator
 		_time_type,
 		boost::shared_ptr<basic_valued_agent<typename _op_type::source_type,_time_type> >,
 		_duration_type
-	>
+	>,
+	public fusable_operator<typename _op_type::source_type,typename _op_type::target_type,_time_type>
 {
 public:
 	typedef _op_type operation_type;
@@ -45,6 +108,16 @@ public:
 
 	operation_type& get_operation() { return m_op; }
 
+	virtual void get_sources(std::vector<source_agent_ptr>& _sources) const { _sources.push_back(this->m_linked_policy.linked()); }
+
+	virtual fused_operation get_fused() const
+	{
+		fused_operation f(fused_operation::UNARY);
+		f.op = &m_op;
+		f.unary = &fused_call<operation_type>::unary;
+		return f;
+	}
+
 protected:
 	operation_type m_op;
 
@@ -81,7 +154,8 @@ class cumulative_operator
 		_time_type,
 		boost::shared_ptr<basic_valued_agent<typename _op_type::source_type,_time_type> >,
 		_duration_type
-	>
+	>,
+	public fusable_operator<typename _op_type::source_type,typename _op_type::target_type,_time_type>
 {
 public:
 	typedef _op_type operation_type;
@@ -93,6 +167,16 @@ public:
 	
 	operation_type& get_operation() { return m_op; }
 
+	virtual void get_sources(std::vector<source_agent_ptr>& _sources) const { _sources.push_back(this->m_linked_policy.linked()); }
+
+	virtual fused_operation get_fused() const
+	{
+		fused_operation f(fused_operation::CUMULATIVE);
+		f.op = &m_op;
+		f.binary = &fused_call<operation_type>::binary;
+		return f;
+	}
+
 protected:
 	operation_type m_op;
 
@@ -128,7 +212,8 @@ class sequential_operator
 		_time_type,
 		boost::shared_ptr<basic_valued_agent<typename _op_type::source_type,_time_type> >,
 		_duration_type
-	>
+	>,
+	public fusable_operator<typename _op_type::source_type,typename _op_type::target_type,_time_type>
 {
 public:
 	typedef _op_type operation_type;
@@ -145,6 +230,18 @@ public:
 
 	operation_type& get_operation() { return m_op; }
 
+	virtual void get_sources(std::vector<source_agent_ptr>& _sources) const { _sources.push_back(this->m_linked_policy.linked()); }
+
+	virtual fused_operation get_fused() const
+	{
+		fused_operation f(fused_operation::SEQUENTIAL);
+		f.op = &m_op;
+		f.binary = &fused_call<operation_type>::binary;
+		f.has_initial = m_has_initial;
+		f.initial = static_cast<double>(m_initial);
+		return f;
+	}
+
 protected:
 	operation_type m_op;
 	source_type m_last,m_initial;
@@ -170,7 +267,8 @@ class binary_operator
 		_time_type,
 		boost::shared_ptr<basic_valued_agent<typename _op_type::source_type,_time_type> >,
 		_duration_type
-	>
+	>,
+	public fusable_operator<typename _op_type::source_type,typename _op_type::target_type,_time_type>
 {
 public:
 	typedef _op_type operation_type;
@@ -184,6 +282,19 @@ public:
 
 	operation_type& get_operation() { return m_op; }
 
+	virtual void get_sources(std::vector<source_agent_ptr>& _sources) const
+	{
+		_sources.insert(_sources.end(),this->linked().begin(),this->linked().end());
+	}
+
+	virtual fused_operation get_fused() const
+	{
+		fused_operation f(fused_operation::BINARY);
+		f.op = &m_op;
+		f.binary = &fused_call<operation_type>::binary;
+		return f;
+	}
+
 protected:
 	operation_type m_op;
 
@@ -0,0 +1,209 @@
+#ifndef __FBOX_SIMULATE_PIPELINE_H__
+#define __FBOX_SIMULATE_PIPELINE_H__
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Statically composed model pipelines
+
+	A pipeline is a fixed chain of stages, each one mapping the value of the stage before it to its own,
+	wrapped in a single agent. The stages are policies combined by templates, so a whole chain compiles
+	into one update function with no links or virtual calls between stages. A stage provides:
+
+	<code>
+	struct my_stage
+	{
+		double reset(double _in);						// value at reset, given the input's
+		double update(double _in,const stage_step& _step);	// value after a step, given the input's
+	};
+	</code>
+
+	For example, the following agent updates exactly as a <code>basic_lognormal</code> driven by a
+	<code>gaussian_variate</code>, from the same random numbers:
+
+	<code>
+	typedef chain<uniform_stage,chain<normal_stage,lognormal_stage> > gbm_stages;
+	shared_ptr<pipeline<gbm_stages> > gbm( new pipeline<gbm_stages> );
+	gbm->stages().second().second().setup(0.05,0.2,100.0);
+	</code>
+*/
+
+#include <cmath>
+#include <boost/math/distributions/normal.hpp>
+#include <fbox/main.h>
+#include <fbox/option.h>
+#include "agent_impl.h"
+#include "models.h"
+
+namespace fbox {
+namespace simulate {
+
+
+//! What stages see of each update
+struct stage_step
+{
+	double dt;			//!< Step length as a year fraction
+	generator* rnd;		//!< Path random number generator
+};
+
+
+//! Stage feeding the output of _first into _second
+template<typename _first,typename _second>
+class chain
+{
+public:
+	typedef _first first_type;
+	typedef _second second_type;
+
+	first_type& first() { return m_first; }
+	second_type& second() { return m_second; }
+
+	double reset(double _in) { return m_second.reset(m_first.reset(_in)); }
+	double update(double _in,const stage_step& _step) { return m_second.update(m_first.update(_in,_step),_step); }
+
+private:
+	first_type m_first;
+	second_type m_second;
+};
+
+
+//! Agent evaluating the stages _stages. The input of the first stage is the state of the source agent,
+//! if one is set, and zero otherwise.
+template<typename _stages>
+class pipeline
+:	public multi_agent_impl<double,default_time_type,double_agent_ptr>
+{
+public:
+	typedef _stages stages_type;
+
+	//! Agent feeding the first stage
+	void set_source(double_agent_ptr _source)
+	{
+		clear_connected();
+		if (mp_src = _source) connect(_source);
+	}
+
+	stages_type& stages() { return m_stages; }
+
+protected:
+	stages_type m_stages;
+	double_agent_ptr mp_src;
+	fbox::simulate::year_fraction<double> year_fraction;
+
+	double input() const { return mp_src ? mp_src->state() : 0.0; }
+
+	virtual void reset_impl() { m_state = m_stages.reset(input()); }
+
+	virtual bool update_impl()
+	{
+		stage_step step;
+		step.dt = year_fraction.yf(time_interval());
+		step.rnd = mp_rnd;
+		m_state = m_stages.update(input(),step);
+		return true;
+	}
+};
+
+
+
+//////////////////////////////////////////////////////
+// Stages
+//////////////////////////////////////////////////////
+
+//! Uniform deviate in [0,1] drawn on each update (see uniform_variate). Zero at reset.
+struct uniform_stage
+{
+	double reset(double /*_in*/) { return 0.0; }
+	double update(double /*_in*/,const stage_step& _step) { return _step.rnd->rnd(); }
+};
+
+
+//! Maps uniform inputs to standard normal deviates. Like gaussian_variate there is no draw at reset,
+//! where the value is zero.
+struct normal_stage
+{
+	double reset(double /*_in*/) { return 0.0; }
+	double update(double _in,const stage_step& /*_step*/) { return boost::math::quantile(m_dist,_in); }
+
+private:
+	boost::math::normal m_dist;
+};
+
+
+//! Diffusion driven by standard normal inputs (see basic_diffusion)
+class diffusion_stage
+{
+public:
+	diffusion_stage() : m_drift(0.0),m_vol(0.0),m_initial(0.0),m_state(0.0) {}
+
+	void setup(double _drift,double _volatility,double _initial=0.0)
+	{
+		m_drift = _drift;
+		m_vol = _volatility;
+		m_initial = _initial;
+	}
+
+	double reset(double /*_in*/) { return m_state = m_initial; }
+
+	double update(double _in,const stage_step& _step)
+	{
+		return m_state += m_drift * _step.dt + m_vol * std::sqrt(_step.dt) * _in;
+	}
+
+private:
+	double m_drift,m_vol,m_initial,m_state;
+};
+
+
+//! Lognormal diffusion driven by standard normal inputs (see basic_lognormal)
+class lognormal_stage
+{
+public:
+	lognormal_stage() : m_drift(0.0),m_vol(0.0),m_initial(0.0),m_state(0.0) {}
+
+	void setup(double _drift,double _volatility,double _initial=0.0)
+	{
+		m_drift = _drift;
+		m_vol = _volatility;
+		m_initial = _initial;
+	}
+
+	double reset(double /*_in*/) { return m_state = m_initial; }
+
+	double update(double _in,const stage_step& _step)
+	{
+		return m_state *= std::exp( (m_drift - m_vol*m_vol / 2.0) * _step.dt + m_vol * std::sqrt(_step.dt) * _in );
+	}
+
+private:
+	double m_drift,m_vol,m_initial,m_state;
+};
+
+
+//! Undiscounted option payoff on the input
+class payoff_stage
+{
+public:
+	payoff_stage() : m_cp('c'),m_strike(0.0) {}
+
+	void setup(char _call_put,double _strike)
+	{
+		m_cp = _call_put;
+		m_strike = _strike;
+	}
+
+	double reset(double _in) { return fbox::finance::option_intrinsic(m_cp,m_strike,_in,1.0); }
+	double update(double _in,const stage_step& /*_step*/) { return fbox::finance::option_intrinsic(m_cp,m_strike,_in,1.0); }
+
+private:
+	char m_cp;
+	double m_strike;
+};
+
+
+
+} // namespace simulate
+} // namespace fbox
+
+#endif
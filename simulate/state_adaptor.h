@@ -67,6 +67,7 @@ public:
 
 	virtual const state_type& state() const { return m_convert(); }
 	virtual bool is_live() const { return mp_agent->is_live(); }
+	virtual bool unschedule(std::vector<typename parent_type::basic_agent_type*>& _deps) { return mp_agent->unschedule(_deps); }
 	virtual void init(const time_type& _start,const time_type& _end,generator* _random) { mp_agent->init(_start,_end,_random); }
 	virtual void reset() { mp_agent->reset(); }
 	virtual void update(const time_type& _time) { return mp_agent->update(_time); }
@@ -9,12 +9,14 @@
 
 #define BOOST_TEST_MAIN
 #include <boost/test/unit_test.hpp>
+#include <sstream>
 #include <fbox/math.h>
 #include "../simulator.h"
 #include "../observer.h"
 #include "../agent_impl.h"
 #include "../basic_agents.h"
 #include "../memory.h"
+#include "../dump.h"
 
 
 using namespace fbox::simulate;
@@ -88,6 +90,64 @@ BOOST_AUTO_TEST_CASE(test_agent)
 }
 
 
+//! Counts its updates
+class agent3 : public standalone_agent_impl<int>
+{
+protected:
+	virtual void reset_impl() { m_state = 0; }
+	virtual bool update_impl() { ++m_state; return true; }
+};
+
+//! Live until time 5, counts calls to update()
+class agent4 : public multi_agent_impl<double>
+{
+public:
+	agent4() : calls(0) {}
+	int calls;
+
+	virtual void update(const time_type& _time) { ++calls; multi_agent_impl<double>::update(_time); }
+
+protected:
+	virtual bool update_impl() { return time() < 5; }
+};
+
+
+BOOST_AUTO_TEST_CASE(test_dormant_agents)
+{
+	boost::shared_ptr<agent3> c1(new agent3);
+	boost::shared_ptr<agent3> c2(new agent3);
+	boost::shared_ptr<agent4> p1(new agent4);
+	boost::shared_ptr<agent4> d1(new agent4);
+	boost::shared_ptr<agent4> d2(new agent4);
+	boost::shared_ptr<agent2> p2(new agent2);
+	p1->linked().connect(c1);
+	d1->linked().connect(d2);
+	p2->linked().connect(p1);
+	p2->linked().connect(c2);
+	p2->linked().connect(d1);
+
+	p2->init(0,10,0);
+	for(int path = 0; path < 2; ++path)
+	{
+		p1->calls = d1->calls = d2->calls = 0;
+		p2->reset();
+		for(int t = 1; t <= 10; ++t) p2->update(t);
+
+		// p1 is dropped once it stops at time 5, and the live agent below it takes its place
+		BOOST_CHECK(!p1->is_live());
+		BOOST_CHECK_EQUAL(p1->time(),5);
+		BOOST_CHECK_EQUAL(p1->calls,5);
+		BOOST_CHECK_EQUAL(c1->state(),10);
+		BOOST_CHECK_EQUAL(c2->state(),10);
+		BOOST_CHECK_EQUAL(p2->state(),30.0);
+
+		// d2 stops with d1 and is dropped by it first, so nothing takes d1's place
+		BOOST_CHECK_EQUAL(d1->calls,5);
+		BOOST_CHECK_EQUAL(d2->calls,5);
+	}
+}
+
+
 BOOST_AUTO_TEST_CASE(test_time)
 {
 	boost::shared_ptr<fbox::simulate::time> t(new fbox::simulate::time);
@@ -519,3 +579,52 @@ BOOST_AUTO_TEST_CASE(test_gearbox)
 	BOOST_CHECK_EQUAL(a->time(),100);
 	BOOST_CHECK_EQUAL(g->time(),100);
 }
+
+
+BOOST_AUTO_TEST_CASE(test_dump_graph)
+{
+	// layers of two agents, each depending on both agents in the layer below
+	const int layers = 20;
+	boost::shared_ptr<agent1> base(new agent1(1.0));
+	std::vector<boost::shared_ptr<agent2> > nodes;
+	for(int i = 0; i < 2 * layers; ++i)
+	{
+		boost::shared_ptr<agent2> a(new agent2);
+		if (i < 2)
+			a->linked().connect(base);
+		else
+		{
+			a->linked().connect(nodes[i - 2 - i % 2]);
+			a->linked().connect(nodes[i - 1 - i % 2]);
+		}
+		nodes.push_back(a);
+	}
+
+	std::vector<boost::shared_ptr<agent2> > roots(nodes.end() - 2,nodes.end());
+	std::stringstream graph;
+	dump_graph(graph,roots);
+
+	// every agent written once, every other link as a reference
+	int agents = 0,refs = 0;
+	fbox::xml::pull_parser xml(graph);
+	while (xml.next() != fbox::xml::pull_parser::END_DOCUMENT)
+	{
+		if (xml.event() != fbox::xml::pull_parser::START_ELEMENT) continue;
+		if (xml.name() == "agent") ++agents;
+		if (xml.name() == "ref") ++refs;
+	}
+
+	BOOST_CHECK_EQUAL(2 * layers + 1,agents);
+	BOOST_CHECK_EQUAL(2 * layers - 1,refs);
+
+	// plain dumps are unchanged outside dump_graph, and well formed
+	std::stringstream plain;
+	plain << *nodes[5];
+	BOOST_CHECK_EQUAL(std::string::npos,plain.str().find("<agent"));
+
+	fbox::xml::pull_parser xml2(plain);
+	int elements = 0;
+	while (xml2.next() != fbox::xml::pull_parser::END_DOCUMENT)
+		if (xml2.event() == fbox::xml::pull_parser::START_ELEMENT) ++elements;
+	BOOST_CHECK_EQUAL(7,elements); // the shared subtrees are repeated
+}
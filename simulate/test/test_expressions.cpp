@@ -0,0 +1,347 @@
+/*!
+	\file
+	\copyright Copyright (c) 2015 Pedro Tavares
+	\warning Please refer to the copyright notices and important disclaimers in file 'LICENSE'
+
+	Test expressions and expression agents
+*/
+
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+#include "../expressions.h"
+#include "../expression_parser.h"
+#include "../basic_agents.h"
+
+
+using namespace fbox::simulate;
+
+typedef boost::shared_ptr<basic_expression<double> > expr_ptr;
+typedef boost::shared_ptr<basic_expression<bool> > bool_expr_ptr;
+
+
+//! Counts its evaluations
+class counting_expression : public basic_expression<double>
+{
+public:
+	counting_expression(double _v) : count(0),m_v(_v) {}
+	virtual double value() { ++count; return m_v; }
+	int count;
+
+private:
+	double m_v;
+};
+
+
+BOOST_AUTO_TEST_CASE(test_expression_program)
+{
+	using namespace operators;
+
+	boost::shared_ptr<constant<double> > x( new constant<double>(3.0) );
+	expr_ptr s( new state_linked_expression<constant<double> >(x) );
+	expr_ptr two( new constant_expression<double>(2.0) );
+	expr_ptr five( new constant_expression<double>(5.0) );
+
+	// (x - (2 * 5)) / exp(2), max with -1, plus ln(x)
+	expr_ptr c10( new binary_expression<product>(two,five) );
+	expr_ptr e2( new unary_expression<natural_exponent>(two) );
+	expr_ptr d( new binary_expression<division>(expr_ptr( new binary_expression<difference>(s,c10) ),e2) );
+	expr_ptr m( new binary_expression<maximum>(d,expr_ptr( new constant_expression<double>(-1.0) )) );
+	expr_ptr f( new binary_expression<sum>(m,expr_ptr( new unary_expression<natural_logarithm>(s) )) );
+
+	expression_program p;
+	p.compile(*f);
+	BOOST_CHECK_EQUAL(p.run(),f->value());
+
+	// 2*5 and exp(2) are folded: leaf, 10, -, exp(2), /, -1, max, leaf, ln, +
+	BOOST_CHECK_EQUAL(p.size(),10u);
+
+	x->setup(0.5);
+	BOOST_CHECK_EQUAL(p.run(),f->value());
+
+	// constant trees fold to a single instruction
+	p.compile(*c10);
+	BOOST_CHECK(p.is_constant());
+	BOOST_CHECK_EQUAL(p.run(),10.0);
+
+	// comparisons, logical and integer operators go through their register values
+	bool_expr_ptr gt( new binary_expression<greater_than>(s,two) );
+	bool_expr_ptr both( new binary_expression<land>(gt,bool_expr_ptr( new unary_expression<lnot>(gt) )) );
+	boost::shared_ptr<basic_expression<double> > mod( new binary_expression<modulus>(
+		boost::shared_ptr<basic_expression<int> >( new constant_expression<int>(7) ),
+		boost::shared_ptr<basic_expression<int> >( new expression_converter<double,int>(five) )) );
+
+	p.compile(*mod);
+	BOOST_CHECK_EQUAL(p.run(),2.0);
+
+	for(double v = -1.0; v < 5.0; v += 1.0)
+	{
+		x->setup(v);
+		expression_program q;
+		q.compile(*gt);
+		BOOST_CHECK_EQUAL(q.run(),gt->value() ? 1.0 : 0.0);
+		q.compile(*both);
+		BOOST_CHECK_EQUAL(q.run(),0.0);
+	}
+}
+
+
+//! Sum of a vector, an operator over a non-scalar
+struct vector_sum : public operators::basic_operator<std::vector<double>,double>
+{
+	double operator() (const std::vector<double>& _a) const { double s = 0.0; for(fbox::size_type i = 0; i < _a.size(); ++i) s += _a[i]; return s; }
+};
+
+
+//! Vector valued expression
+class vector_expression : public basic_expression<std::vector<double> >
+{
+public:
+	vector_expression() : v(2,1.0) {}
+	virtual std::vector<double> value() { return v; }
+	std::vector<double> v;
+};
+
+
+BOOST_AUTO_TEST_CASE(test_expression_operator_state)
+{
+	using namespace operators;
+
+	boost::shared_ptr<constant<double> > x( new constant<double>(0.5) );
+	expr_ptr s( new state_linked_expression<constant<double> >(x) );
+	expression_program p;
+
+	// operators with state are called on the node's own operator object
+	boost::shared_ptr<unary_expression<factor> > scaled( new unary_expression<factor>(s) );
+	scaled->get_operation().setup(4.0);
+	p.compile(*scaled);
+	BOOST_CHECK_EQUAL(p.run(),2.0);
+	scaled->get_operation().setup(-1.0);
+	BOOST_CHECK_EQUAL(p.run(),-0.5);
+	BOOST_CHECK_EQUAL(p.run(),scaled->value());
+
+	// and folded with it
+	boost::shared_ptr<unary_expression<factor> > folded( new unary_expression<factor>(expr_ptr( new constant_expression<double>(5.0) )) );
+	folded->get_operation().setup(3.0);
+	p.compile(*folded);
+	BOOST_CHECK(p.is_constant());
+	BOOST_CHECK_EQUAL(p.run(),15.0);
+
+	boost::math::normal n(1.0,2.0);
+	boost::shared_ptr<unary_expression<distribution<boost::math::normal> > > cdf( new unary_expression<distribution<boost::math::normal> >(s) );
+	cdf->get_operation().get_distribution() = n;
+	p.compile(*cdf);
+	BOOST_CHECK_CLOSE(p.run(),boost::math::cdf(n,0.5),1e-12);
+
+	boost::shared_ptr<unary_expression<inverse_distribution<boost::math::normal> > > q( new unary_expression<inverse_distribution<boost::math::normal> >(expr_ptr(cdf)) );
+	q->get_operation().get_distribution() = n;
+	p.compile(*q);
+	BOOST_CHECK_CLOSE(p.run(),0.5,1e-10);
+	x->setup(2.0);
+	BOOST_CHECK_CLOSE(p.run(),2.0,1e-10);
+
+	// operators over non-scalars are opaque leaves
+	boost::shared_ptr<vector_expression> v( new vector_expression );
+	expr_ptr total( new binary_expression<product>(expr_ptr( new unary_expression<vector_sum>(v) ),s) );
+	p.compile(*total);
+	BOOST_CHECK_EQUAL(p.run(),4.0);
+	v->v.push_back(2.0);
+	BOOST_CHECK_EQUAL(p.run(),8.0);
+}
+
+
+BOOST_AUTO_TEST_CASE(test_expression_select)
+{
+	using namespace operators;
+
+	boost::shared_ptr<constant<double> > x( new constant<double>(3.0) );
+	expr_ptr s( new state_linked_expression<constant<double> >(x) );
+	expr_ptr two( new constant_expression<double>(2.0) );
+
+	boost::shared_ptr<counting_expression> yes( new counting_expression(1.0) );
+	boost::shared_ptr<counting_expression> no( new counting_expression(-1.0) );
+	bool_expr_ptr cond( new binary_expression<greater_than>(s,two) );
+	expr_ptr sel( new fbox::simulate::select<double>(cond,yes,no) );
+	expr_ptr f( new binary_expression<product>(sel,expr_ptr( new constant_expression<double>(10.0) )) );
+
+	expression_program p;
+	p.compile(*f);
+
+	// only the branch taken is evaluated
+	BOOST_CHECK_EQUAL(p.run(),10.0);
+	BOOST_CHECK_EQUAL(yes->count,1);
+	BOOST_CHECK_EQUAL(no->count,0);
+
+	x->setup(1.0);
+	BOOST_CHECK_EQUAL(p.run(),-10.0);
+	BOOST_CHECK_EQUAL(yes->count,1);
+	BOOST_CHECK_EQUAL(no->count,1);
+
+	// a constant condition selects the branch when compiled
+	bool_expr_ptr always( new binary_expression<less_than>(two,expr_ptr( new constant_expression<double>(3.0) )) );
+	expr_ptr csel( new fbox::simulate::select<double>(always,yes,no) );
+	p.compile(*csel);
+	BOOST_CHECK_EQUAL(p.size(),1u);
+	BOOST_CHECK_EQUAL(p.run(),1.0);
+	BOOST_CHECK_EQUAL(no->count,1);
+
+	// nested selects
+	expr_ptr nested( new fbox::simulate::select<double>(cond,sel,expr_ptr( new fbox::simulate::select<double>(cond,two,sel) )) );
+	p.compile(*nested);
+	for(double v = 0.0; v < 5.0; v += 0.5)
+	{
+		x->setup(v);
+		BOOST_CHECK_EQUAL(p.run(),nested->value());
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(test_expression_agents)
+{
+	using namespace operators;
+
+	boost::shared_ptr<fbox::simulate::time> t( new fbox::simulate::time );
+	typedef state_linked_expression<fbox::simulate::time> time_expr;
+	expr_ptr te( new time_expr(t) );
+	expr_ptr half( new constant_expression<double>(0.5) );
+
+	boost::shared_ptr<expression_agent> a( new expression_agent );
+	a->setup(expr_ptr( new binary_expression<product>(te,half) ));
+	a->linked().connect(t);
+
+	boost::shared_ptr<multi_expression_agent> m( new multi_expression_agent );
+	m->setup(2);
+	m->set_all(0,te);
+	m->set_all(1,expr_ptr( new binary_expression<sum>(te,half) ));
+	m->linked().connect(t);
+
+	a->init(0,10,0);
+	m->init(0,10,0);
+	a->reset();
+	m->reset();
+	BOOST_CHECK_EQUAL(a->state(),0.0);
+
+	for(int i = 1; i <= 10; ++i)
+	{
+		a->update(i);
+		m->update(i);
+		BOOST_CHECK_EQUAL(a->state(),0.5 * i);
+		BOOST_CHECK_EQUAL(m->state()[0],double(i));
+		BOOST_CHECK_EQUAL(m->state()[1],i + 0.5);
+	}
+}
+
+
+//! Counts the reads of its state
+class counting_constant : public constant<double>
+{
+public:
+	counting_constant(double _v) : constant<double>(_v),count(0) {}
+	virtual const double& state() const { ++count; return constant<double>::state(); }
+	mutable int count;
+};
+
+
+BOOST_AUTO_TEST_CASE(test_expression_parser)
+{
+	boost::shared_ptr<constant<double> > s( new constant<double>(110.0) );
+	boost::shared_ptr<constant<double> > df( new constant<double>(0.9) );
+
+	expression_parser parser;
+	parser.define("S",s);
+	parser.define("df",df);
+	parser.define("K",100.0);
+
+	BOOST_CHECK_CLOSE(parser.parse("max(S-K,0)*df")->value(),9.0,1e-12);
+	BOOST_CHECK_EQUAL(parser.parse("if(S>K,1,2)")->value(),1.0);
+	BOOST_CHECK_EQUAL(parser.parse("2^3^2")->value(),512.0);
+	BOOST_CHECK_EQUAL(parser.parse("-2^2")->value(),-4.0);
+	BOOST_CHECK_CLOSE(parser.parse("1e-2*S + 2.5E+1")->value(),26.1,1e-12);
+	BOOST_CHECK_CLOSE(parser.parse("sqrt(abs(K - S)) / pow(2,-1)")->value(),2.0 * std::sqrt(10.0),1e-12);
+	BOOST_CHECK_CLOSE(parser.parse("exp(log(df))")->value(),0.9,1e-12);
+	BOOST_CHECK_EQUAL(parser.parse("(S <= K) + (S != K) + (S == S) + min(S,K)")->value(),102.0);
+
+	s->setup(90.0);
+	BOOST_CHECK_EQUAL(parser.parse("if(S>K,1,2)")->value(),2.0);
+	BOOST_CHECK_EQUAL(parser.parse("max(S-K,0)*df")->value(),0.0);
+
+	// hash-consing
+	BOOST_CHECK(parser.parse("max(S-K,0)*df") == parser.parse("max(S - K, 0) * df"));
+	BOOST_CHECK(parser.parse("S*2") != parser.parse("2*S"));
+
+	BOOST_CHECK_THROW(parser.parse("S+"),fbox::error);
+	BOOST_CHECK_THROW(parser.parse("(S"),fbox::error);
+	BOOST_CHECK_THROW(parser.parse("X*2"),fbox::error);
+	BOOST_CHECK_THROW(parser.parse("foo(S)"),fbox::error);
+	BOOST_CHECK_THROW(parser.parse("max(S)"),fbox::error);
+	BOOST_CHECK_THROW(parser.parse("S # 2"),fbox::error);
+}
+
+
+BOOST_AUTO_TEST_CASE(test_expression_sharing)
+{
+	boost::shared_ptr<counting_constant> x( new counting_constant(3.0) );
+
+	expression_parser parser;
+	parser.define("x",x);
+
+	// x*x+1 appears in all three outputs, exp(x*x+1) in two
+	boost::shared_ptr<multi_expression_agent> m( new multi_expression_agent );
+	m->setup(3);
+	m->set_all(0,parser.parse("x*x+1"));
+	m->set_all(1,parser.parse("exp(x*x+1) - 1"));
+	m->set_all(2,parser.parse("(x*x+1) * exp(x*x+1)"));
+	parser.connect(*m);
+
+	BOOST_CHECK_EQUAL(parser.shared(),2u); // x*x+1 and exp(x*x+1), but not x*x whose only parent is x*x+1
+
+	m->init(0,10,0);
+	m->reset();
+	BOOST_CHECK_EQUAL(m->state()[0],10.0);
+	BOOST_CHECK_CLOSE(m->state()[1],std::exp(10.0) - 1.0,1e-12);
+	BOOST_CHECK_CLOSE(m->state()[2],10.0 * std::exp(10.0),1e-12);
+
+	// x is read twice (x*x) per evaluation however many outputs use it
+	for(int i = 1; i <= 5; ++i)
+	{
+		x->setup(double(i));
+		x->count = 0;
+		m->update(i);
+		BOOST_CHECK_EQUAL(x->count,2);
+		BOOST_CHECK_EQUAL(m->state()[0],i * i + 1.0);
+		BOOST_CHECK_CLOSE(m->state()[2],(i * i + 1.0) * std::exp(i * i + 1.0),1e-12);
+	}
+
+	// shared nodes evaluated directly, or by programs run without a round, are always recomputed
+	boost::shared_ptr<constant<double> > s( new constant<double>(1.0) );
+	parser.define("S",s);
+	expr_ptr twice = parser.parse("S*2");
+	BOOST_CHECK_EQUAL(twice->value(),2.0);
+	BOOST_CHECK(parser.parse("S*2") == twice);
+
+	s->setup(5.0);
+	BOOST_CHECK_EQUAL(twice->value(),10.0);
+
+	expression_program p;
+	p.compile(*parser.parse("S*2 + S*2"));
+	BOOST_CHECK_EQUAL(p.run(),20.0);
+	s->setup(6.0);
+	BOOST_CHECK_EQUAL(p.run(),24.0);
+
+	// within a round they are computed once
+	evaluation_round round;
+	BOOST_CHECK_EQUAL(p.run(&round),24.0);
+	s->setup(7.0);
+	BOOST_CHECK_EQUAL(p.run(&round),24.0);
+	round.next();
+	BOOST_CHECK_EQUAL(p.run(&round),28.0);
+
+	// repeated text is not enough: S-K has the one parent max(S-K,0) in both formulas
+	expression_parser payoff;
+	payoff.define("S",s);
+	payoff.define("K",5.0);
+	payoff.define("df",0.9);
+	payoff.parse("max(S-K,0)*df");
+	payoff.parse("max(S-K,0)>0");
+	BOOST_CHECK_EQUAL(payoff.shared(),1u);
+}
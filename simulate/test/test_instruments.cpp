@@ -249,6 +249,249 @@ BOOST_AUTO_TEST_CASE(test_float_coupon)
 
 
 
+BOOST_AUTO_TEST_CASE(test_coupon_leg)
+{
+	boost::shared_ptr<fbox::math::linear_line> df = get_df();
+
+	boost::shared_ptr<gaussian_variate> rnd( new gaussian_variate );
+	boost::shared_ptr<hw_yield_curve> yc( new hw_yield_curve );
+	yc->setup(rnd,df,0.1,0.01);
+
+	boost::shared_ptr<fbox::simulate::time> index( new fbox::simulate::time );
+
+	// the same coupons as a single leg agent (added in reverse) and as a portfolio of coupon agents
+	boost::shared_ptr<instruments::coupon_leg> leg( new instruments::coupon_leg );
+	leg->setup(yc);
+	boost::shared_ptr<instruments::portfolio> graph( new instruments::portfolio );
+
+	for(int i = 39; i >= 0; --i)
+	{
+		int t0 = 91 * i,t1 = t0 + 91,tp = t1 + 2;
+
+		boost::shared_ptr<instruments::fixed_coupon> fc( new instruments::fixed_coupon );
+		fc->setup(yc,t0,t1,tp,0.04,0.25);
+		leg->add_fixed(t0,t1,tp,0.04,0.25);
+		graph->add_instrument(fc);
+
+		boost::shared_ptr<instruments::vanilla_float_coupon> vc( new instruments::vanilla_float_coupon );
+		vc->setup(yc,t0,t0,t1,tp,-1.0,0.25);
+		leg->add_float(t0,t0,t1,tp,-1.0,0.25);
+		graph->add_instrument(vc);
+
+		boost::shared_ptr<instruments::float_coupon> ic( new instruments::float_coupon );
+		ic->setup(yc,t0,t0,t1,tp,index,1e-5,0.25);
+		leg->add_float(t0,t0,t1,tp,index,1e-5,0.25);
+		graph->add_instrument(ic);
+	}
+
+	boost::shared_ptr<instruments::fixed_payment> pay( new instruments::fixed_payment );
+	pay->setup(yc,3642,100.0);
+	leg->add_payment(3642,100.0);
+	graph->add_instrument(pay);
+
+	BOOST_CHECK_EQUAL(leg->size(),121u);
+
+	generator g;
+	leg->init(0,3700,&g);
+	graph->init(0,3700,&g);
+
+	for(int path = 0; path < 3; ++path)
+	{
+		g.reset();
+		yc->reset();
+		leg->reset();
+		graph->reset();
+
+		double paid = 0.0;
+		for(int t = 0; t <= 3700; t += 30)
+		{
+			leg->update(t);
+			graph->update(t);
+
+			BOOST_REQUIRE_CLOSE(leg->state().value,graph->state().value,1e-10);
+			BOOST_REQUIRE_CLOSE(leg->state().flow + 1.0,graph->state().flow + 1.0,1e-10);
+			paid += leg->state().flow;
+		}
+
+		BOOST_CHECK(leg->state().matured);
+		BOOST_CHECK_SMALL(leg->state().value,1e-12);
+		BOOST_CHECK(paid > 100.0);
+	}
+}
+
+
+
+BOOST_AUTO_TEST_CASE(test_portfolio_netting)
+{
+	boost::shared_ptr<fbox::math::linear_line> df = get_df();
+
+	boost::shared_ptr<gaussian_variate> rnd( new gaussian_variate );
+	boost::shared_ptr<hw_yield_curve> yc( new hw_yield_curve );
+	yc->setup(rnd,df,0.1,0.01);
+
+	// netted and plain portfolios of the same legs, with overlapping schedules
+	boost::shared_ptr<instruments::portfolio> netted( new instruments::portfolio );
+	boost::shared_ptr<instruments::portfolio> plain( new instruments::portfolio );
+	netted->set_netting(true);
+
+	std::vector<boost::shared_ptr<instruments::fixed_leg> > legs;
+	for(int i = 0; i < 50; ++i)
+	{
+		boost::shared_ptr<instruments::fixed_leg> leg( new instruments::fixed_leg );
+		leg->setup(yc,(i % 5) * 30,1000 + 91 * (i % 20),91,1.0 + i,100.0);
+		legs.push_back(leg);
+
+		double w = (i % 2) ? 1.0 : -0.5;
+		netted->add_instrument(leg,w);
+		plain->add_instrument(leg,w);
+	}
+
+	// instruments without deterministic flows are simulated as usual
+	boost::shared_ptr<instruments::coupon_leg> floats( new instruments::coupon_leg );
+	floats->setup(yc);
+	for(int i = 0; i < 10; ++i) floats->add_float(91 * i,91 * i,91 * (i + 1),91 * (i + 1),1.0,0.25);
+	netted->add_instrument(floats);
+	plain->add_instrument(floats);
+
+	// derived legs are not netted unless they opt in
+	boost::shared_ptr<instruments::risky_leg> risky( new instruments::risky_leg );
+	risky->setup(yc,yc);
+	risky->set_schedule(0,1820,91,2.0);
+	netted->add_instrument(risky);
+	plain->add_instrument(risky);
+
+	BOOST_CHECK(netted->netted(0));
+	BOOST_CHECK(!netted->netted(50));
+	BOOST_CHECK(!netted->netted(51));
+	BOOST_CHECK(!plain->netted(0));
+
+	// only the curve, the float leg and the risky leg (with their weights) remain connected
+	BOOST_CHECK_EQUAL(netted->linked().count_connected(),5u);
+
+	generator g;
+	for(int round = 0; round < 2; ++round)
+	{
+		// netted legs changed after they were added are read again by init()
+		if (round == 1)
+		{
+			legs[0]->clear();
+			legs[1]->set_schedule(0,2500,182,7.0);
+			legs[2]->add(2900,50.0);
+		}
+
+		netted->init(0,3000,&g);
+		plain->init(0,3000,&g);
+
+		for(int path = 0; path < 3; ++path)
+		{
+			g.reset();
+			yc->reset();
+			netted->reset();
+			plain->reset();
+
+			for(int t = 0; t <= 3000; t += 30)
+			{
+				netted->update(t);
+				plain->update(t);
+
+				BOOST_REQUIRE_CLOSE(netted->state().value,plain->state().value,1e-10);
+				BOOST_REQUIRE_SMALL(netted->state().flow - plain->state().flow,1e-9);
+			}
+		}
+	}
+
+	// a netted leg cannot move to another curve
+	boost::shared_ptr<hw_yield_curve> yc2( new hw_yield_curve );
+	yc2->setup(rnd,df,0.1,0.01);
+	legs[3]->setup(yc2,0,1000,91,1.0);
+	BOOST_CHECK_THROW(netted->init(0,3000,&g),fbox::error);
+}
+
+
+
+//! Counts calls to update()
+class counted_leg : public instruments::fixed_leg
+{
+public:
+	counted_leg() : calls(0) {}
+	int calls;
+
+	virtual void update(const time_type& _time) { ++calls; instruments::fixed_leg::update(_time); }
+};
+
+
+BOOST_AUTO_TEST_CASE(test_matured_leg_unscheduled)
+{
+	boost::shared_ptr<fbox::math::linear_line> df = get_df();
+
+	// each portfolio has its own curves and drivers, so that they can be compared draw by draw
+	boost::shared_ptr<gaussian_variate> rnd[4];
+	boost::shared_ptr<hw_yield_curve> yc[4];
+	for(int i = 0; i < 4; ++i)
+	{
+		rnd[i].reset( new gaussian_variate );
+		yc[i].reset( new hw_yield_curve );
+		yc[i]->setup(rnd[i],df,0.1,0.01);
+	}
+
+	// curve 0 is only reached through two legs maturing at different times, either side of a long leg on
+	// curve 1. The reference portfolio holds legs that never mature in their place.
+	boost::shared_ptr<counted_leg> short1( new counted_leg );
+	boost::shared_ptr<counted_leg> short2( new counted_leg );
+	boost::shared_ptr<instruments::fixed_leg> long1( new instruments::fixed_leg );
+	short1->setup(yc[0],0,730,91,1.0,100.0);
+	long1->setup(yc[1],0,1820,91,1.0,100.0);
+	short2->setup(yc[0],0,365,91,1.0,100.0);
+
+	boost::shared_ptr<instruments::fixed_leg> ref[3];
+	for(int i = 0; i < 3; ++i)
+	{
+		ref[i].reset( new instruments::fixed_leg );
+		ref[i]->setup(yc[i == 1 ? 3 : 2],0,1820,91,1.0,100.0);
+	}
+
+	boost::shared_ptr<instruments::portfolio> pruned( new instruments::portfolio );
+	boost::shared_ptr<instruments::portfolio> reference( new instruments::portfolio );
+	pruned->add_instrument(short1);
+	pruned->add_instrument(long1);
+	pruned->add_instrument(short2);
+	for(int i = 0; i < 3; ++i) reference->add_instrument(ref[i]);
+
+	generator g0,g1;
+	g0.set_seed(1);
+	g1.set_seed(1);
+	pruned->init(0,1820,&g0);
+	reference->init(0,1820,&g1);
+
+	for(int path = 0; path < 2; ++path)
+	{
+		g0.reset();
+		g1.reset();
+		pruned->reset();
+		reference->reset();
+		short1->calls = short2->calls = 0;
+
+		for(int t = 30; t <= 1800; t += 30)
+		{
+			pruned->update(t);
+			reference->update(t);
+
+			// dropping the matured legs does not change the order in which the drivers draw
+			BOOST_REQUIRE_EQUAL(rnd[0]->state(),rnd[2]->state());
+			BOOST_REQUIRE_EQUAL(rnd[1]->state(),rnd[3]->state());
+			BOOST_REQUIRE_CLOSE(long1->state().value,ref[1]->state().value,1e-10);
+		}
+
+		// a leg is last updated on the step after its final flow, when it stops being live
+		BOOST_CHECK(!short1->is_live());
+		BOOST_CHECK(!short2->is_live());
+		BOOST_CHECK_EQUAL(short1->calls,26);
+		BOOST_CHECK_EQUAL(short2->calls,14);
+		BOOST_CHECK_EQUAL(yc[0]->time(),1800);
+	}
+}
+
+
 BOOST_AUTO_TEST_CASE(test_forward)
 {
 	boost::shared_ptr<fbox::math::linear_line> df = get_df();
@@ -11,6 +11,8 @@
 #include <boost/test/floating_point_comparison.hpp>
 #include "../basic_agents.h"
 #include "../models.h"
+#include "../basic_pricing.h"
+#include "../pipeline.h"
 #include "../simulator.h"
 #include "../observer.h"
 
@@ -164,6 +166,90 @@ BOOST_AUTO_TEST_CASE(test_jump)
 	sim.simulate(x);
 	e = sim.observer(1).value();
 	BOOST_CHECK_CLOSE(10.0,e,1);
+
+	// very high intensity jump, sampled by rejection
+	boost::shared_ptr<constant<double> > vhigh( new constant<double>(500.0) );
+	x->setup(g,vhigh);
+	sim.simulate(x);
+	e = sim.observer(1).value();
+	BOOST_CHECK_CLOSE(500.0,e,0.2);
 }
 
 
+
+
+BOOST_AUTO_TEST_CASE(test_portfolio_events)
+{
+	const fbox::size_type names = 1000;
+	boost::shared_ptr<portfolio_events::counter> counter( new portfolio_events::counter(names) );
+	boost::shared_ptr<constant<double> > h( new constant<double>(0.5) );
+	portfolio_events x;
+	x.setup(counter,h,-1);
+
+	generator g;
+	x.init(0,365,&g);
+
+	const int samples = 20000;
+	double s1 = 0.0,s2 = 0.0;
+	for(int i = 0; i < samples; ++i)
+	{
+		x.reset();
+		x.update(365);
+		BOOST_REQUIRE_EQUAL(counter->state() + x.state(),names);
+		s1 += x.state();
+		s2 += double(x.state()) * x.state();
+	}
+
+	// events over the year are binomial with individual probability 1 - exp(-h)
+	double p = 1.0 - std::exp(-0.5);
+	double m = s1 / samples;
+	BOOST_CHECK_CLOSE(m,names * p,0.5);
+	BOOST_CHECK_CLOSE(s2 / samples - m * m,names * p * (1.0 - p),5);
+}
+
+
+BOOST_AUTO_TEST_CASE(test_pipeline)
+{
+	const int steps = 1000;
+
+	boost::shared_ptr<gaussian_variate> g( new gaussian_variate );
+	boost::shared_ptr<basic_lognormal> x( new basic_lognormal );
+	x->setup(g,0.05,0.2,100.0);
+
+	typedef chain<uniform_stage,chain<normal_stage,lognormal_stage> > gbm_stages;
+	boost::shared_ptr<pipeline<gbm_stages> > p( new pipeline<gbm_stages> );
+	p->stages().second().second().setup(0.05,0.2,100.0);
+
+	generator rnd1,rnd2;
+	rnd1.set_seed(1234);
+	rnd2.set_seed(1234);
+	x->init(0,steps,&rnd1);
+	p->init(0,steps,&rnd2);
+	x->reset();
+	p->reset();
+	BOOST_CHECK_EQUAL(p->state(),100.0);
+
+	// same random numbers, same path
+	for(int i = 1; i <= steps; ++i)
+	{
+		x->update(i);
+		p->update(i);
+		BOOST_REQUIRE_EQUAL(p->state(),x->state());
+	}
+
+	// a pipeline reading another agent, and a payoff stage
+	boost::shared_ptr<pipeline<chain<lognormal_stage,payoff_stage> > > c( new pipeline<chain<lognormal_stage,payoff_stage> > );
+	c->set_source(g);
+	c->stages().first().setup(0.0,0.3,100.0);
+	c->stages().second().setup('p',100.0);
+
+	simulator<expectation> sim;
+	sim.add_fix(0);
+	sim.add_fix(365);
+	sim.set_step(1000);
+	sim.set_samples(100000);
+	sim.simulate(c);
+
+	BOOST_CHECK_SMALL(sim.observer(0).value(),1e-12);
+	BOOST_CHECK_CLOSE(sim.observer(1).value(),fbox::finance::black_scholes('p',100.0,1.0,100.0,0.3),1.0);
+}
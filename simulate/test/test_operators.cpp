@@ -8,6 +8,7 @@
 
 
 #include "../operators.h"
+#include "../operator_fusion.h"
 #include "../basic_agents.h"
 #include "../simulator.h"
 #include "../observer.h"
@@ -175,3 +176,86 @@ BOOST_AUTO_TEST_CASE(test_sequential_ops)
 	BOOST_CHECK_CLOSE(0.0,sim.observer(2).value(),1e-10);
 }
 
+
+
+BOOST_AUTO_TEST_CASE(test_operator_fusion)
+{
+	boost::shared_ptr<fbox::simulate::time> t( new fbox::simulate::time );
+	boost::shared_ptr<constant<double> > x( new constant<double>(3.0) );
+
+	// f = -x + max_t(t + x) * (t - t[-1]) * -x, with -x read twice
+	boost::shared_ptr<unary_operator<operators::negate> > s( new unary_operator<operators::negate> );
+	s->connect(x);
+
+	boost::shared_ptr<binary_operator<operators::sum> > a( new binary_operator<operators::sum> );
+	a->connect(t);
+	a->connect(x);
+
+	boost::shared_ptr<cumulative_operator<operators::maximum> > c( new cumulative_operator<operators::maximum> );
+	c->connect(a);
+
+	boost::shared_ptr<sequential_operator<operators::difference> > d( new sequential_operator<operators::difference> );
+	d->setup(t,-10.0);
+
+	boost::shared_ptr<binary_operator<operators::product> > e( new binary_operator<operators::product> );
+	e->connect(c);
+	e->connect(d);
+	e->connect(s);
+
+	boost::shared_ptr<binary_operator<operators::sum> > f( new binary_operator<operators::sum> );
+	f->connect(s);
+	f->connect(e);
+
+	std::vector<double> expected;
+	f->init(0,100,0);
+	f->reset();
+	expected.push_back(f->state());
+	for(int i = 1; i <= 100; i += 7)
+	{
+		f->update(i);
+		expected.push_back(f->state());
+	}
+
+	// s has two readers and stays; a, c, d and e are folded into f
+	double_agent_ptr root = f;
+	BOOST_CHECK_EQUAL(fuse_operators(root),4u);
+	BOOST_CHECK(root != f);
+	BOOST_CHECK_EQUAL(boost::dynamic_pointer_cast<fused_operator>(root)->size(),5u);
+
+	for(int k = 0; k < 2; ++k)
+	{
+		root->init(0,100,0);
+		root->reset();
+		BOOST_CHECK_EQUAL(root->state(),expected[0]);
+		for(int i = 1,j = 1; i <= 100; i += 7,++j)
+		{
+			root->update(i);
+			BOOST_CHECK_EQUAL(root->state(),expected[j]);
+		}
+	}
+
+	// lone operators and other agents are left alone
+	double_agent_ptr lone = s;
+	BOOST_CHECK_EQUAL(fuse_operators(lone),0u);
+	BOOST_CHECK(lone == s);
+
+	double_agent_ptr other = x;
+	BOOST_CHECK_EQUAL(fuse_operators(other),0u);
+	BOOST_CHECK(other == x);
+
+	// e is also read elsewhere: it is fused on its own and f reads it
+	std::vector<double_agent_ptr> roots;
+	roots.push_back(f);
+	roots.push_back(e);
+	BOOST_CHECK_EQUAL(fuse_operators(roots),3u);
+	BOOST_CHECK_EQUAL(boost::dynamic_pointer_cast<fused_operator>(roots[0])->size(),1u);
+	BOOST_CHECK_EQUAL(boost::dynamic_pointer_cast<fused_operator>(roots[1])->size(),4u);
+
+	roots[0]->init(0,100,0);
+	roots[0]->reset();
+	for(int i = 1,j = 1; i <= 100; i += 7,++j)
+	{
+		roots[0]->update(i);
+		BOOST_CHECK_EQUAL(roots[0]->state(),expected[j]);
+	}
+}
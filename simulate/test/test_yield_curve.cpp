@@ -12,6 +12,7 @@
 #include <fbox/line.h>
 #include "../yield_curve_models.h"
 #include "../basic_agents.h"
+#include "../models.h"
 #include "../simulator.h"
 #include "../observer.h"
 
@@ -139,3 +140,209 @@ BOOST_AUTO_TEST_CASE(test_hw)
 	sim.simulate(bnd);
 	BOOST_CHECK_CLOSE(sim.observer(0).expectation(),(*df)(730.0),1e-6);
 }
+
+
+BOOST_AUTO_TEST_CASE(test_hw_large_steps)
+{
+	double rf = 0.05;
+	boost::shared_ptr<fbox::math::linear_line> df( new fbox::math::linear_line );
+	for(double t = 0.0; t < 3651.0; t += 10.0) df->add(t,exp(-rf*t/365.0));
+
+	boost::shared_ptr<gaussian_variate> rnd( new gaussian_variate );
+	boost::shared_ptr<gaussian_variate> irnd( new gaussian_variate );
+	boost::shared_ptr<hw_yield_curve> yc( new hw_yield_curve );
+
+	boost::shared_ptr<hw_yield_curve::spot_bond> bnd( new hw_yield_curve::spot_bond );
+	bnd->setup(yc);
+
+	simulator<statistics> sim;
+	sim.add_fix(0);
+	sim.add_fix(1825);
+	sim.set_samples(20000);
+	sim.set_step(1825); // single step to maturity
+
+	// cash account is the conditional expectation given the short rate path
+	yc->setup(rnd,df,0.1,0.01);
+	sim.simulate(bnd);
+	BOOST_CHECK_CLOSE(sim.observer(1).expectation(),(*df)(1825.0),0.1);
+
+	// cash account sampled jointly with the short rate
+	yc->setup(rnd,df,0.1,0.01,irnd);
+	sim.simulate(bnd);
+	BOOST_CHECK_CLOSE(sim.observer(1).expectation(),(*df)(1825.0),0.2);
+
+	// vanishing mean reversion
+	yc->setup(rnd,df,0.0,0.01);
+	sim.simulate(bnd);
+	BOOST_CHECK_CLOSE(sim.observer(1).expectation(),(*df)(1825.0),0.1);
+}
+
+
+//! Largest difference between the batch and single maturity discount factors of a curve
+class batch_discount_check
+:	public single_agent_impl<double>
+{
+public:
+	void setup(yield_curve_ptr _yc) { connect(mp_yc = _yc); }
+
+protected:
+	yield_curve_ptr mp_yc;
+
+	void reset_impl() { update_impl(); }
+
+	bool update_impl()
+	{
+		const duration_type terms[] = { 0, 1, 45, 91, 200, 365, 800, 2000 };
+		const fbox::size_type n = sizeof(terms) / sizeof(terms[0]);
+
+		time_type mats[n];
+		double df[n];
+		for(fbox::size_type i = 0; i < n; ++i) mats[i] = m_time + terms[i];
+		mp_yc->discount(mats,df,n);
+
+		m_state = 0.0;
+		for(fbox::size_type i = 0; i < n; ++i) m_state = std::max(m_state,std::fabs(df[i] - mp_yc->discount(mats[i])));
+
+		return true;
+	}
+};
+
+
+BOOST_AUTO_TEST_CASE(test_batch_discount)
+{
+	boost::shared_ptr<fbox::math::linear_line> df( new fbox::math::linear_line );
+	for(double t = 0.0; t < 5000.0; t += 10.0) df->add(t,exp(-0.05*t/365.0));
+
+	boost::shared_ptr<gaussian_variate> rnd( new gaussian_variate );
+	boost::shared_ptr<constant<double> > level( new constant<double>(0.05) );
+
+	boost::shared_ptr<basic_ou> r1( new basic_ou ),r2( new basic_ou ),r3( new basic_ou );
+	r1->setup(rnd,level,0.1,0.01,0.03);
+	r2->setup(rnd,level,0.1,0.01,0.04);
+	r3->setup(rnd,level,0.1,0.01,0.05);
+
+	boost::shared_ptr<hw_yield_curve> hw( new hw_yield_curve );
+	hw->setup(rnd,df,0.1,0.01);
+
+	boost::shared_ptr<libor_yield_curve> libor( new libor_yield_curve );
+	libor->set_tenor(91);
+	libor->add_rate(r1);
+	libor->add_rate(r2);
+	libor->add_rate(r3);
+
+	boost::shared_ptr<swap_yield_curve> swap( new swap_yield_curve );
+	swap->add_rate(r1,91);
+	swap->add_rate(r2,365);
+	swap->add_rate(r3,1826);
+
+	boost::shared_ptr<static_yield_curve> stat( new static_yield_curve );
+	stat->setup(df);
+
+	boost::shared_ptr<constant_rate_yield_curve> flat( new constant_rate_yield_curve );
+	flat->setup(0.02);
+
+	boost::shared_ptr<combined_yield_curve> comb( new combined_yield_curve );
+	comb->setup(hw,libor);
+
+	simulator<statistics> sim;
+	sim.add_fix(0);
+	sim.add_fix(365);
+	sim.add_fix(1000);
+	sim.set_samples(10);
+	sim.set_step(30);
+
+	yield_curve_ptr curves[] = { hw, libor, swap, stat, flat, comb };
+	for(fbox::size_type i = 0; i < sizeof(curves) / sizeof(curves[0]); ++i)
+	{
+		boost::shared_ptr<batch_discount_check> check( new batch_discount_check );
+		check->setup(curves[i]);
+		sim.simulate(check);
+
+		for(fbox::size_type j = 0; j < 3; ++j) BOOST_CHECK_SMALL(sim.observer(j).expectation(),1e-12);
+	}
+}
+
+
+//! Static curve that counts how many maturities it is asked to evaluate
+class counting_yield_curve
+:	public static_yield_curve
+{
+public:
+	fbox::size_type count;
+
+protected:
+	double discount_impl(const time_type& _time) 
+	{
+		++count;
+		return static_yield_curve::discount_impl(_time);
+	}
+
+	void discount_impl(const time_type* _maturities,double* _out,fbox::size_type _n)
+	{
+		count += _n;
+		static_yield_curve::discount_impl(_maturities,_out,_n);
+	}
+};
+
+
+//! Number of maturities a curve evaluates while answering the same few queries repeatedly
+class memo_check
+:	public single_agent_impl<double>
+{
+public:
+	void setup(boost::shared_ptr<counting_yield_curve> _yc) { connect(mp_yc = _yc); }
+
+protected:
+	boost::shared_ptr<counting_yield_curve> mp_yc;
+
+	void reset_impl() { update_impl(); }
+
+	bool update_impl()
+	{
+		time_type mats[] = { m_time + 365, m_time + 730, m_time + 365 };
+		double df[3];
+
+		fbox::size_type count = mp_yc->count;
+		double d1 = mp_yc->discount(mats[0]);
+		double d2 = mp_yc->discount(mats[0]);
+		mp_yc->discount(mats,df,3);
+		m_state = mp_yc->count - count;
+
+		if (d1 != d2 || d1 != df[0] || df[1] != mp_yc->discount(mats[1])) m_state = -1.0;
+		if (mp_yc->memo_size() > 2) m_state = -1.0; // earlier steps' maturities are gone
+
+		return true;
+	}
+};
+
+
+BOOST_AUTO_TEST_CASE(test_discount_memo)
+{
+	boost::shared_ptr<fbox::math::linear_line> df( new fbox::math::linear_line );
+	for(double t = 0.0; t < 5000.0; t += 10.0) df->add(t,exp(-0.05*t/365.0));
+
+	boost::shared_ptr<counting_yield_curve> yc( new counting_yield_curve );
+	yc->setup(df);
+	yc->count = 0;
+
+	boost::shared_ptr<memo_check> check( new memo_check );
+	check->setup(yc);
+
+	simulator<statistics> sim;
+	sim.add_fix(0);
+	sim.add_fix(365);
+	sim.set_samples(3);
+	sim.set_step(30);
+
+	// without memoization every query is evaluated
+	sim.simulate(check);
+	BOOST_CHECK_EQUAL(sim.observer(0).expectation(),5.0);
+	BOOST_CHECK_EQUAL(sim.observer(1).expectation(),5.0);
+
+	// with memoization each distinct maturity is evaluated once per step
+	yc->set_memoize(true);
+	sim.simulate(check);
+	BOOST_CHECK_EQUAL(sim.observer(0).expectation(),2.0);
+	BOOST_CHECK_EQUAL(sim.observer(1).expectation(),2.0);
+	BOOST_CHECK_EQUAL(yc->memo_size(),2);
+}
@@ -16,6 +16,100 @@ namespace simulate {
 // basic_yield_curve
 //////////////////////////////////////////////////////
 
+double basic_yield_curve::discount(const time_type& _time)
+{
+	if (!m_memoize) return discount_impl(_time);
+
+	memo_map_type& m = memo();
+	memo_map_type::const_iterator itr = m.find(_time);
+	if (itr != m.end()) return itr->second;
+
+	double df = discount_impl(_time);
+	m.insert(memo_map_type::value_type(_time,df));
+	return df;
+}
+
+
+void basic_yield_curve::discount(const time_type* _maturities,double* _out,size_type _n)
+{
+	if (!m_memoize) 
+	{
+		discount_impl(_maturities,_out,_n);
+		return;
+	}
+
+	// serve what we can from the memo and evaluate the rest in a single batch
+	memo_map_type& m = memo();
+	m_miss_times.clear();
+	m_miss_index.clear();
+	for(size_type i = 0; i < _n; ++i)
+	{
+		memo_map_type::const_iterator itr = m.find(_maturities[i]);
+		if (itr != m.end())
+		{
+			_out[i] = itr->second;
+		}
+		else
+		{
+			m_miss_times.push_back(_maturities[i]);
+			m_miss_index.push_back(i);
+		}
+	}
+
+	size_type n = m_miss_times.size();
+	if (n == 0) return;
+
+	m_miss_values.resize(n);
+	discount_impl(&m_miss_times[0],&m_miss_values[0],n);
+
+	for(size_type i = 0; i < n; ++i)
+	{
+		_out[m_miss_index[i]] = m_miss_values[i];
+		m.insert(memo_map_type::value_type(m_miss_times[i],m_miss_values[i]));
+	}
+}
+
+
+void basic_yield_curve::set_memoize(bool _memoize)
+{
+	m_memoize = _memoize;
+	m_memo.clear();
+}
+
+
+void basic_yield_curve::reset()
+{
+	if (!m_reset) ++m_step;
+	multi_agent_impl<double>::reset();
+}
+
+
+void basic_yield_curve::update(const time_type& _time)
+{
+	if (_time > m_time) ++m_step;
+	multi_agent_impl<double>::update(_time);
+}
+
+
+void basic_yield_curve::discount_impl(const time_type* _maturities,double* _out,size_type _n)
+{
+	for(size_type i = 0; i < _n; ++i) _out[i] = discount_impl(_maturities[i]);
+}
+
+
+basic_yield_curve::memo_map_type& basic_yield_curve::memo()
+{
+	// the first query of a step drops the previous step's maturities, so the memo cannot grow with time
+	if (m_memo_step != m_step)
+	{
+		m_memo.clear();
+		m_memo_step = m_step;
+	}
+
+	return m_memo;
+}
+
+
 void basic_yield_curve::basic_bond::setup(
 	shared_ptr<basic_yield_curve> _yc,
 	const time_type& _end)
@@ -87,12 +181,20 @@ double constant_rate_yield_curve::discount()
 }
 
 
-double constant_rate_yield_curve::discount(const time_type& _time)
+double constant_rate_yield_curve::discount_impl(const time_type& _time)
 {
 	return std::exp(-m_rate * (_time - m_time)/365.0);
 }
 
 
+void constant_rate_yield_curve::discount_impl(const time_type* _maturities,double* _out,size_type _n)
+{
+	double r = -m_rate / 365.0;
+	for(size_type i = 0; i < _n; ++i) _out[i] = r * (_maturities[i] - m_time);
+	for(size_type i = 0; i < _n; ++i) _out[i] = std::exp(_out[i]);
+}
+
+
 //////////////////////////////////////////////////////
 // static_yield_curve
 //////////////////////////////////////////////////////
@@ -100,18 +202,29 @@ double constant_rate_yield_curve::discount(const time_type& _time)
 void static_yield_curve::setup(shared_ptr<math::line> _discount_factors)
 {
 	mp_df = _discount_factors;
+	m_hint = -1;
 }
 
 
 double static_yield_curve::discount()
 {
-	return (*mp_df)(m_time);
+	return (*mp_df)(m_time,m_hint);
 }
 
 
-double static_yield_curve::discount(const time_type& _time)
+double static_yield_curve::discount_impl(const time_type& _time)
 {
-	return (*mp_df)(_time) / (*mp_df)(m_time);
+	return (*mp_df)(_time) / (*mp_df)(m_time,m_hint);
+}
+
+
+void static_yield_curve::discount_impl(const time_type* _maturities,double* _out,size_type _n)
+{
+	double df = 1.0 / (*mp_df)(m_time,m_hint);
+
+	m_x.assign(_maturities,_maturities + _n);
+	if (_n) mp_df->evaluate(&m_x[0],_out,_n);
+	for(size_type i = 0; i < _n; ++i) _out[i] *= df;
 }
 
 
@@ -123,7 +236,8 @@ void static_yield_curve::reset_impl()
 
 bool static_yield_curve::update_impl()
 {
-	m_state = log( (*mp_df)(m_time) / (*mp_df)(m_time+1) ) * 365.0;
+	int hint = m_hint;
+	m_state = log( (*mp_df)(m_time,m_hint) / (*mp_df)(m_time+1,hint) ) * 365.0;
 	return true;
 }
 
@@ -136,7 +250,8 @@ void libor_yield_curve::clear()
 {
 	clear_connected();
 	m_rates.clear();
-	m_df.clear();
+	m_log_df.clear();
+	m_rate.clear();
 }
 
 
@@ -150,7 +265,8 @@ void libor_yield_curve::add_rate(double_agent_ptr _rate)
 {
 	connect(_rate);
 	m_rates.push_back(_rate);
-	m_df.push_back(1.0);
+	m_log_df.push_back(0.0);
+	m_rate.push_back(0.0);
 }
 
 
@@ -160,20 +276,34 @@ double libor_yield_curve::discount()
 }
 
 
-double libor_yield_curve::discount(const time_type& _time)
+double libor_yield_curve::discount_impl(const time_type& _time)
 {
 	double t = _time - m_time;
 	double n = t / m_tenor;
 	size_type i = static_cast<size_type>(n);
-	size_type i1 = i >= m_rates.size()? m_rates.size()-1 : i;
+	if (i >= m_rate.size()) i = m_rate.size() - 1;
 
-	double acc = year_fraction.yf(t - i1 * m_tenor);
-	double df = std::exp(-m_rates[i1]->state() * acc);
+	double acc = year_fraction.yf(t - i * m_tenor);
+	return std::exp((i == 0? 0.0 : m_log_df[i-1]) - m_rate[i] * acc);
+}
 
-	if (i == 0)
-		return df;
-	else
-		return m_df[i-1] * df;
+
+void libor_yield_curve::discount_impl(const time_type* _maturities,double* _out,size_type _n)
+{
+	size_type last = m_rate.size() - 1;
+
+	// exponents first so that the exponentials run in a separate, branch free loop
+	for(size_type k = 0; k < _n; ++k)
+	{
+		double t = _maturities[k] - m_time;
+		size_type i = static_cast<size_type>(t / m_tenor);
+		if (i > last) i = last;
+
+		double acc = year_fraction.yf(t - i * m_tenor);
+		_out[k] = (i == 0? 0.0 : m_log_df[i-1]) - m_rate[i] * acc;
+	}
+
+	for(size_type k = 0; k < _n; ++k) _out[k] = std::exp(_out[k]);
 }
 
 
@@ -186,19 +316,22 @@ void libor_yield_curve::reset_impl()
 
 bool libor_yield_curve::update_impl()
 {
+	// snapshot the rates for this step
+	for(size_type i = 0; i < m_rates.size(); ++i) m_rate[i] = m_rates[i]->state();
+
 	// update spot discount factor
 	double dt = year_fraction.yf(time_interval());
-	m_spot_df *= std::exp(-(*m_rates.begin())->state() * dt);
+	m_spot_df *= std::exp(-m_rate[0] * dt);
 
-	// update future discount factors
-	double df = 1.0;
+	// update cumulative log discount factors
+	double ldf = 0.0;
 	double t = year_fraction.yf(m_tenor);
-	for(size_type i = 0; i < m_rates.size(); ++i)
+	for(size_type i = 0; i < m_rate.size(); ++i)
 	{
-		df = m_df[i] = df * std::exp(-m_rates[i]->state() * t);
+		ldf = m_log_df[i] = ldf - m_rate[i] * t;
 	}
 
-	m_state = m_rates[0]->state();
+	m_state = m_rate[0];
 
 	return true;
 }
@@ -235,7 +368,7 @@ double swap_yield_curve::discount()
 }
 
 
-double swap_yield_curve::discount(const time_type& _time)
+double swap_yield_curve::discount_impl(const time_type& _time)
 {
 	rate_vector_type::iterator itr = m_rates.begin();
 	while(itr != m_rates.end() && itr->tenor > _time) ++itr;
@@ -249,6 +382,23 @@ double swap_yield_curve::discount(const time_type& _time)
 }
 
 
+void swap_yield_curve::discount_impl(const time_type* _maturities,double* _out,size_type _n)
+{
+	for(size_type k = 0; k < _n; ++k)
+	{
+		rate_vector_type::iterator itr = m_rates.begin();
+		while(itr != m_rates.end() && itr->tenor > _maturities[k]) ++itr;
+
+		if (itr == m_rates.begin())
+			_out[k] = 0.0;
+		else
+			_out[k] = -(--itr)->rate->state() * year_fraction.yf(_maturities[k]);
+	}
+
+	for(size_type k = 0; k < _n; ++k) _out[k] = std::exp(_out[k]);
+}
+
+
 void swap_yield_curve::reset_impl()
 {
 	m_spot_df = 1.0;
@@ -279,16 +429,26 @@ void swap_yield_curve::dump(std::ostream& _strm) const
 // hw_yield_curve
 //////////////////////////////////////////////////////
 
+//! (1 - exp(-m.t)) / m, stable as m.t goes to zero
 inline double emt(double m,double t)
 {
-	if (m * t > 2e-1) return (1.0 - std::exp(-m * t)) / m;
-	else return (1.0 - m * t / 2.0) * t; // 2nd order expansion of the above
+	if (m * t > 1e-2) return (1.0 - std::exp(-m * t)) / m;
+	else return (1.0 - m * t / 2.0 + m * m * t * t / 6.0) * t; // 3rd order expansion of the above
+}
+
+
+//! Variance of the integral over [0,t] of an OU process with unit volatility and reversion speed m
+inline double emt_integral_variance(double m,double t)
+{
+	if (m * t > 1e-2) return (t - 2.0 * emt(m,t) + emt(2.0 * m,t)) / (m * m);
+	else return t * t * t * (1.0 / 3.0 - m * t / 4.0 + 7.0 * m * m * t * t / 60.0); // series expansion of the above
 }
 
 
 void hw_yield_curve::calibrator::setup(shared_ptr<math::line> _bonds,double _mrs,double _vol)
 {
 	bonds = _bonds;
+	hint = -1;
 	mrs = _mrs;
 	vol = _vol;
 }
@@ -296,34 +456,57 @@ void hw_yield_curve::calibrator::setup(shared_ptr<math::line> _bonds,double _mrs
 
 void hw_yield_curve::calibrator::reset_impl()
 {
-	m_state.b = (*bonds)(m_start);
+	m_state.b = (*bonds)(m_start,hint);
 	m_state.f = -std::log((*bonds)(m_start+1) / m_state.b) * year_fraction.ratio();
-	a = m_state.mu = m_state.f;
+	m_state.alpha = m_state.f;
+	m_state.ialpha = 0.0;
+	m_state.table.reset(new bond_table);
 }
 
 
 bool hw_yield_curve::calibrator::update_impl()
 {
 	double t = year_fraction.yf( time() - start() );
-	double dt = year_fraction.yf( time_interval() );
+	double t0 = year_fraction.yf( time() - time_interval() - start() );
+	double b0 = (*bonds)(m_time - time_interval(),hint);
 
-	m_state.b = (*bonds)(m_time);
-	m_state.f = -std::log((*bonds)(m_time+1) / m_state.b) * year_fraction.ratio();
+	m_state.b = (*bonds)(m_time,hint);
+	m_state.f = -std::log((*bonds)(m_time+1,hint) / m_state.b) * year_fraction.ratio();
 
-	double g = (1.0 - std::exp(-mrs * t)) / mrs * vol;
-	double a1 = m_state.f + g * g / 2.0;
-	m_state.mu = a1 - a * std::exp(-mrs * dt);
-	a = a1;
+	// alpha(t) = f(0,t) + vol^2 B(t)^2 / 2 and its exact integral over the last step
+	double g = emt(mrs,t) * vol;
+	m_state.alpha = m_state.f + g * g / 2.0;
+	m_state.ialpha = std::log(b0 / m_state.b) + vol * vol * (emt_integral_variance(mrs,t) - emt_integral_variance(mrs,t0)) / 2.0;
+	m_state.table.reset(new bond_table);
 
 	return true;
 }
 
 
+const hw_yield_curve::bond_terms& hw_yield_curve::calibrator::terms(const time_type& _mat) const
+{
+	bond_table& table = *state().table;
+	bond_table::iterator itr = table.lower_bound(_mat);
+	if (itr != table.end() && itr->first == _mat) return itr->second;
+
+	const cstate& s = state();
+	double t = year_fraction.yf( time() - start() );
+	double dt = year_fraction.yf(_mat - time());
+
+	bond_terms bt;
+	bt.b = emt(mrs,dt);
+	bt.lna = std::log((*bonds)(_mat) / s.b) + bt.b * (s.f - bt.b * vol * vol * emt(2.0 * mrs,t) / 2.0);
+
+	return table.insert(itr,bond_table::value_type(_mat,bt))->second;
+}
+
+
 void hw_yield_curve::setup(
 	double_agent_ptr _rnd,
 	shared_ptr<math::line> _bonds,
 	double _reversion_speed,
-	double _volatility)
+	double _volatility,
+	double_agent_ptr _integral_rnd)
 {
 	mp_calibrator.reset(new calibrator);
 	mp_calibrator->setup(_bonds,_reversion_speed,_volatility);
@@ -331,31 +514,45 @@ void hw_yield_curve::setup(
 	clear_connected();
 	connect(mp_rnd = _rnd);
 	connect(mp_calibrator);
+
+	mp_irnd = _integral_rnd;
+	if (mp_irnd) connect(mp_irnd);
 }
 
 
 void hw_yield_curve::reset_impl()
 {
 	m_state = mp_calibrator->state().f;
+	m_x = 0.0;
 	m_df = 1.0;
 }
 
 
 bool hw_yield_curve::update_impl()
 {
-	double last = m_state;
-
 	double mrs = mp_calibrator->mrs;
 	double vol = mp_calibrator->vol;
-	double mu = mp_calibrator->state().mu;
-
 	double dt = year_fraction.yf(time_interval());
 
-	double e = last * std::exp(-mrs * dt) + mu;
-	double v = ( (1.0 - std::exp(-2.0 * mrs * dt)) / mrs ) * vol * vol / 2.0;
+	// exact joint Gaussian transition of x(t+dt) and of the integral of x over [t,t+dt]
+	double b = emt(mrs,dt);
+	double vx = vol * vol * emt(2.0 * mrs,dt);
+	double vi = vol * vol * emt_integral_variance(mrs,dt);
+	double cxi = vol * vol * b * b / 2.0;
 
-	m_state = e + sqrt(v) * mp_rnd->state();
-	m_df *= std::exp(-(last+m_state)/2.0 * dt); // rough approximation
+	double ex = vx > 0.0? std::sqrt(vx) * mp_rnd->state() : 0.0;
+	double beta = vx > 0.0? cxi / vx : 0.0;
+	double vcond = std::max(vi - beta * cxi,0.0);
+
+	double integral = m_x * b + beta * ex + mp_calibrator->state().ialpha;
+
+	if (mp_irnd)
+		m_df *= std::exp(-integral - std::sqrt(vcond) * mp_irnd->state());
+	else
+		m_df *= std::exp(-integral + vcond / 2.0);
+
+	m_x = m_x * std::exp(-mrs * dt) + ex;
+	m_state = m_x + mp_calibrator->state().alpha;
 
 	return true;
 }
@@ -367,23 +564,22 @@ double hw_yield_curve::discount()
 }
 
 
-double hw_yield_curve::discount(const time_type& _time)
+double hw_yield_curve::discount_impl(const time_type& _time)
 {
-	double m = mp_calibrator->mrs;
-	double v = mp_calibrator->vol;
-	double b = mp_calibrator->state().b;
-	double f = mp_calibrator->state().f;
+	const bond_terms& bt = mp_calibrator->terms(_time);
+	return std::exp(bt.lna - bt.b * m_state);
+}
 
-	double fb = (*mp_calibrator->bonds)(_time) / b;
 
-	double t = year_fraction.yf( time() - start() );
-	double dt = year_fraction.yf(_time - m_time);
-	
-	double B = (1.0 - std::exp(-m * dt)) / m;
-	double s = (1.0 - std::exp(-2.0 * m * t)) / m;
-	double A = fb * std::exp( B * (f - B * v * v * s / 4.0) );
-	
-	return A * std::exp(-B * m_state);
+void hw_yield_curve::discount_impl(const time_type* _maturities,double* _out,size_type _n)
+{
+	for(size_type k = 0; k < _n; ++k)
+	{
+		const bond_terms& bt = mp_calibrator->terms(_maturities[k]);
+		_out[k] = bt.lna - bt.b * m_state;
+	}
+
+	for(size_type k = 0; k < _n; ++k) _out[k] = std::exp(_out[k]);
 }
 
  
@@ -423,7 +619,7 @@ double shifted_yield_curve::discount()
 }
 
 
-double shifted_yield_curve::discount(const time_type& _time)
+double shifted_yield_curve::discount_impl(const time_type& _time)
 {
 	double dt = _time - m_time;
 
@@ -434,6 +630,16 @@ double shifted_yield_curve::discount(const time_type& _time)
 }
 
 
+void shifted_yield_curve::discount_impl(const time_type* _maturities,double* _out,size_type _n)
+{
+	if (m_type == additive)
+		throw error("Additive rate shifts are not allowed yet. Use combined_yield_curve instead.");
+
+	mp_yc->discount(_maturities,_out,_n);
+	for(size_type i = 0; i < _n; ++i) _out[i] = std::pow(_out[i],(*mp_shift)(_maturities[i] - m_time));
+}
+
+
 void shifted_yield_curve::reset_impl()
 {
 	update_impl();
@@ -472,12 +678,23 @@ double combined_yield_curve::discount()
 }
 
 
-double combined_yield_curve::discount(const time_type& _time)
+double combined_yield_curve::discount_impl(const time_type& _time)
 {
 	return mp_yc1->discount(_time) * mp_yc2->discount(_time);
 }
 
 
+void combined_yield_curve::discount_impl(const time_type* _maturities,double* _out,size_type _n)
+{
+	if (_n == 0) return;
+
+	m_buffer.resize(_n);
+	mp_yc1->discount(_maturities,_out,_n);
+	mp_yc2->discount(_maturities,&m_buffer[0],_n);
+	for(size_type i = 0; i < _n; ++i) _out[i] *= m_buffer[i];
+}
+
+
 void combined_yield_curve::reset_impl()
 {
 	update_impl();
@@ -8,6 +8,8 @@
 	Yield curve models
 */
 
+#include <map>
+#include <boost/unordered_map.hpp>
 #include <fbox/main.h>
 #include <fbox/line.h>
 #include "agent_impl.h"
@@ -18,15 +20,34 @@ namespace fbox {
 namespace simulate {
 
 //! Discount factor and interest rate interface for yield curve models
+/*!
+	Models implement <code>discount_impl()</code>. When memoization is enabled each distinct maturity is
+	evaluated at most once per step, no matter how many instruments ask for it. The memo is emptied on the
+	first query after the curve is reset or updated, so it only ever holds the maturities of one step.
+*/
 class basic_yield_curve
 :	public multi_agent_impl<double>
 {
 public:
+	basic_yield_curve() : m_memoize(false),m_step(1),m_memo_step(0) {}
+
 	//! Rolling discount bond (cash numeraire)
 	virtual double discount() = 0;
 
 	//! Discount bond maturing at _time
-	virtual double discount(const time_type& _time) = 0;
+	double discount(const time_type& _time);
+
+	//! Discount bonds maturing at each of _maturities[0.._n)
+	void discount(const time_type* _maturities,double* _out,size_type _n);
+
+	//! Memoize discount factors by maturity within each step (off by default)
+	void set_memoize(bool _memoize);
+
+	//! Number of maturities memoized in the current step
+	size_type memo_size() const { return m_memo_step == m_step? m_memo.size() : 0; }
+
+	virtual void reset();
+	virtual void update(const time_type& _time);
 
 public:
 	//! Term/rolling bond interface and common interface
@@ -96,6 +117,26 @@ public:
 
 protected:
 	fbox::simulate::year_fraction<double> year_fraction;
+
+	//! Discount bond maturing at _time
+	virtual double discount_impl(const time_type& _time) = 0;
+
+	//! Batch version of the above. Models override this to share the per-step work across maturities,
+	//! the default simply calls discount_impl(time) for each one.
+	virtual void discount_impl(const time_type* _maturities,double* _out,size_type _n);
+
+private:
+	typedef boost::unordered_map<time_type,double> memo_map_type;
+
+	bool m_memoize;
+	size_type m_step;					//!< Incremented whenever the curve state changes
+	size_type m_memo_step;				//!< Step whose discount factors m_memo holds
+	memo_map_type m_memo;
+	std::vector<time_type> m_miss_times;
+	std::vector<size_type> m_miss_index;
+	std::vector<double> m_miss_values;
+
+	memo_map_type& memo();
 };
 
 
@@ -109,9 +150,12 @@ public:
 	void setup(double _rate);
 
 	virtual double discount();
-	virtual double discount(const time_type& _time);
+	using basic_yield_curve::discount;
 
 protected:
+	virtual double discount_impl(const time_type& _time);
+	virtual void discount_impl(const time_type* _maturities,double* _out,size_type _n);
+
 	double m_rate;
 
 	void reset_impl() {}
@@ -127,10 +171,15 @@ public:
 	void setup(shared_ptr<math::line> _discount_factors);
 
 	virtual double discount();
-	virtual double discount(const time_type& _time);
+	using basic_yield_curve::discount;
 
 protected:
+	virtual double discount_impl(const time_type& _time);
+	virtual void discount_impl(const time_type* _maturities,double* _out,size_type _n);
+
 	shared_ptr<math::line> mp_df;
+	int m_hint; //!< Segment of the last lookup at the current time
+	std::vector<double> m_x; //!< Maturities buffer for batch lookups
 
 	void reset_impl();
 	bool update_impl();
@@ -163,12 +212,16 @@ public:
 	void set_tenor(duration_type const& _tenor);
 
 	virtual double discount();
-	virtual double discount(const time_type& _time);
+	using basic_yield_curve::discount;
 	virtual void dump(std::ostream& _strm) const;
 
 protected:
+	virtual double discount_impl(const time_type& _time);
+	virtual void discount_impl(const time_type* _maturities,double* _out,size_type _n);
+
 	double m_spot_df;
-	std::vector<double> m_df;
+	std::vector<double> m_log_df;		//!< Cumulative log discount factor to the end of each tenor
+	std::vector<double> m_rate;			//!< Rate states for the current step
 	std::vector<double_agent_ptr> m_rates;
 	duration_type m_tenor;
 
@@ -200,10 +253,13 @@ public:
 	void add_rate(double_agent_ptr _rate,duration_type const& _tenor);
 
 	virtual double discount();
-	virtual double discount(const time_type& _time);
+	using basic_yield_curve::discount;
 	virtual void dump(std::ostream& _strm) const;
 
 protected:
+	virtual double discount_impl(const time_type& _time);
+	virtual void discount_impl(const time_type* _maturities,double* _out,size_type _n);
+
 	struct rate_type
 	{
 		rate_type(double_agent_ptr _rate,duration_type const& _tenor) : rate(_rate),tenor(_tenor) {}
@@ -223,6 +279,17 @@ protected:
 
 
 //! Hull-White (aka extended Vasicek) short rate yield curve model
+/*!
+	The short rate r = x + alpha is stepped with the exact transition of the underlying OU process x,
+	and the cash account uses the exact joint Gaussian law of x and its integral over each step, so
+	any step size gives unbiased results. If a second driver is provided the integral is sampled
+	jointly with the short rate, otherwise the cash account is the conditional expectation of the
+	exact one given the short rate at either end of the step.
+
+	Bond prices are P(t,T) = exp(ln A(t,T) - B(t,T) r). The deterministic ln A and B terms are tabulated
+	by maturity on each simulation step the first time they are needed. The tables live in the cached
+	calibrator state, so every later sample reuses them.
+*/
 class hw_yield_curve
 :	public basic_yield_curve
 {
@@ -231,27 +298,36 @@ public:
 		double_agent_ptr _rnd,			//!< Driving generator
 		shared_ptr<math::line> _bonds,	//!< Discount factors
 		double _reversion_speed,		//!< Mean reversion speed
-		double _volatility);			//!< Volatility
+		double _volatility,				//!< Volatility
+		double_agent_ptr _integral_rnd = double_agent_ptr()); //!< Optional independent driver for the short rate integral
 
 	virtual double discount();
-	virtual double discount(const time_type& _time);
+	using basic_yield_curve::discount;
 	virtual void dump(std::ostream& _strm) const;
 
 protected:
-	struct cstate { double b,f,mu; };
+	virtual double discount_impl(const time_type& _time);
+	virtual void discount_impl(const time_type* _maturities,double* _out,size_type _n);
+
+	struct bond_terms { double lna,b; };
+	typedef std::map<time_type,bond_terms> bond_table;
+
+	struct cstate { double b,f,alpha,ialpha; shared_ptr<bond_table> table; };
 	struct calibrator : public standalone_cached_agent_impl<cstate>
 	{
 		fbox::simulate::year_fraction<double> year_fraction;
-		double mrs,vol,a,a0;
+		double mrs,vol;
 		shared_ptr<math::line> bonds;
+		int hint;
 		void setup(shared_ptr<math::line> _bonds,double _mrs,double _vol);
+		const bond_terms& terms(const time_type& _mat) const; //!< ln A and B for a bond maturing at _mat
 		virtual void reset_impl();
 		virtual bool update_impl();
 	};
 
-	double_agent_ptr mp_rnd;
+	double_agent_ptr mp_rnd,mp_irnd;
 	shared_ptr<calibrator> mp_calibrator;
-	double m_df;
+	double m_df,m_x;
 
 	virtual void reset_impl();
 	virtual bool update_impl();
@@ -275,9 +351,12 @@ public:
 		shift_type _type);					//!< Type of shift
 
 	virtual double discount();
-	virtual double discount(const time_type& _time);
+	using basic_yield_curve::discount;
 
 protected:
+	virtual double discount_impl(const time_type& _time);
+	virtual void discount_impl(const time_type* _maturities,double* _out,size_type _n);
+
 	shared_ptr<basic_yield_curve> mp_yc;
 	shared_ptr<math::line> mp_shift;
 	shift_type m_type;
@@ -297,10 +376,14 @@ public:
 		shared_ptr<basic_yield_curve> _yc2);	//!< Second yield curve
 
 	virtual double discount();
-	virtual double discount(const time_type& _time);
+	using basic_yield_curve::discount;
 
 protected:
+	virtual double discount_impl(const time_type& _time);
+	virtual void discount_impl(const time_type* _maturities,double* _out,size_type _n);
+
 	shared_ptr<basic_yield_curve> mp_yc1,mp_yc2;
+	std::vector<double> m_buffer;
 
 	void reset_impl();
 	bool update_impl();